@@ -0,0 +1,709 @@
+// Benchmark suite: builds synthetic wallpaper libraries and times the
+// library paths end to end, with a stub Plasma backend in place of
+// plasmashell. The D-Bus transport itself is timed against a stand-in
+// plasmashell on a private bus when dbus-daemon is installed. Results print as a table and, with --json, as a JSON
+// document that can be compared between runs.
+//
+//   make bench
+//   ./bench/bench [--json FILE] [--dir DIR] [files ...]
+
+#include "catalog.h"
+#include "config.h"
+#include "hashindex.h"
+#include "importer.h"
+#include "log.h"
+#include "plasma.h"
+#include "selector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#define BENCH_SEED 42
+#define BENCH_ROUNDS 5
+#define BENCH_PICKS 100000
+#define BENCH_APPLIES 1000
+#define BENCH_DESKTOPS 4
+#define BENCH_IMPORT_WORKERS 4
+#define BENCH_TRANSPORT_CALLS 200
+
+typedef struct {
+    const char *name;
+    guint files;
+    guint rounds;
+    guint items;        // Work items per round (picks, files, ...)
+    double min_ms;
+    double mean_ms;
+} BenchResult;
+
+typedef struct {
+    const char *name;
+    guint files;
+    guint items;
+    guint rounds;
+    double total_ms;
+    double min_ms;
+    gint64 start_time;
+} BenchTimer;
+
+// A stand-in plasmashell on a private bus. It answers from its own thread,
+// since the calls being timed block the main one.
+typedef struct {
+    const char *address;
+    GDBusConnection *connection;
+    GMainContext *context;
+    GMainLoop *loop;
+    GMutex lock;
+    GCond cond;
+    gboolean ready;
+    guint calls;
+} BenchShell;
+
+static GArray *results = NULL;
+
+static void bench_begin(BenchTimer *timer) {
+    timer->start_time = g_get_monotonic_time();
+}
+
+static void bench_end(BenchTimer *timer) {
+    double elapsed = (g_get_monotonic_time() - timer->start_time) / 1000.0;
+    timer->total_ms += elapsed;
+    timer->min_ms = timer->rounds == 0 ? elapsed : MIN(timer->min_ms, elapsed);
+    timer->rounds++;
+}
+
+static void bench_report(const BenchTimer *timer) {
+    BenchResult result = {
+        .name = timer->name,
+        .files = timer->files,
+        .rounds = timer->rounds,
+        .items = timer->items,
+        .min_ms = timer->min_ms,
+        .mean_ms = timer->rounds ? timer->total_ms / timer->rounds : 0,
+    };
+    g_array_append_val(results, result);
+
+    printf("%-16s %8u %6u %10.2f %10.2f %12.3f\n", result.name, result.files, result.rounds,
+           result.mean_ms, result.min_ms, result.items ? result.mean_ms * 1000.0 / result.items : 0.0);
+    fflush(stdout);
+}
+
+// Stub backend: accept every script, answering desktop count queries
+static gboolean bench_script_handler(const char *script, char **output, GError **error, gpointer user_data) {
+    (void)error;
+    gsize *bytes = user_data;
+    *bytes += strlen(script);
+    if (output) {
+        *output = g_strdup_printf("%d", BENCH_DESKTOPS);
+    }
+    return TRUE;
+}
+
+// Synthetic weights from 1 to 8 that change on every query, like a rating
+// plus a show count
+static double bench_weight(const char *path, gpointer user_data) {
+    guint *calls = user_data;
+    return 1 + (g_str_hash(path) + (*calls)++) % 8;
+}
+
+// A spread of common wallpaper sizes, landscape and portrait, so screen
+// matching has something to sort
+static const int bench_sizes[][2] = {
+    { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 2560, 1080 },
+    { 1920, 1200 }, { 1080, 1920 }, { 1440, 2560 }, { 1024, 768 },
+};
+
+// Just enough of a PNG (signature and IHDR) or a JPEG (SOI, JFIF APP0 and
+// SOF0) for the header reader
+static gsize bench_write_header(guint8 *buffer, gboolean png, int width, int height) {
+    if (png) {
+        static const guint8 start[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R' };
+        memcpy(buffer, start, sizeof(start));
+        guint8 *p = buffer + sizeof(start);
+        guint32 be_width = GUINT32_TO_BE((guint32)width), be_height = GUINT32_TO_BE((guint32)height);
+        memcpy(p, &be_width, 4);
+        memcpy(p + 4, &be_height, 4);
+        memcpy(p + 8, "\x08\x02\x00\x00\x00\x00\x00\x00\x00", 9);
+        return sizeof(start) + 17;
+    }
+
+    static const guint8 start[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0,
+        0xFF, 0xC0, 0, 17, 8,
+    };
+    memcpy(buffer, start, sizeof(start));
+    guint8 *p = buffer + sizeof(start);
+    p[0] = (guint8)(height >> 8);
+    p[1] = (guint8)height;
+    p[2] = (guint8)(width >> 8);
+    p[3] = (guint8)width;
+    memcpy(p + 4, "\x03\x01\x22\x00\x02\x11\x01\x03\x11\x01", 10);
+    return sizeof(start) + 14;
+}
+
+static void bench_remove_tree(const char *path) {
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (dir) {
+        const char *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            char *child = g_build_filename(path, name, NULL);
+            if (g_file_test(child, G_FILE_TEST_IS_DIR)) {
+                bench_remove_tree(child);
+            } else {
+                g_unlink(child);
+            }
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_rmdir(path);
+}
+
+// A library of small files with image headers and distinct contents, so
+// imports can't dedup them
+static gboolean bench_generate_library(const char *directory, guint files) {
+    g_mkdir_with_parents(directory, 0755);
+
+    char buffer[256];
+    for (guint i = 0; i < files; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s/wallpaper_%07u.%s", directory, i, (i % 4 == 0) ? "png" : "jpg");
+        FILE *file = fopen(name, "wb");
+        if (!file) {
+            fprintf(stderr, "Failed to create %s\n", name);
+            return FALSE;
+        }
+        const int *size = bench_sizes[g_str_hash(name) % G_N_ELEMENTS(bench_sizes)];
+        gsize length = bench_write_header((guint8 *)buffer, i % 4 == 0, size[0], size[1]);
+        length += (gsize)snprintf(buffer + length, sizeof(buffer) - length, "synthetic wallpaper %u\n", i);
+        fwrite(buffer, 1, length, file);
+        fclose(file);
+    }
+    return TRUE;
+}
+
+static void bench_library(const char *root, guint files) {
+    BenchTimer timer;
+    char *size_dir = g_strdup_printf("%s/%u", root, files);
+    char *library = g_build_filename(size_dir, "library", NULL);
+    char *catalog_path = g_build_filename(size_dir, "catalog.bin", NULL);
+    GRand *rand = g_rand_new_with_seed(BENCH_SEED);
+
+    timer = (BenchTimer){ .name = "generate", .files = files, .items = files };
+    bench_begin(&timer);
+    gboolean generated = bench_generate_library(library, files);
+    bench_end(&timer);
+    bench_report(&timer);
+    if (!generated) {
+        goto out;
+    }
+
+    // Directory scan without a cache, then reopening the saved catalog
+    timer = (BenchTimer){ .name = "scan_cold", .files = files, .items = files };
+    Catalog *catalog = NULL;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        g_unlink(catalog_path);
+        catalog_free(catalog);
+        bench_begin(&timer);
+        catalog = catalog_open(library, catalog_path);
+        catalog_refresh(catalog);
+        catalog_save(catalog);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+    catalog_free(catalog);
+
+    timer = (BenchTimer){ .name = "scan_warm", .files = files, .items = files };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        catalog = catalog_open(library, catalog_path);
+        catalog_refresh(catalog);
+        bench_end(&timer);
+        if (round < BENCH_ROUNDS - 1) {
+            catalog_free(catalog);
+        }
+    }
+    bench_report(&timer);
+
+    guint count = catalog_get_count(catalog);
+    if (count == 0) {
+        fprintf(stderr, "Scan found no images in %s\n", library);
+        catalog_free(catalog);
+        goto out;
+    }
+
+    // Random picks, alone and followed by an apply through the stub backend
+    timer = (BenchTimer){ .name = "pick", .files = files, .items = BENCH_PICKS };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_PICKS; i++) {
+        g_free(catalog_get_path(catalog, g_rand_int_range(rand, 0, (gint32)count)));
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+
+    // Shuffle bag: filling it from the catalog, re-syncing after one file
+    // went away, then picks through whole cycles
+    char *selector_path = g_build_filename(size_dir, "selector.bin", NULL);
+    GPtrArray *paths = g_ptr_array_new_full(count, g_free);
+    for (guint i = 0; i < count; i++) {
+        g_ptr_array_add(paths, catalog_get_path(catalog, i));
+    }
+
+    Selector *selector = NULL;
+    timer = (BenchTimer){ .name = "shuffle_fill", .files = files, .items = count };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        selector_free(selector);
+        selector = selector_open(selector_path);
+        bench_begin(&timer);
+        selector_sync(selector, paths);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "shuffle_resync", .files = files, .items = count };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        g_ptr_array_remove_index_fast(paths, g_rand_int_range(rand, 0, (gint32)paths->len));
+        bench_begin(&timer);
+        selector_sync(selector, paths);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "shuffle_next", .files = files, .items = BENCH_PICKS };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_PICKS; i++) {
+        g_free(selector_next(selector));
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "shuffle_save", .files = files, .items = count };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        g_free(selector_next(selector));
+        bench_begin(&timer);
+        selector_save(selector);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    // Weighted picks, then picks that each follow a weight change (one
+    // block and the top table rebuilt)
+    guint weight_calls = 0;
+    selector_set_weight_func(selector, bench_weight, &weight_calls);
+    selector_set_mode(selector, SELECTOR_MODE_WEIGHTED);
+    g_free(selector_next(selector));
+
+    timer = (BenchTimer){ .name = "weighted_next", .files = files, .items = BENCH_PICKS };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_PICKS; i++) {
+        g_free(selector_next(selector));
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "weighted_update", .files = files, .items = BENCH_APPLIES };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_APPLIES; i++) {
+        char *path = selector_next(selector);
+        selector_update_weight(selector, path);
+        g_free(path);
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+    selector_free(selector);
+    g_ptr_array_free(paths, TRUE);
+    g_free(selector_path);
+
+    // Screen matching: building the aspect index after a change, then
+    // closest-image queries for a mix of screens
+    static const int screens[][2] = { { 1920, 1080 }, { 1080, 1920 }, { 3440, 1440 }, { 1280, 1024 } };
+    timer = (BenchTimer){ .name = "screen_index", .files = files, .items = count };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        catalog_set_lower(catalog, NULL);
+        bench_begin(&timer);
+        g_array_free(catalog_find_closest(catalog, screens[0][0], screens[0][1]), TRUE);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "screen_closest", .files = files, .items = BENCH_PICKS };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_PICKS; i++) {
+        guint screen = i % G_N_ELEMENTS(screens);
+        g_array_free(catalog_find_closest(catalog, screens[screen][0], screens[screen][1]), TRUE);
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+
+    gsize script_bytes = 0;
+    plasma_set_script_handler(bench_script_handler, &script_bytes);
+
+    timer = (BenchTimer){ .name = "apply_stub", .files = files, .items = BENCH_APPLIES };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_APPLIES; i++) {
+        char *path = catalog_get_path(catalog, g_rand_int_range(rand, 0, (gint32)count));
+        plasma_set_wallpaper(path, -1, NULL);
+        g_free(path);
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+
+    timer = (BenchTimer){ .name = "apply_batch_stub", .files = files, .items = BENCH_APPLIES };
+    bench_begin(&timer);
+    for (guint i = 0; i < BENCH_APPLIES; i++) {
+        PlasmaAssignment assignments[BENCH_DESKTOPS];
+        char *paths[BENCH_DESKTOPS];
+        for (int d = 0; d < BENCH_DESKTOPS; d++) {
+            paths[d] = catalog_get_path(catalog, g_rand_int_range(rand, 0, (gint32)count));
+            assignments[d].desktop_index = d;
+            assignments[d].image_path = paths[d];
+        }
+        plasma_apply_batch(assignments, BENCH_DESKTOPS, NULL);
+        for (int d = 0; d < BENCH_DESKTOPS; d++) {
+            g_free(paths[d]);
+        }
+    }
+    bench_end(&timer);
+    bench_report(&timer);
+    plasma_set_script_handler(NULL, NULL);
+
+    // Settings only; the photo list comes from the catalog and isn't saved
+    char *config_path = g_build_filename(size_dir, "config.json", NULL);
+    Config *config = config_new();
+
+    timer = (BenchTimer){ .name = "config_save", .files = files, .items = 1 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        config_save(config, config_path);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+    config_free(config);
+
+    config = config_new();
+    timer = (BenchTimer){ .name = "config_load", .files = files, .items = 1 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        config_load(config, config_path);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    // A settings toggle through the write-behind path
+    timer = (BenchTimer){ .name = "config_flush", .files = files, .items = 1 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        config->auto_rotate_enabled = !config->auto_rotate_enabled;
+        config_mark_dirty(config, CONFIG_DIRTY_SETTINGS);
+        bench_begin(&timer);
+        config_flush(config);
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+
+    // The only library-side work before the tray icon: loading the settings.
+    // GTK, D-Bus and indicator setup can't run here, so this is a part of
+    // the real time to tray; `dpaper --stats` reports that as "startup".
+    timer = (BenchTimer){ .name = "startup_settings", .files = files, .items = 1 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        Config *startup_config = config_new();
+        config_load(startup_config, config_path);
+        bench_end(&timer);
+        config_free(startup_config);
+    }
+    bench_report(&timer);
+
+    // Right after the tray icon: opening the catalog for a boot wallpaper pick
+    timer = (BenchTimer){ .name = "boot_pick", .files = files, .items = 1 };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        Catalog *startup_catalog = catalog_open(library, catalog_path);
+        if (catalog_is_current(startup_catalog) && catalog_get_count(startup_catalog) > 0) {
+            g_free(catalog_get_path(startup_catalog,
+                                    g_rand_int_range(rand, 0, (gint32)catalog_get_count(startup_catalog))));
+        }
+        bench_end(&timer);
+        catalog_free(startup_catalog);
+    }
+    bench_report(&timer);
+
+    // Deferred until after the tray icon: refilling the photo list from the catalog
+    timer = (BenchTimer){ .name = "library_ready", .files = files, .items = count };
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        bench_begin(&timer);
+        config_clear_photos(config);
+        for (guint i = 0; i < count; i++) {
+            config_add_photo(config, catalog_get_name(catalog, i));
+        }
+        bench_end(&timer);
+    }
+    bench_report(&timer);
+    config_free(config);
+    g_free(config_path);
+
+    // Import the library into an empty one, then again (all duplicates)
+    GSList *sources = NULL;
+    for (guint i = count; i > 0; i--) {
+        sources = g_slist_prepend(sources, catalog_get_path(catalog, i - 1));
+    }
+    catalog_free(catalog);
+
+    char *imported_dir = g_build_filename(size_dir, "imported", NULL);
+    char *index_path = g_build_filename(size_dir, "hashes.bin", NULL);
+    g_mkdir_with_parents(imported_dir, 0755);
+    HashIndex *index = hashindex_open(imported_dir, index_path);
+
+    const char *import_names[] = { "import", "import_dup" };
+    for (guint pass = 0; pass < G_N_ELEMENTS(import_names); pass++) {
+        guint duplicates = 0;
+        timer = (BenchTimer){ .name = import_names[pass], .files = files, .items = count };
+        bench_begin(&timer);
+        GPtrArray *imported = importer_import(sources, imported_dir, index, BENCH_IMPORT_WORKERS,
+                                              NULL, NULL, &duplicates, NULL);
+        bench_end(&timer);
+        bench_report(&timer);
+        if (imported->len + duplicates != count) {
+            fprintf(stderr, "%s: %u imported, %u duplicates of %u\n",
+                    import_names[pass], imported->len, duplicates, count);
+        }
+        g_ptr_array_free(imported, TRUE);
+    }
+
+    hashindex_free(index);
+    g_slist_free_full(sources, g_free);
+    g_free(index_path);
+    g_free(imported_dir);
+
+out:
+    g_rand_free(rand);
+    bench_remove_tree(size_dir);
+    g_free(catalog_path);
+    g_free(library);
+    g_free(size_dir);
+}
+
+static void bench_shell_method_call(GDBusConnection *connection, const char *sender, const char *path,
+                                    const char *interface, const char *method, GVariant *parameters,
+                                    GDBusMethodInvocation *invocation, gpointer data) {
+    (void)connection;
+    (void)sender;
+    (void)path;
+    (void)interface;
+    (void)method;
+    (void)parameters;
+    BenchShell *shell = data;
+    shell->calls++;
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(s)", ""));
+}
+
+static gpointer bench_shell_run(gpointer data) {
+    BenchShell *shell = data;
+    g_main_context_push_thread_default(shell->context);
+
+    static const char *xml =
+        "<node><interface name='org.kde.PlasmaShell'>"
+        "<method name='evaluateScript'><arg type='s' direction='in'/><arg type='s' direction='out'/></method>"
+        "</interface></node>";
+    static const GDBusInterfaceVTable vtable = { bench_shell_method_call, NULL, NULL, { 0 } };
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(xml, NULL);
+    shell->connection = g_dbus_connection_new_for_address_sync(
+        shell->address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+        NULL, NULL, NULL);
+    if (shell->connection) {
+        g_dbus_connection_register_object(shell->connection, "/PlasmaShell", info->interfaces[0], &vtable,
+                                          shell, NULL, NULL);
+        GVariant *reply = g_dbus_connection_call_sync(shell->connection, "org.freedesktop.DBus",
+                                                      "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                                      "RequestName", g_variant_new("(su)", "org.kde.plasmashell", 0),
+                                                      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+        if (reply) {
+            g_variant_unref(reply);
+        }
+    }
+    g_dbus_node_info_unref(info);
+
+    g_mutex_lock(&shell->lock);
+    shell->ready = TRUE;
+    g_cond_signal(&shell->cond);
+    g_mutex_unlock(&shell->lock);
+
+    if (shell->connection) {
+        g_main_loop_run(shell->loop);
+        g_dbus_connection_close_sync(shell->connection, NULL, NULL);
+        g_clear_object(&shell->connection);
+    }
+    g_main_context_pop_thread_default(shell->context);
+    return NULL;
+}
+
+// One apply's round trip to plasmashell: the in-process call on the
+// shared connection against the per-apply process the app used to start
+// (qdbus through system()). dbus-send stands in for qdbus here; it skips
+// the shell and Qt's startup, so the subprocess figure is a lower bound.
+static void bench_transport(const char *image_path) {
+    char *daemon = g_find_program_in_path("dbus-daemon");
+    char *sender = g_find_program_in_path("dbus-send");
+    if (!daemon || !sender) {
+        fprintf(stderr, "apply_dbus/apply_spawn skipped: dbus-daemon and dbus-send are needed\n");
+        g_free(daemon);
+        g_free(sender);
+        return;
+    }
+    g_free(daemon);
+
+    GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+
+    BenchShell shell = { .address = g_test_dbus_get_bus_address(bus) };
+    g_mutex_init(&shell.lock);
+    g_cond_init(&shell.cond);
+    shell.context = g_main_context_new();
+    shell.loop = g_main_loop_new(shell.context, FALSE);
+    GThread *thread = g_thread_new("bench-shell", bench_shell_run, &shell);
+    g_mutex_lock(&shell.lock);
+    while (!shell.ready) {
+        g_cond_wait(&shell.cond, &shell.lock);
+    }
+    g_mutex_unlock(&shell.lock);
+
+    char *script = plasma_build_wallpaper_script(image_path, 0);
+    char *argument = g_strconcat("string:", script, NULL);
+    char *argv[] = {
+        sender, "--session", "--print-reply", "--dest=org.kde.plasmashell", "/PlasmaShell",
+        "org.kde.PlasmaShell.evaluateScript", argument, NULL
+    };
+
+    GError *error = NULL;
+    if (!plasma_evaluate_script(script, NULL, &error)) {
+        fprintf(stderr, "apply_dbus/apply_spawn skipped: %s\n", error->message);
+        g_clear_error(&error);
+    } else {
+        BenchTimer timer = { .name = "apply_dbus", .items = BENCH_TRANSPORT_CALLS };
+        bench_begin(&timer);
+        for (guint i = 0; i < BENCH_TRANSPORT_CALLS; i++) {
+            plasma_evaluate_script(script, NULL, NULL);
+        }
+        bench_end(&timer);
+        bench_report(&timer);
+
+        timer = (BenchTimer){ .name = "apply_spawn", .items = BENCH_TRANSPORT_CALLS };
+        bench_begin(&timer);
+        for (guint i = 0; i < BENCH_TRANSPORT_CALLS; i++) {
+            int wait_status;
+            g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                         NULL, NULL, NULL, NULL, &wait_status, NULL);
+        }
+        bench_end(&timer);
+        bench_report(&timer);
+
+        if (shell.calls != 2 * BENCH_TRANSPORT_CALLS + 1) {
+            fprintf(stderr, "apply_dbus/apply_spawn: the stand-in shell saw %u of %u calls\n",
+                    shell.calls, 2 * BENCH_TRANSPORT_CALLS + 1);
+        }
+    }
+
+    // The private bus only goes down once the shared connection is gone
+    plasma_shutdown();
+    g_main_loop_quit(shell.loop);
+    g_thread_join(thread);
+    g_main_loop_unref(shell.loop);
+    g_main_context_unref(shell.context);
+    g_cond_clear(&shell.cond);
+    g_mutex_clear(&shell.lock);
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+
+    g_free(argument);
+    g_free(script);
+    g_free(sender);
+}
+
+static gboolean bench_write_json(const char *path) {
+    GString *json = g_string_new("{\n");
+    GDateTime *now = g_date_time_new_now_utc();
+    char *timestamp = g_date_time_format(now, "%Y-%m-%dT%H:%M:%SZ");
+    g_date_time_unref(now);
+
+    g_string_append_printf(json, "  \"suite\": \"dpaper\",\n  \"timestamp\": \"%s\",\n", timestamp);
+    g_string_append_printf(json, "  \"host\": {\"name\": \"%s\", \"cpus\": %d},\n",
+                           g_get_host_name(), (int)g_get_num_processors());
+    g_string_append(json, "  \"results\": [\n");
+    for (guint i = 0; i < results->len; i++) {
+        const BenchResult *result = &g_array_index(results, BenchResult, i);
+        g_string_append_printf(json, "    {\"case\": \"%s\", \"files\": %u, \"rounds\": %u, \"items\": %u, "
+                               "\"mean_ms\": %.3f, \"min_ms\": %.3f, \"per_item_us\": %.3f}%s\n",
+                               result->name, result->files, result->rounds, result->items,
+                               result->mean_ms, result->min_ms,
+                               result->items ? result->mean_ms * 1000.0 / result->items : 0.0,
+                               i + 1 < results->len ? "," : "");
+    }
+    g_string_append(json, "  ]\n}\n");
+    g_free(timestamp);
+
+    GError *error = NULL;
+    gboolean success = g_file_set_contents(path, json->str, json->len, &error);
+    if (!success) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, error->message);
+        g_error_free(error);
+    }
+    g_string_free(json, TRUE);
+    return success;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    const char *base_dir = g_get_tmp_dir();
+    GArray *sizes = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            base_dir = argv[++i];
+        } else {
+            guint files = (guint)strtoul(argv[i], NULL, 10);
+            if (files == 0) {
+                fprintf(stderr, "Usage: %s [--json FILE] [--dir DIR] [files ...]\n", argv[0]);
+                return 2;
+            }
+            g_array_append_val(sizes, files);
+        }
+    }
+    if (sizes->len == 0) {
+        static const guint default_sizes[] = { 1000, 10000, 100000 };
+        g_array_append_vals(sizes, default_sizes, G_N_ELEMENTS(default_sizes));
+    }
+
+    // The log file is never opened, so messages would only fill its ring;
+    // don't spend timed work formatting the importer's per-file lines
+    log_set_level(LOG_LEVEL_ERROR);
+
+    char *template = g_build_filename(base_dir, "dp-bench-XXXXXX", NULL);
+    char *root = g_mkdtemp(template);
+    if (!root) {
+        fprintf(stderr, "Failed to create a directory in %s\n", base_dir);
+        return 1;
+    }
+
+    results = g_array_new(FALSE, FALSE, sizeof(BenchResult));
+    printf("%-16s %8s %6s %10s %10s %12s\n", "case", "files", "rounds", "mean_ms", "min_ms", "per_item_us");
+    for (guint i = 0; i < sizes->len; i++) {
+        bench_library(root, g_array_index(sizes, guint, i));
+    }
+    char *image_path = g_build_filename(root, "wallpaper.jpg", NULL);
+    bench_transport(image_path);
+    g_free(image_path);
+    bench_remove_tree(root);
+    g_free(root);
+
+    int status = 0;
+    if (json_path && !bench_write_json(json_path)) {
+        status = 1;
+    }
+
+    g_array_free(results, TRUE);
+    g_array_free(sizes, TRUE);
+    return status;
+}
@@ -0,0 +1,57 @@
+#ifndef BINFILE_H
+#define BINFILE_H
+
+#include <glib.h>
+
+// Shared layout of the binary cache and state files (catalog, hash index,
+// ratings, selector state, scaled-source memo): a BinfileHeader, a fixed
+// block of file-specific fields, the record table, then a pool of
+// NUL-terminated strings that records refer to by offset and length.
+// Files are native-endian; a layout change bumps the owner's version.
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    guint32 count;          // Records in the table
+    guint32 pool_size;      // Bytes in the string pool
+} BinfileHeader;
+
+// What a module stores. extra_size and record_size should be multiples of
+// 8 so the table stays aligned.
+typedef struct {
+    guint32 magic;
+    guint32 version;
+    gsize extra_size;       // File-specific fields between header and table
+    gsize record_size;
+} BinfileFormat;
+
+// A validated file; the pointers borrow from the data it was parsed from
+typedef struct {
+    const void *extra;
+    const void *records;
+    guint32 count;
+    const char *pool;       // NUL-terminated at pool[pool_size - 1] unless empty
+    guint32 pool_size;
+} BinfileView;
+
+// Check data against the format: magic, version, an exact length for the
+// table and pool, and a terminated pool
+gboolean binfile_parse(const BinfileFormat *format, const char *data, gsize length, BinfileView *view);
+
+// Read and parse a file. Returns the data the view points into (free with
+// g_free) or NULL if the file is missing or doesn't match the format.
+char* binfile_load(const BinfileFormat *format, const char *path, BinfileView *view);
+
+// Pool string a record refers to, or NULL if it runs out of the pool
+const char* binfile_string(const BinfileView *view, guint32 offset, guint32 length);
+
+// Append a string and its NUL to a pool being built; returns its offset and
+// stores its length
+guint32 binfile_pool_append(GString *pool, const char *string, guint32 *length);
+
+// Write header, extra, count records and the pool to path, creating its
+// directory. The file is replaced atomically and synced before returning.
+gboolean binfile_save(const BinfileFormat *format, const char *path, const void *extra,
+                      const void *records, guint count, const char *pool, gsize pool_size,
+                      GError **error);
+
+#endif // BINFILE_H
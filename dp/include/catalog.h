@@ -0,0 +1,74 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <glib.h>
+#include "imagemeta.h"
+
+// Persistent image catalog for a wallpaper directory.
+//
+// The catalog is stored as a compact binary file (normally
+// ~/.dp/cache/catalog-<hash>.bin, one per directory) that is memory-mapped
+// on open, so loading it does not parse anything. It records the directory's mtime at scan time; when the
+// directory changes catalog_refresh() rebuilds it from a single readdir pass.
+// Lookups by index never touch the filesystem. Individual additions and
+// removals can be applied without a rescan; the first one copies the mapped
+// table into owned memory.
+//
+// A catalog can also be layered over a read-only one, such as the bundled
+// wallpapers in a system directory. The plain queries below cover only the
+// catalog's own directory; the visible ones add the lower layer's images,
+// minus any whose name the upper directory also has.
+//
+// Entries also record each image's format and dimensions, read from its
+// header (see imagemeta.h) when a file is new or modified; a scan reads
+// the headers it needs on a thread pool. Files whose header can't be read
+// are kept but marked corrupt. Screen matching runs on an index of the
+// visible images' sizes sorted by aspect ratio, rebuilt lazily after
+// changes.
+typedef struct _Catalog Catalog;
+
+// An image fits a screen when their aspect ratios differ by at most
+// CATALOG_FIT_ASPECT and it is at least CATALOG_FIT_SCALE of the screen's size
+#define CATALOG_FIT_ASPECT 0.10
+#define CATALOG_FIT_SCALE  0.75
+
+// Catalog lifecycle
+Catalog* catalog_open(const char *directory, const char *cache_path);
+void catalog_free(Catalog *catalog);
+gboolean catalog_is_current(const Catalog *catalog);
+gboolean catalog_refresh(Catalog *catalog);
+gboolean catalog_rebuild(Catalog *catalog);
+gboolean catalog_save(Catalog *catalog);
+
+// Incremental updates (each costs a stat and a header read, not a rescan)
+gboolean catalog_add(Catalog *catalog, const char *name);
+gboolean catalog_remove(Catalog *catalog, const char *name);
+gboolean catalog_rename(Catalog *catalog, const char *old_name, const char *new_name);
+
+// Catalog queries
+const char* catalog_get_directory(const Catalog *catalog);
+guint catalog_get_count(const Catalog *catalog);
+const char* catalog_get_name(const Catalog *catalog, guint index);
+char* catalog_get_path(const Catalog *catalog, guint index);
+gboolean catalog_get_dimensions(const Catalog *catalog, guint index, int *width, int *height);
+ImageFormat catalog_get_format(const Catalog *catalog, guint index);
+gboolean catalog_is_corrupt(const Catalog *catalog, guint index);
+
+// Layers (lower is not owned and must outlive the catalog)
+void catalog_set_lower(Catalog *catalog, const Catalog *lower);
+const Catalog* catalog_get_lower(const Catalog *catalog);
+guint catalog_get_visible_count(const Catalog *catalog);
+char* catalog_get_visible_path(const Catalog *catalog, guint index);
+gboolean catalog_is_visible_corrupt(const Catalog *catalog, guint index);
+gboolean catalog_lookup_dimensions(Catalog *catalog, const char *path, int *width, int *height);
+
+// Screen matching over the visible images (see CATALOG_FIT_ASPECT)
+gboolean catalog_image_fits(int width, int height, int screen_width, int screen_height);
+GArray* catalog_find_fitting(Catalog *catalog, int screen_width, int screen_height);
+GArray* catalog_find_closest(Catalog *catalog, int screen_width, int screen_height);
+
+// Utility functions
+char* catalog_get_cache_path(const char *directory);
+int catalog_is_image_file(const char *filename);
+
+#endif // CATALOG_H
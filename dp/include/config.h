@@ -2,31 +2,51 @@
 #define CONFIG_H
 
 #include <glib.h>
+#include "selector.h"
+
+// Parts of the configuration with unsaved changes
+#define CONFIG_DIRTY_SETTINGS (1 << 0)
 
 // Configuration structure
 typedef struct {
     char *wallpaper_directory;      // Main wallpaper directory
     GPtrArray *supported_formats;   // Array of supported file extensions
-    GPtrArray *installed_photos;    // Array of installed photo filenames
+    GPtrArray *installed_photos;    // Array of installed photo filenames, from the catalog; not saved
+    GHashTable *photo_index;        // Photo filename -> index in installed_photos + 1
     int auto_rotate_interval;       // Auto-rotate interval in seconds
     gboolean auto_rotate_enabled;   // Whether auto-rotate is enabled
+    int pause_on_battery_below;     // Auto-rotate pauses on battery below this percentage (0 = never)
+    SelectorMode rotation_policy;   // How random picks choose the next image
     int last_desktop_index;         // Last used desktop index
     gboolean use_default_wallpapers; // Whether to use bundled default wallpapers
     gboolean boot_screen_enabled;   // Whether boot screen wallpaper is enabled
     char *boot_screen_image;        // Specific image path for boot screen (NULL = random)
+
+    // Write-behind state
+    char *path;                     // File loaded from and flushed to
+    guint dirty;                    // CONFIG_DIRTY_* flags
+    gint64 dirty_since;             // Monotonic time of the oldest unsaved change
+    guint save_source_id;           // Pending flush timeout
 } Config;
 
 // Configuration functions
 Config* config_new(void);
 void config_free(Config *config);
+// Settings only; the photo list stays empty for the caller to fill
 gboolean config_load(Config *config, const char *filename);
 gboolean config_save(const Config *config, const char *filename);
 void config_set_defaults(Config *config);
 
+// Write-behind persistence (main thread only). Changes are flushed after a
+// short idle window; call config_flush() before exiting.
+void config_mark_dirty(Config *config, guint flags);
+gboolean config_flush(Config *config);
+
 // Photo management
 void config_add_photo(Config *config, const char *filename);
 void config_remove_photo(Config *config, const char *filename);
 gboolean config_has_photo(const Config *config, const char *filename);
+void config_clear_photos(Config *config);
 GPtrArray* config_get_photos(const Config *config);
 
 // Utility functions
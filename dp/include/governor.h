@@ -0,0 +1,52 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+// Paces auto-rotate. Ticks come from a seconds-granularity timeout, so the
+// wakeups coalesce with the rest of the session's. Rotation pauses while
+// the session is locked or idle (logind LockedHint/IdleHint), while the
+// system is going to sleep (logind PrepareForSleep) and while on battery
+// below a threshold (UPower OnBattery and the display device's
+// Percentage); no timer runs while paused. A rotation that came due during
+// a pause happens once on resume instead of once per missed tick.
+//
+// State is read from the bus handed to governor_watch(), normally the
+// system bus; a connection to a private bus with stand-in services works
+// the same. Until then the governor never pauses. Use from the main loop.
+typedef struct _Governor Governor;
+
+typedef enum {
+    GOVERNOR_PAUSE_LOCKED  = 1 << 0,
+    GOVERNOR_PAUSE_IDLE    = 1 << 1,
+    GOVERNOR_PAUSE_SLEEP   = 1 << 2,
+    GOVERNOR_PAUSE_BATTERY = 1 << 3
+} GovernorPause;
+
+typedef struct {
+    void (*rotate)(void);   // Time for the next wallpaper
+    void (*woke)(void);     // The system came back from sleep; may be NULL
+} GovernorHandlers;
+
+// Governor lifecycle
+Governor* governor_new(const GovernorHandlers *handlers);
+void governor_free(Governor *governor);
+
+// Follow logind and UPower on connection. The session is XDG_SESSION_ID's,
+// or the one this process belongs to.
+void governor_watch(Governor *governor, GDBusConnection *connection);
+
+// A rotation every interval seconds, the first one interval from now
+void governor_start(Governor *governor, guint interval);
+void governor_stop(Governor *governor);
+void governor_set_interval(Governor *governor, guint interval);
+gboolean governor_is_running(const Governor *governor);
+
+// Battery percentage below which rotation pauses; 0 never pauses
+void governor_set_battery_threshold(Governor *governor, int percent);
+
+// GovernorPause flags in effect, 0 while rotating normally
+guint governor_get_pause_reasons(const Governor *governor);
+
+#endif // GOVERNOR_H
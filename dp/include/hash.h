@@ -0,0 +1,26 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <glib.h>
+
+// Fast non-cryptographic content hashing (XXH64). Used to recognise
+// identical image files; not suitable for anything security related.
+typedef struct {
+    guint64 total_length;
+    guint64 lanes[4];
+    guint8 buffer[32];
+    guint32 buffered;
+    guint64 seed;
+} HashState;
+
+// Streaming interface
+void hash_init(HashState *state, guint64 seed);
+void hash_update(HashState *state, const void *data, gsize length);
+guint64 hash_digest(const HashState *state);
+
+// One-shot helpers
+guint64 hash_bytes(const void *data, gsize length, guint64 seed);
+gboolean hash_file(const char *path, guint64 *hash, guint64 *size, GError **error);
+char* hash_to_string(guint64 hash);
+
+#endif // HASH_H
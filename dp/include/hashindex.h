@@ -0,0 +1,43 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <glib.h>
+
+// Persistent content-hash index of a wallpaper directory.
+//
+// Maps each library filename to the XXH64 hash of its contents, and each
+// (hash, size) pair back to a filename, so an import can tell in O(1)
+// whether the library already holds the same bytes. Entries remember the
+// file's size and mtime and are only re-hashed when those change. Stored in
+// ~/.dp/cache/hashes.bin. All functions are thread-safe.
+typedef struct _HashIndex HashIndex;
+
+// Index lifecycle
+HashIndex* hashindex_open(const char *directory, const char *cache_path);
+void hashindex_free(HashIndex *index);
+gboolean hashindex_save(HashIndex *index);
+const char* hashindex_get_directory(const HashIndex *index);
+
+// Content lookups for imports. hashindex_claim() returns FALSE and the
+// existing filename if the content is already present (or being imported);
+// otherwise it reserves the content until hashindex_set() or
+// hashindex_release().
+gboolean hashindex_claim(HashIndex *index, guint64 hash, guint64 size, char **existing);
+void hashindex_release(HashIndex *index, guint64 hash, guint64 size);
+
+// Per-file entries
+void hashindex_set(HashIndex *index, const char *name, guint64 hash, guint64 size, gint64 mtime);
+void hashindex_remove(HashIndex *index, const char *name);
+void hashindex_rename(HashIndex *index, const char *old_name, const char *new_name);
+gboolean hashindex_lookup(HashIndex *index, const char *name, guint64 size, gint64 mtime, guint64 *hash);
+
+// Hash a library file, reusing the stored hash while size and mtime match
+gboolean hashindex_hash_file(HashIndex *index, const char *name, guint64 *hash);
+
+// Drop entries for files that are no longer in the directory
+guint hashindex_prune(HashIndex *index, GHashTable *present_names);
+
+// Utility functions
+char* hashindex_get_default_path(void);
+
+#endif // HASHINDEX_H
@@ -0,0 +1,42 @@
+#ifndef IMAGEMETA_H
+#define IMAGEMETA_H
+
+#include <glib.h>
+
+// Image format and dimensions from the file header alone: the JPEG frame
+// header (SOF), the PNG IHDR chunk, the GIF logical screen descriptor and
+// the BMP info header. A JPEG's EXIF Orientation is read from its APP1
+// segment and the dimensions are reported as displayed. Files are read with pread() in IMAGEMETA_READ_SIZE
+// windows, one for most images; a JPEG whose SOF sits behind large EXIF or
+// ICC segments costs one more per window skipped. Nothing is decoded, so
+// indexing is bound by I/O. The format comes from the content, not the
+// extension. Thread-safe.
+
+#define IMAGEMETA_READ_SIZE 4096
+
+typedef enum {
+    IMAGE_FORMAT_UNKNOWN,   // Not a format we read, or not an image at all
+    IMAGE_FORMAT_JPEG,
+    IMAGE_FORMAT_PNG,
+    IMAGE_FORMAT_GIF,
+    IMAGE_FORMAT_BMP
+} ImageFormat;
+
+typedef struct {
+    ImageFormat format;
+    int width;              // 0 x 0 unless the header was read
+    int height;             // As displayed, after any EXIF rotation
+    int orientation;        // EXIF Orientation 1-8, 1 when absent
+} ImageMeta;
+
+// Read the header. On failure meta still holds the format if the file
+// started like one; a known format without dimensions is a corrupt or
+// truncated file.
+gboolean imagemeta_read(const char *path, ImageMeta *meta, GError **error);
+gboolean imagemeta_read_at(int dir_fd, const char *name, ImageMeta *meta, GError **error);
+gboolean imagemeta_read_fd(int fd, ImageMeta *meta, GError **error);
+
+// Utility functions
+const char* imagemeta_format_name(ImageFormat format);
+
+#endif // IMAGEMETA_H
@@ -0,0 +1,39 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include "hashindex.h"
+
+// Photo import engine. Files are placed into the library with the cheapest
+// method the filesystem allows: a reflink clone, a hardlink when source and
+// library share a filesystem, copy_file_range(), and finally a large-buffer
+// copy. Several files are imported concurrently by a bounded worker pool.
+// With a hash index, files whose contents are already in the library are
+// skipped.
+typedef enum {
+    IMPORT_METHOD_CLONE,        // FICLONE reflink
+    IMPORT_METHOD_LINK,         // Hardlink on the same filesystem
+    IMPORT_METHOD_COPY_RANGE,   // In-kernel copy_file_range()
+    IMPORT_METHOD_COPY,         // Userspace buffer copy
+    IMPORT_METHOD_DUPLICATE     // Already in the library; nothing was written
+} ImportMethod;
+
+// Called from pool threads after each file, successful or not
+typedef void (*ImporterProgressFunc)(guint done, guint total, gpointer user_data);
+
+// Import a list of paths into dest_dir. Returns the filenames that were
+// added, in no particular order. index may be NULL.
+GPtrArray* importer_import(GSList *files, const char *dest_dir, HashIndex *index, guint max_workers,
+                           ImporterProgressFunc progress, gpointer user_data,
+                           guint *duplicates, GCancellable *cancellable);
+
+// Import one file, picking a free name in dest_dir. For a duplicate,
+// dest_name is the existing file (NULL if it is still being imported).
+gboolean importer_import_file(const char *src_path, const char *dest_dir, HashIndex *index,
+                              char **dest_name, ImportMethod *method, GError **error);
+
+// Utility functions
+const char* importer_method_name(ImportMethod method);
+
+#endif // IMPORTER_H
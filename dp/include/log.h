@@ -0,0 +1,33 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <glib.h>
+
+// Buffered application log (~/.dp/error.log). Log calls format into a
+// lock-free in-memory ring and return; a background thread writes the ring
+// out, so callers never touch the file. The file is rotated by size.
+typedef enum {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+} LogLevel;
+
+// Lifecycle; messages logged before log_init() are kept until it runs
+void log_init(const char *path);
+void log_shutdown(void);
+char* log_get_default_path(void);
+
+// Messages below the level are discarded without formatting
+void log_set_level(LogLevel level);
+gboolean log_enabled(LogLevel level);
+
+// Safe from any thread
+void log_write(LogLevel level, const char *format, ...) G_GNUC_PRINTF(2, 3);
+
+#define log_debug(...)   log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...)    log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warning(...) log_write(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_error(...)   log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,39 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <glib.h>
+
+// In-process latency and throughput metrics. Each operation keeps call,
+// error and item counters and a log-linear latency histogram (HdrHistogram
+// style, within about 6% of the true value). Recording is a handful of
+// atomic increments and safe from any thread.
+typedef enum {
+    METRIC_APPLY,           // Wallpaper applies, items = desktops
+    METRIC_PICK,            // Random image selection
+    METRIC_SCAN,            // Library directory scans
+    METRIC_IMPORT,          // Photo imports, items = files added
+    METRIC_CONFIG_LOAD,
+    METRIC_CONFIG_SAVE,
+    METRIC_STARTUP,         // Launch to tray icon shown
+    METRIC_COUNT
+} MetricId;
+
+// Marks the start of the process uptime
+void metrics_init(void);
+
+// Recording
+void metrics_record(MetricId id, gint64 usec);
+void metrics_record_since(MetricId id, gint64 start_time);
+void metrics_add_items(MetricId id, guint items);
+void metrics_add_error(MetricId id);
+
+// Snapshot as a{sa{st}}: metric name -> count, errors, items, sum_us,
+// max_us, p50_us, p90_us, p99_us, p999_us; plus "process" -> uptime_us
+GVariant* metrics_snapshot(void);
+
+// Human-readable table of a snapshot
+char* metrics_format(GVariant *snapshot);
+
+const char* metrics_get_name(MetricId id);
+
+#endif // METRICS_H
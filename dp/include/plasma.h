@@ -0,0 +1,50 @@
+#ifndef PLASMA_H
+#define PLASMA_H
+
+#include <glib.h>
+
+// In-process client for the Plasma shell scripting interface
+// (org.kde.plasmashell /PlasmaShell org.kde.PlasmaShell.evaluateScript).
+// One session bus connection is kept for the lifetime of the process.
+
+// One image for one desktop in a batch apply
+typedef struct {
+    int desktop_index;
+    const char *image_path;
+} PlasmaAssignment;
+
+// The screen a desktop is shown on, in logical pixels; screen is -1 and
+// the size 0 x 0 for a desktop that isn't on any screen
+typedef struct {
+    int desktop_index;
+    int screen;
+    int width;
+    int height;
+} PlasmaScreen;
+
+// Replacement for the D-Bus call, e.g. a stub backend for benchmarks
+typedef gboolean (*PlasmaScriptHandler)(const char *script, char **output, GError **error, gpointer user_data);
+
+// Script evaluation
+gboolean plasma_evaluate_script(const char *script, char **output, GError **error);
+void plasma_set_script_handler(PlasmaScriptHandler handler, gpointer user_data);
+char* plasma_build_wallpaper_script(const char *image_path, int desktop_index);
+
+// Wallpaper functions (desktop_index -1 means all desktops)
+gboolean plasma_set_wallpaper(const char *image_path, int desktop_index, GError **error);
+gboolean plasma_apply_wallpaper_tool(const char *image_path, GError **error);
+gboolean plasma_apply_batch(const PlasmaAssignment *assignments, guint count, GError **error);
+char* plasma_build_batch_script(const PlasmaAssignment *assignments, guint count);
+int plasma_get_desktop_count(GError **error);
+int plasma_peek_desktop_count(void);
+
+// Screens (arrays of PlasmaScreen in desktop order)
+GArray* plasma_get_screens(GError **error);
+GArray* plasma_peek_screens(void);
+void plasma_forget_screens(void);
+GArray* plasma_parse_screens(const char *output);
+
+// Connection management
+void plasma_shutdown(void);
+
+#endif // PLASMA_H
@@ -0,0 +1,43 @@
+#ifndef RATINGS_H
+#define RATINGS_H
+
+#include <glib.h>
+
+// Per-image star ratings and viewing history, and the selection weight
+// derived from them.
+//
+// A rating of 1-5 stars scales an image's weight from 1/4 to 4 (3 stars,
+// like no rating, is 1). Each time an image is shown and each time it is
+// skipped soon after, a counter goes up; the counters decay exponentially,
+// shows with a half-life of RATINGS_SHOW_HALF_LIFE and skips with
+// RATINGS_SKIP_HALF_LIFE, and divide the weight while they last. Stored
+// in ~/.dp/ratings.bin next to the config. Not thread-safe.
+typedef struct _Ratings Ratings;
+
+#define RATINGS_MAX_STARS 5
+#define RATINGS_SHOW_HALF_LIFE (3 * 24 * 3600)      // Seconds
+#define RATINGS_SKIP_HALF_LIFE (30 * 24 * 3600)
+
+// Ratings lifecycle
+Ratings* ratings_open(const char *path);
+void ratings_free(Ratings *ratings);
+gboolean ratings_save(Ratings *ratings);
+
+// Stars are 1..RATINGS_MAX_STARS; 0 clears the rating
+void ratings_set_stars(Ratings *ratings, const char *image_path, int stars);
+int ratings_get_stars(const Ratings *ratings, const char *image_path);
+
+// History; now is wall-clock seconds
+void ratings_record_show(Ratings *ratings, const char *image_path, gint64 now);
+void ratings_record_skip(Ratings *ratings, const char *image_path, gint64 now);
+
+// Keep an image's rating and history when its file is renamed
+void ratings_rename(Ratings *ratings, const char *old_path, const char *new_path);
+
+// Selection weight at time now, > 0
+double ratings_get_weight(const Ratings *ratings, const char *image_path, gint64 now);
+
+// Utility functions
+char* ratings_get_default_path(void);
+
+#endif // RATINGS_H
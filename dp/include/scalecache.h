@@ -0,0 +1,47 @@
+#ifndef SCALECACHE_H
+#define SCALECACHE_H
+
+#include <glib.h>
+
+// Derived-image cache of library images pre-scaled for the screen.
+//
+// Variants live in ~/.dp/cache/scaled and are named after the source
+// image's content hash and the target size, so renamed or duplicated files
+// share one variant and a resolution change never serves a stale one. Only
+// images that are larger than the screen (or stored uncompressed) get a
+// variant; everything else is applied as-is.
+//
+// Looking up a variant never reads the source past its header: content
+// hashes are remembered by path while the file's size, mtime and inode are
+// unchanged, and kept in ~/.dp/cache/scaled-sources.bin across restarts.
+// Until scalecache_prepare() has hashed an image in the background, the
+// lookup finds nothing and the original is applied.
+//
+// scalecache_prune() keeps the directory bounded: variants go once their
+// source is gone or changed, when they're for a size that is no longer the
+// target, after SCALECACHE_MAX_AGE_DAYS without use, and least recently
+// used first beyond SCALECACHE_MAX_BYTES.
+
+#define SCALECACHE_MAX_BYTES    (512 * 1024 * 1024)
+#define SCALECACHE_MAX_AGE_DAYS 60
+
+// Target geometry (set from the main thread, read from workers)
+void scalecache_set_target(int width, int height);
+gboolean scalecache_get_target(int *width, int *height);
+
+// Variant lookup and generation (callers free the returned path)
+char* scalecache_lookup(const char *image_path);
+char* scalecache_prepare(const char *image_path, GError **error);
+gboolean scalecache_wants_variant(const char *image_path);
+
+// Persist the hash memo if it changed; scalecache_shutdown() does too
+gboolean scalecache_save(void);
+
+// Evict variants; returns how many files were removed. Blocks on I/O.
+guint scalecache_prune(void);
+
+// Utility functions
+char* scalecache_get_default_directory(void);
+void scalecache_shutdown(void);
+
+#endif // SCALECACHE_H
@@ -1,15 +1,78 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
-// Function declarations for scheduling functionality
+#include <glib.h>
+
+// Time-of-day wallpaper schedule, read from a key file (normally
+// ~/.dp/schedule.ini):
+//
+//   [location]
+//   latitude=52.37
+//   longitude=4.90
+//
+//   [day]
+//   start=sunrise+00:30
+//   image=~/Pictures/dawn.jpg;~/Pictures/noon.jpg
+//
+//   [night]
+//   start=21:00
+//   playlist=~/Pictures/Night
+//
+// Every group other than location is a slot that lasts from its start to
+// the next slot's start, wrapping around midnight. A start is HH:MM local
+// time, or sunrise/sunset with an optional +HH:MM or -HH:MM offset;
+// sunrise and sunset are computed from the coordinates with the NOAA solar
+// equations, and sun-relative slots are left out on days the sun doesn't
+// rise or set. A slot shows its images, or the images directly inside its
+// playlist directory, in turn. Relative paths are taken from the schedule
+// file's directory.
+//
+// While running, the scheduler keeps one timer armed for the next slot
+// boundary and does nothing in between. Not thread-safe; use from the main
+// loop.
+typedef enum {
+    SCHEDULER_ANCHOR_CLOCK,     // offset is minutes after local midnight
+    SCHEDULER_ANCHOR_SUNRISE,   // offset is minutes from sunrise
+    SCHEDULER_ANCHOR_SUNSET     // offset is minutes from sunset
+} SchedulerAnchor;
+
 typedef struct {
-    int hour;
-    int minute;
-    char *wallpaper_path;
+    char *name;                 // Group name
+    SchedulerAnchor anchor;
+    int offset;
+    char **images;              // Full paths, or NULL
+    char *playlist;             // Directory, or NULL
+    guint position;             // Next image to show
 } TimeSlot;
 
-int start_scheduler(int interval_seconds);
-void stop_scheduler(void);
-TimeSlot* get_time_based_wallpaper(void);
+typedef struct _Scheduler Scheduler;
+
+// Called when a slot begins, and on start for the slot active then. Don't
+// free the scheduler from here.
+typedef void (*SchedulerCallback)(TimeSlot *slot, gpointer user_data);
+
+// Scheduler lifecycle
+Scheduler* scheduler_load(const char *path, GError **error);
+void scheduler_free(Scheduler *scheduler);
+
+void scheduler_start(Scheduler *scheduler, SchedulerCallback callback, gpointer user_data);
+void scheduler_stop(Scheduler *scheduler);
+
+// Re-arm after the wall clock moved under the timer (resume from suspend,
+// time zone change); a slot that began meanwhile is reported once
+void scheduler_reschedule(Scheduler *scheduler);
+
+// Queries; now is local time, NULL for the current time
+TimeSlot* scheduler_get_active_slot(const Scheduler *scheduler, GDateTime *now);
+GDateTime* scheduler_get_next_boundary(const Scheduler *scheduler, GDateTime *now);
+guint scheduler_get_slot_count(const Scheduler *scheduler);
+
+// The slot's next image, skipping missing files; NULL if it has none.
+// Peeking returns the same image without moving the slot on.
+char* scheduler_next_image(TimeSlot *slot);
+char* scheduler_peek_image(const TimeSlot *slot);
+
+// Utility functions
+char* scheduler_get_default_path(void);
 
-#endif // SCHEDULER_H
\ No newline at end of file
+#endif // SCHEDULER_H
@@ -0,0 +1,79 @@
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include <glib.h>
+
+// Chooses which image to show next.
+//
+// Randomness comes from a xoshiro256** generator whose state is saved with
+// the selector (normally ~/.dp/cache/selector.bin), so picks don't depend
+// on the clock and a restart continues the same sequence. In shuffle mode
+// every image is shown once per cycle before any repeats, and the last
+// image of a cycle is never the first of the next. The bag is an array
+// split into not-yet-shown and shown parts plus a path -> position table,
+// so a pick, an addition and a removal are each O(1). Which images were
+// already shown this cycle is saved too.
+//
+// In weighted mode each image is picked in proportion to a weight supplied
+// by a callback (ratings, history, ...). Picks use Vose alias tables: one
+// per block of SELECTOR_BLOCK items plus one over the block totals, so a
+// pick is O(1) and a changed weight only rebuilds its block and the top
+// table, lazily at the next pick.
+//
+// Items are full image paths. Not thread-safe; use from the main loop.
+typedef struct _Selector Selector;
+
+#define SELECTOR_BLOCK 256
+
+typedef enum {
+    SELECTOR_MODE_RANDOM,   // Independent uniform picks
+    SELECTOR_MODE_SHUFFLE,  // No repeats until every image has been shown
+    SELECTOR_MODE_WEIGHTED  // In proportion to the weights, no immediate repeats
+} SelectorMode;
+
+// Weight of an image, >= 0. Called when an image is added and on updates.
+typedef double (*SelectorWeightFunc)(const char *path, gpointer user_data);
+
+// Whether an image is acceptable for a restricted pick
+typedef gboolean (*SelectorMatchFunc)(const char *path, gpointer user_data);
+
+// Selector lifecycle
+Selector* selector_open(const char *cache_path);
+void selector_free(Selector *selector);
+gboolean selector_save(Selector *selector);
+gboolean selector_is_dirty(const Selector *selector);
+
+void selector_set_mode(Selector *selector, SelectorMode mode);
+SelectorMode selector_get_mode(const Selector *selector);
+
+// Weights (all 1 without a function). Re-query one image after its inputs
+// change, or all of them, O(n), e.g. as history decays.
+void selector_set_weight_func(Selector *selector, SelectorWeightFunc func, gpointer user_data);
+void selector_update_weight(Selector *selector, const char *path);
+void selector_refresh_weights(Selector *selector);
+
+// Incremental updates. An added image joins the current cycle; a renamed
+// one keeps its place in it.
+gboolean selector_add(Selector *selector, const char *path);
+gboolean selector_remove(Selector *selector, const char *path);
+gboolean selector_rename(Selector *selector, const char *old_path, const char *new_path);
+
+// Make the items exactly paths (copied), keeping the cycle position of
+// images that stay. O(n) in the number of paths.
+void selector_sync(Selector *selector, GPtrArray *paths);
+
+// Picks; NULL or an empty array when there are no images
+char* selector_next(Selector *selector);
+GPtrArray* selector_next_many(Selector *selector, guint count);
+char* selector_next_matching(Selector *selector, SelectorMatchFunc match, gpointer user_data, guint tries);
+
+// Queries
+guint selector_get_count(const Selector *selector);
+guint selector_get_remaining(const Selector *selector);
+
+// Utility functions
+char* selector_get_default_path(void);
+const char* selector_mode_get_name(SelectorMode mode);
+gboolean selector_mode_from_name(const char *name, SelectorMode *mode);
+
+#endif // SELECTOR_H
@@ -0,0 +1,33 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+// D-Bus interface of the running instance on the session bus. The bus name
+// is the application id; GApplication owns it and exports the object path.
+#define SERVICE_BUS_NAME    "com.cyberboost.Dpaper"
+#define SERVICE_OBJECT_PATH "/com/cyberboost/Dpaper"
+#define SERVICE_INTERFACE   "com.cyberboost.Dpaper1"
+
+// Actions behind the interface's methods, run on the main loop. Each returns
+// FALSE and sets error when the request is rejected; accepted requests are
+// queued and complete in the background.
+typedef struct {
+    char* (*next)(GError **error);                                  // Returns the image chosen
+    gboolean (*set)(const char *image_path, int desktop_index, GError **error);  // -1 = all desktops
+    guint (*import)(const char *path, GError **error);              // Returns the files queued, 0 on error
+    char* (*rate)(const char *image_path, int stars, GError **error); // "" = current; returns the image rated
+} ServiceHandlers;
+
+// Daemon side: export the interface on the application's connection
+void service_start(GDBusConnection *connection, const ServiceHandlers *handlers);
+void service_stop(void);
+
+// Client side: call a method on the running instance; fails quickly if it isn't running
+GVariant* service_call(const char *method, GVariant *parameters, const GVariantType *reply_type, GError **error);
+
+// Client side: the Stats (see metrics_snapshot()) of a running instance
+GVariant* service_get_stats(GError **error);
+
+#endif // SERVICE_H
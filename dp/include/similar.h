@@ -0,0 +1,39 @@
+#ifndef SIMILAR_H
+#define SIMILAR_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+// Perceptual near-duplicate detection. Each image gets a 64-bit difference
+// hash (dHash) of a 9x8 grayscale thumbnail; resized or re-encoded copies of
+// a picture land within a few bits of each other. Images are grouped by
+// Hamming distance to the copy each group would keep.
+
+// Maximum differing bits for two images to count as the same picture
+#define SIMILAR_DEFAULT_THRESHOLD 10
+
+// Per-image result of similar_hash_files()
+typedef struct {
+    guint64 dhash;
+    int width;
+    int height;
+    gboolean valid;     // FALSE if the image couldn't be decoded
+} SimilarInfo;
+
+// Called from pool threads after each image
+typedef void (*SimilarProgressFunc)(guint done, guint total, gpointer user_data);
+
+// Hashing
+guint64 similar_dhash_rgb(const guint8 *pixels, int width, int height, int rowstride, int channels);
+gboolean similar_dhash_file(const char *path, SimilarInfo *info, GError **error);
+SimilarInfo* similar_hash_files(GPtrArray *paths, guint max_workers,
+                                SimilarProgressFunc progress, gpointer user_data,
+                                GCancellable *cancellable);
+
+// Grouping: returns clusters of two or more indices (GArray of guint each).
+// The first index of a cluster is the copy to keep, the one with the most
+// pixels (then the earliest); every other member is within threshold of it.
+GPtrArray* similar_cluster(const SimilarInfo *infos, guint count, guint threshold);
+guint similar_distance(guint64 a, guint64 b);
+
+#endif // SIMILAR_H
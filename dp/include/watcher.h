@@ -0,0 +1,24 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <glib.h>
+
+// Watches a wallpaper directory and reports image-level changes as they
+// happen, so the library can be updated incrementally instead of rescanned.
+typedef enum {
+    WATCHER_EVENT_ADDED,     // name was created, modified or moved in
+    WATCHER_EVENT_REMOVED,   // name was deleted or moved out
+    WATCHER_EVENT_RENAMED    // name was renamed to new_name within the directory
+} WatcherEventType;
+
+typedef void (*WatcherCallback)(WatcherEventType type, const char *name,
+                                const char *new_name, gpointer user_data);
+
+typedef struct _Watcher Watcher;
+
+// Watcher functions
+Watcher* watcher_new(const char *directory, WatcherCallback callback, gpointer user_data);
+void watcher_free(Watcher *watcher);
+const char* watcher_get_directory(const Watcher *watcher);
+
+#endif // WATCHER_H
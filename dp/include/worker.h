@@ -0,0 +1,29 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+// Background job executor. Jobs run on a worker thread per lane; their
+// completion callbacks run back on the main loop. Jobs in a lane run one at
+// a time, in submission order.
+typedef enum {
+    WORKER_LANE_APPLY,   // Wallpaper applies; a new job cancels older ones still queued
+    WORKER_LANE_IO,      // Imports and directory scans
+    WORKER_LANE_COUNT
+} WorkerLane;
+
+// Runs on the worker thread. Skipped entirely if cancelled before it starts.
+typedef void (*WorkerFunc)(gpointer data, GCancellable *cancellable);
+
+// Runs on the main loop once the job has finished or been skipped
+typedef void (*WorkerDoneFunc)(gpointer data, gboolean cancelled);
+
+// Worker functions. Once worker_shutdown() has begun, submitted jobs are
+// dropped: their data is freed and neither func nor done runs.
+void worker_init(void);
+void worker_shutdown(void);
+void worker_submit(WorkerLane lane, WorkerFunc func, WorkerDoneFunc done,
+                   gpointer data, GDestroyNotify free_data);
+
+#endif // WORKER_H
@@ -0,0 +1,97 @@
+#include "binfile.h"
+#include <string.h>
+#include <glib.h>
+
+gboolean binfile_parse(const BinfileFormat *format, const char *data, gsize length, BinfileView *view) {
+    if (!data || length < sizeof(BinfileHeader) + format->extra_size) {
+        return FALSE;
+    }
+
+    const BinfileHeader *header = (const BinfileHeader *)data;
+    gsize table_size = (gsize)header->count * format->record_size;
+    if (header->magic != format->magic ||
+        header->version != format->version ||
+        (format->record_size > 0 && table_size / format->record_size != header->count) ||
+        length != sizeof(BinfileHeader) + format->extra_size + table_size + header->pool_size) {
+        return FALSE;
+    }
+
+    const char *extra = data + sizeof(BinfileHeader);
+    const char *pool = extra + format->extra_size + table_size;
+    if (header->pool_size > 0 && pool[header->pool_size - 1] != '\0') {
+        return FALSE;
+    }
+
+    view->extra = extra;
+    view->records = extra + format->extra_size;
+    view->count = header->count;
+    view->pool = pool;
+    view->pool_size = header->pool_size;
+    return TRUE;
+}
+
+char* binfile_load(const BinfileFormat *format, const char *path, BinfileView *view) {
+    char *data = NULL;
+    gsize length = 0;
+    if (!g_file_get_contents(path, &data, &length, NULL)) {
+        return NULL;
+    }
+    if (!binfile_parse(format, data, length, view)) {
+        g_free(data);
+        return NULL;
+    }
+    return data;
+}
+
+const char* binfile_string(const BinfileView *view, guint32 offset, guint32 length) {
+    guint64 end = (guint64)offset + length;
+    if (end >= view->pool_size || view->pool[end] != '\0') {
+        return NULL;
+    }
+    return view->pool + offset;
+}
+
+guint32 binfile_pool_append(GString *pool, const char *string, guint32 *length) {
+    guint32 offset = (guint32)pool->len;
+    *length = (guint32)strlen(string);
+    g_string_append_len(pool, string, *length + 1);
+    return offset;
+}
+
+gboolean binfile_save(const BinfileFormat *format, const char *path, const void *extra,
+                      const void *records, guint count, const char *pool, gsize pool_size,
+                      GError **error) {
+    BinfileHeader header = {0};
+    header.magic = format->magic;
+    header.version = format->version;
+    header.count = count;
+    header.pool_size = (guint32)pool_size;
+
+    gsize table_size = (gsize)count * format->record_size;
+    gsize length = sizeof(header) + format->extra_size + table_size + pool_size;
+    char *buffer = g_malloc(length);
+    char *cursor = buffer;
+    memcpy(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+    if (format->extra_size > 0) {
+        memcpy(cursor, extra, format->extra_size);
+        cursor += format->extra_size;
+    }
+    if (table_size > 0) {
+        memcpy(cursor, records, table_size);
+        cursor += table_size;
+    }
+    if (pool_size > 0) {
+        memcpy(cursor, pool, pool_size);
+    }
+
+    char *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+
+    gboolean success = g_file_set_contents_full(path, buffer, length,
+                                                G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE,
+                                                0644, error);
+    g_free(buffer);
+    return success;
+}
@@ -0,0 +1,888 @@
+#define _GNU_SOURCE
+#include "catalog.h"
+#include "binfile.h"
+#include "imagemeta.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define CATALOG_MAGIC   0x54435044u  // "DPCT"
+#define CATALOG_VERSION 5
+
+// Header reads run on a pool of this many threads once a scan has more
+// than CATALOG_INDEX_BATCH files to read; they mostly wait on the disk
+#define CATALOG_INDEX_WORKERS 8
+#define CATALOG_INDEX_BATCH 32
+
+// On-disk layout: this after the binfile header, then the entry table and
+// the name pool. The pool starts with the catalog's directory followed by
+// each image filename.
+typedef struct {
+    gint64 dir_mtime_sec;
+    gint64 dir_mtime_nsec;
+} CatalogSaved;
+
+typedef struct {
+    guint32 name_offset;
+    guint32 name_length;
+    guint64 size;
+    gint64 mtime;
+    guint32 width;          // 0 x 0 if the header couldn't be read
+    guint32 height;
+    guint32 format;         // ImageFormat
+    guint32 reserved;
+} CatalogEntry;
+
+static const BinfileFormat catalog_format = {
+    CATALOG_MAGIC, CATALOG_VERSION, sizeof(CatalogSaved), sizeof(CatalogEntry)
+};
+
+// The visible images of one size in the aspect index. Libraries hold many
+// images of a few sizes, so queries walk sizes rather than images.
+typedef struct {
+    double aspect;          // log(width / height), so ratios compare symmetrically
+    guint32 width;
+    guint32 height;
+    guint first;            // Visible indices are aspect_members[first, first + count)
+    guint count;
+} CatalogAspect;
+
+struct _Catalog {
+    char *directory;
+    char *cache_path;
+    gint64 dir_mtime_sec;
+    gint64 dir_mtime_nsec;
+
+    // Point into the mapping when loaded from disk, into owned buffers after a rebuild
+    const CatalogEntry *entries;
+    const char *names;
+    guint count;
+    gsize names_size;
+
+    GMappedFile *mapping;
+    GArray *owned_entries;
+    GString *owned_names;
+    gsize names_garbage;
+
+    // Name -> index + 1, built on first incremental update
+    GHashTable *index;
+
+    // Read-only layer underneath (not owned); see catalog_set_lower()
+    const Catalog *lower;
+    GHashTable *lower_names;        // Lower layer name -> index + 1, keys borrowed
+    GArray *lower_visible;          // Lower indices not shadowed by an entry of ours
+
+    // CatalogAspect per image size, sorted by aspect; built at the first
+    // match after a change
+    GArray *aspects;
+    GArray *aspect_members;
+};
+
+static void catalog_update_lower(Catalog *catalog);
+
+// Visible indices move with every change, so the aspect index goes with them
+static void catalog_forget_aspects(Catalog *catalog) {
+    if (catalog->aspects) {
+        g_array_free(catalog->aspects, TRUE);
+        g_array_free(catalog->aspect_members, TRUE);
+        catalog->aspects = NULL;
+        catalog->aspect_members = NULL;
+    }
+}
+
+// Drop the current entry table, whichever storage it lives in
+static void catalog_clear(Catalog *catalog) {
+    if (catalog->mapping) {
+        g_mapped_file_unref(catalog->mapping);
+        catalog->mapping = NULL;
+    }
+    if (catalog->owned_entries) {
+        g_array_free(catalog->owned_entries, TRUE);
+        catalog->owned_entries = NULL;
+    }
+    if (catalog->owned_names) {
+        g_string_free(catalog->owned_names, TRUE);
+        catalog->owned_names = NULL;
+    }
+    if (catalog->index) {
+        g_hash_table_destroy(catalog->index);
+        catalog->index = NULL;
+    }
+    catalog_forget_aspects(catalog);
+    catalog->entries = NULL;
+    catalog->names = NULL;
+    catalog->count = 0;
+    catalog->names_size = 0;
+    catalog->names_garbage = 0;
+}
+
+static gboolean stat_directory_mtime(const char *directory, gint64 *sec, gint64 *nsec) {
+    struct stat st;
+    if (stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return FALSE;
+    }
+    *sec = st.st_mtim.tv_sec;
+    *nsec = st.st_mtim.tv_nsec;
+    return TRUE;
+}
+
+// Map the cache file and check it describes this directory
+static gboolean catalog_load_mapping(Catalog *catalog) {
+    GMappedFile *mapping = g_mapped_file_new(catalog->cache_path, FALSE, NULL);
+    if (!mapping) {
+        return FALSE;
+    }
+
+    BinfileView view;
+    if (!binfile_parse(&catalog_format, g_mapped_file_get_contents(mapping),
+                       g_mapped_file_get_length(mapping), &view)) {
+        g_mapped_file_unref(mapping);
+        return FALSE;
+    }
+
+    // The pool must start with our directory and every name must stay in bounds
+    const CatalogEntry *entries = view.records;
+    if (view.pool_size == 0 || strcmp(view.pool, catalog->directory) != 0) {
+        g_mapped_file_unref(mapping);
+        return FALSE;
+    }
+    for (guint32 i = 0; i < view.count; i++) {
+        if (!binfile_string(&view, entries[i].name_offset, entries[i].name_length)) {
+            g_mapped_file_unref(mapping);
+            return FALSE;
+        }
+    }
+
+    const CatalogSaved *saved = view.extra;
+    catalog_clear(catalog);
+    catalog->mapping = mapping;
+    catalog->entries = entries;
+    catalog->names = view.pool;
+    catalog->count = view.count;
+    catalog->names_size = view.pool_size;
+    catalog->dir_mtime_sec = saved->dir_mtime_sec;
+    catalog->dir_mtime_nsec = saved->dir_mtime_nsec;
+    catalog_update_lower(catalog);
+    return TRUE;
+}
+
+// Open the catalog for a directory from its cache file. This only maps the
+// file; call catalog_refresh() to rescan if catalog_is_current() says so.
+Catalog* catalog_open(const char *directory, const char *cache_path) {
+    Catalog *catalog = g_new0(Catalog, 1);
+    catalog->directory = g_strdup(directory);
+    catalog->cache_path = g_strdup(cache_path);
+
+    // Create the cache directory up front so doing so later can't bump the
+    // wallpaper directory's mtime after we've recorded it
+    char *cache_dir = g_path_get_dirname(cache_path);
+    g_mkdir_with_parents(cache_dir, 0755);
+    g_free(cache_dir);
+
+    catalog_load_mapping(catalog);
+    return catalog;
+}
+
+void catalog_free(Catalog *catalog) {
+    if (!catalog) return;
+
+    catalog_set_lower(catalog, NULL);
+    catalog_clear(catalog);
+    g_free(catalog->directory);
+    g_free(catalog->cache_path);
+    g_free(catalog);
+}
+
+// Whether the directory is unchanged since the last scan (one stat)
+gboolean catalog_is_current(const Catalog *catalog) {
+    gint64 sec = 0, nsec = 0;
+    if (!stat_directory_mtime(catalog->directory, &sec, &nsec)) {
+        return catalog->count == 0;
+    }
+
+    return catalog->names != NULL &&
+           sec == catalog->dir_mtime_sec && nsec == catalog->dir_mtime_nsec;
+}
+
+// Rebuild if the directory changed since the last scan. Returns TRUE if rebuilt.
+gboolean catalog_refresh(Catalog *catalog) {
+    if (catalog_is_current(catalog)) {
+        return FALSE;
+    }
+
+    if (!g_file_test(catalog->directory, G_FILE_TEST_IS_DIR)) {
+        catalog_clear(catalog);
+        catalog_update_lower(catalog);
+        return TRUE;
+    }
+
+    if (catalog_rebuild(catalog)) {
+        catalog_save(catalog);
+    }
+    return TRUE;
+}
+
+// Read an image's format and dimensions from its header
+static void catalog_index_entry(int dir_fd, const char *name, CatalogEntry *entry) {
+    ImageMeta meta;
+    imagemeta_read_at(dir_fd, name, &meta, NULL);
+    entry->width = (guint32)meta.width;
+    entry->height = (guint32)meta.height;
+    entry->format = (guint32)meta.format;
+    entry->reserved = 0;
+}
+
+typedef struct {
+    int dir_fd;
+    GArray *entries;
+    const char *names;
+    const GArray *pending;  // Indices into entries
+} CatalogIndexBatch;
+
+// Pool thread: read one header
+static void catalog_index_task_run(gpointer data, gpointer user_data) {
+    CatalogIndexBatch *batch = user_data;
+    guint index = g_array_index(batch->pending, guint, GPOINTER_TO_UINT(data) - 1);
+    CatalogEntry *entry = &g_array_index(batch->entries, CatalogEntry, index);
+    catalog_index_entry(batch->dir_fd, batch->names + entry->name_offset, entry);
+}
+
+// Read the headers of the pending entries, in parallel for large batches
+// so the disk has several requests queued
+static void catalog_index_entries(int dir_fd, GArray *entries, const GString *names, const GArray *pending) {
+    if (pending->len <= CATALOG_INDEX_BATCH) {
+        for (guint i = 0; i < pending->len; i++) {
+            CatalogEntry *entry = &g_array_index(entries, CatalogEntry, g_array_index(pending, guint, i));
+            catalog_index_entry(dir_fd, names->str + entry->name_offset, entry);
+        }
+        return;
+    }
+
+    CatalogIndexBatch batch = { dir_fd, entries, names->str, pending };
+    GThreadPool *pool = g_thread_pool_new(catalog_index_task_run, &batch, CATALOG_INDEX_WORKERS, FALSE, NULL);
+    for (guint i = 0; i < pending->len; i++) {
+        g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+    }
+
+    // Wait for every queued file
+    g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+// Scan the directory once and replace the entry table
+gboolean catalog_rebuild(Catalog *catalog) {
+    gint64 sec = 0, nsec = 0;
+
+    // Record the mtime before reading so concurrent changes show up as stale
+    if (!stat_directory_mtime(catalog->directory, &sec, &nsec)) {
+        catalog_clear(catalog);
+        catalog_update_lower(catalog);
+        return FALSE;
+    }
+
+    DIR *dir = opendir(catalog->directory);
+    if (!dir) {
+        catalog_clear(catalog);
+        catalog_update_lower(catalog);
+        return FALSE;
+    }
+
+    // Headers of unchanged files carry over from the previous table, so
+    // only new and modified images are read
+    GHashTable *previous = NULL;
+    if (catalog->count > 0) {
+        previous = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint i = 0; i < catalog->count; i++) {
+            g_hash_table_insert(previous, (gpointer)catalog_get_name(catalog, i), (gpointer)&catalog->entries[i]);
+        }
+    }
+
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(CatalogEntry));
+    GArray *pending = g_array_new(FALSE, FALSE, sizeof(guint));
+    GString *names = g_string_sized_new(4096);
+    g_string_append_len(names, catalog->directory, strlen(catalog->directory) + 1);
+
+    int dfd = dirfd(dir);
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (!catalog_is_image_file(ent->d_name)) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dfd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        CatalogEntry entry;
+        entry.name_offset = (guint32)names->len;
+        entry.name_length = (guint32)strlen(ent->d_name);
+        entry.size = (guint64)st.st_size;
+        entry.mtime = (gint64)st.st_mtim.tv_sec;
+        const CatalogEntry *old = previous ? g_hash_table_lookup(previous, ent->d_name) : NULL;
+        if (old && old->size == entry.size && old->mtime == entry.mtime) {
+            entry.width = old->width;
+            entry.height = old->height;
+            entry.format = old->format;
+            entry.reserved = 0;
+        } else {
+            g_array_append_val(pending, entries->len);
+        }
+        g_string_append_len(names, ent->d_name, entry.name_length + 1);
+        g_array_append_val(entries, entry);
+    }
+    catalog_index_entries(dfd, entries, names, pending);
+    g_array_free(pending, TRUE);
+    closedir(dir);
+    if (previous) {
+        g_hash_table_destroy(previous);
+    }
+
+    catalog_clear(catalog);
+    catalog->owned_entries = entries;
+    catalog->owned_names = names;
+    catalog->entries = (const CatalogEntry *)entries->data;
+    catalog->names = names->str;
+    catalog->count = entries->len;
+    catalog->names_size = names->len;
+    catalog->dir_mtime_sec = sec;
+    catalog->dir_mtime_nsec = nsec;
+    catalog_update_lower(catalog);
+    return TRUE;
+}
+
+// Write the catalog to its cache file atomically
+gboolean catalog_save(Catalog *catalog) {
+    if (!catalog->names) {
+        return FALSE;
+    }
+
+    CatalogSaved saved = { catalog->dir_mtime_sec, catalog->dir_mtime_nsec };
+    GError *error = NULL;
+    gboolean success = binfile_save(&catalog_format, catalog->cache_path, &saved, catalog->entries, catalog->count,
+                                    catalog->names, catalog->names_size, &error);
+    if (!success) {
+        log_warning("Failed to save catalog %s: %s", catalog->cache_path, error->message);
+        g_error_free(error);
+    }
+    return success;
+}
+
+// Point the public views at the owned buffers after they may have moved
+static void catalog_sync_views(Catalog *catalog) {
+    catalog->entries = (const CatalogEntry *)catalog->owned_entries->data;
+    catalog->names = catalog->owned_names->str;
+    catalog->count = catalog->owned_entries->len;
+    catalog->names_size = catalog->owned_names->len;
+}
+
+static void catalog_ensure_index(Catalog *catalog) {
+    if (catalog->index) return;
+
+    catalog->index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (guint i = 0; i < catalog->count; i++) {
+        g_hash_table_insert(catalog->index, g_strdup(catalog_get_name(catalog, i)),
+                            GUINT_TO_POINTER(i + 1));
+    }
+}
+
+// Move a mapped catalog into owned memory and build the name index
+static gboolean catalog_make_writable(Catalog *catalog) {
+    if (!catalog->names) {
+        return FALSE;
+    }
+
+    if (catalog->mapping) {
+        GArray *entries = g_array_sized_new(FALSE, FALSE, sizeof(CatalogEntry), catalog->count);
+        g_array_append_vals(entries, catalog->entries, catalog->count);
+        GString *names = g_string_sized_new(catalog->names_size);
+        g_string_append_len(names, catalog->names, catalog->names_size);
+
+        g_mapped_file_unref(catalog->mapping);
+        catalog->mapping = NULL;
+        catalog->owned_entries = entries;
+        catalog->owned_names = names;
+        catalog_sync_views(catalog);
+    }
+
+    catalog_ensure_index(catalog);
+    return TRUE;
+}
+
+// Rewrite the name pool without the names of removed entries
+static void catalog_compact_names(Catalog *catalog) {
+    GString *names = g_string_sized_new(catalog->names_size - catalog->names_garbage);
+    g_string_append_len(names, catalog->directory, strlen(catalog->directory) + 1);
+
+    for (guint i = 0; i < catalog->owned_entries->len; i++) {
+        CatalogEntry *entry = &g_array_index(catalog->owned_entries, CatalogEntry, i);
+        const char *name = catalog->owned_names->str + entry->name_offset;
+        entry->name_offset = (guint32)names->len;
+        g_string_append_len(names, name, entry->name_length + 1);
+    }
+
+    g_string_free(catalog->owned_names, TRUE);
+    catalog->owned_names = names;
+    catalog->names_garbage = 0;
+    catalog_sync_views(catalog);
+}
+
+// Keep the recorded mtime current so applied deltas don't force a rescan
+static void catalog_touch(Catalog *catalog) {
+    gint64 sec = 0, nsec = 0;
+    if (stat_directory_mtime(catalog->directory, &sec, &nsec)) {
+        catalog->dir_mtime_sec = sec;
+        catalog->dir_mtime_nsec = nsec;
+    }
+}
+
+// Hide or reveal the lower layer's entry with this name after one of ours
+// was added or removed
+static void catalog_shadow_lower(Catalog *catalog, const char *name, gboolean shadowed) {
+    if (!catalog->lower_names) return;
+
+    guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->lower_names, name));
+    if (slot == 0) return;
+
+    if (!shadowed) {
+        guint lower_index = slot - 1;
+        g_array_append_val(catalog->lower_visible, lower_index);
+        return;
+    }
+    for (guint i = 0; i < catalog->lower_visible->len; i++) {
+        if (g_array_index(catalog->lower_visible, guint, i) == slot - 1) {
+            g_array_remove_index_fast(catalog->lower_visible, i);
+            break;
+        }
+    }
+}
+
+// Add or update a single image. Returns FALSE if it isn't a regular image file.
+gboolean catalog_add(Catalog *catalog, const char *name) {
+    if (!catalog_is_image_file(name) || !catalog_make_writable(catalog)) {
+        return FALSE;
+    }
+
+    char *path = g_build_filename(catalog->directory, name, NULL);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        g_free(path);
+        return FALSE;
+    }
+
+    guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->index, name));
+    if (slot > 0) {
+        CatalogEntry *entry = &g_array_index(catalog->owned_entries, CatalogEntry, slot - 1);
+        if (entry->size != (guint64)st.st_size || entry->mtime != (gint64)st.st_mtim.tv_sec) {
+            catalog_index_entry(AT_FDCWD, path, entry);
+        }
+        entry->size = (guint64)st.st_size;
+        entry->mtime = (gint64)st.st_mtim.tv_sec;
+    } else {
+        CatalogEntry entry;
+        entry.name_offset = (guint32)catalog->owned_names->len;
+        entry.name_length = (guint32)strlen(name);
+        entry.size = (guint64)st.st_size;
+        entry.mtime = (gint64)st.st_mtim.tv_sec;
+        catalog_index_entry(AT_FDCWD, path, &entry);
+        g_string_append_len(catalog->owned_names, name, entry.name_length + 1);
+        g_array_append_val(catalog->owned_entries, entry);
+        g_hash_table_insert(catalog->index, g_strdup(name),
+                            GUINT_TO_POINTER(catalog->owned_entries->len));
+        catalog_sync_views(catalog);
+        catalog_shadow_lower(catalog, name, TRUE);
+    }
+
+    g_free(path);
+    catalog_forget_aspects(catalog);
+    catalog_touch(catalog);
+    return TRUE;
+}
+
+// Remove a single image by moving the last entry into its slot
+gboolean catalog_remove(Catalog *catalog, const char *name) {
+    if (!catalog_make_writable(catalog)) {
+        return FALSE;
+    }
+
+    guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->index, name));
+    if (slot == 0) {
+        return FALSE;
+    }
+
+    guint index = slot - 1;
+    guint last = catalog->owned_entries->len - 1;
+    CatalogEntry *entry = &g_array_index(catalog->owned_entries, CatalogEntry, index);
+    catalog->names_garbage += entry->name_length + 1;
+    g_hash_table_remove(catalog->index, name);
+
+    if (index != last) {
+        const char *moved = catalog->owned_names->str +
+                            g_array_index(catalog->owned_entries, CatalogEntry, last).name_offset;
+        g_hash_table_insert(catalog->index, g_strdup(moved), GUINT_TO_POINTER(index + 1));
+    }
+    g_array_remove_index_fast(catalog->owned_entries, index);
+    catalog_sync_views(catalog);
+
+    if (catalog->names_garbage > catalog->names_size / 2) {
+        catalog_compact_names(catalog);
+    }
+    catalog_shadow_lower(catalog, name, FALSE);
+
+    catalog_forget_aspects(catalog);
+    catalog_touch(catalog);
+    return TRUE;
+}
+
+gboolean catalog_rename(Catalog *catalog, const char *old_name, const char *new_name) {
+    gboolean removed = catalog_remove(catalog, old_name);
+    gboolean added = catalog_add(catalog, new_name);
+    return removed || added;
+}
+
+const char* catalog_get_directory(const Catalog *catalog) {
+    return catalog->directory;
+}
+
+guint catalog_get_count(const Catalog *catalog) {
+    return catalog ? catalog->count : 0;
+}
+
+const char* catalog_get_name(const Catalog *catalog, guint index) {
+    if (index >= catalog->count) return NULL;
+    return catalog->names + catalog->entries[index].name_offset;
+}
+
+// Full path for an entry (caller frees)
+char* catalog_get_path(const Catalog *catalog, guint index) {
+    const char *name = catalog_get_name(catalog, index);
+    if (!name) return NULL;
+    return g_build_filename(catalog->directory, name, NULL);
+}
+
+// Recompute which lower entries show through, after our table was replaced
+static void catalog_update_lower(Catalog *catalog) {
+    catalog_forget_aspects(catalog);
+    if (!catalog->lower_visible) return;
+
+    guint lower_count = catalog_get_count(catalog->lower);
+    gboolean *shadowed = g_new0(gboolean, lower_count);
+    for (guint i = 0; i < catalog->count; i++) {
+        guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->lower_names, catalog_get_name(catalog, i)));
+        if (slot > 0) {
+            shadowed[slot - 1] = TRUE;
+        }
+    }
+
+    g_array_set_size(catalog->lower_visible, 0);
+    for (guint i = 0; i < lower_count; i++) {
+        if (!shadowed[i]) {
+            g_array_append_val(catalog->lower_visible, i);
+        }
+    }
+    g_free(shadowed);
+}
+
+// Layer this catalog over a read-only one, or remove the layer with NULL.
+// The lower catalog must outlive this one and not change while attached.
+void catalog_set_lower(Catalog *catalog, const Catalog *lower) {
+    if (catalog->lower_names) {
+        g_hash_table_destroy(catalog->lower_names);
+        catalog->lower_names = NULL;
+    }
+    if (catalog->lower_visible) {
+        g_array_free(catalog->lower_visible, TRUE);
+        catalog->lower_visible = NULL;
+    }
+    catalog_forget_aspects(catalog);
+    catalog->lower = lower;
+    if (!lower) return;
+
+    guint lower_count = catalog_get_count(lower);
+    catalog->lower_names = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < lower_count; i++) {
+        g_hash_table_insert(catalog->lower_names, (gpointer)catalog_get_name(lower, i), GUINT_TO_POINTER(i + 1));
+    }
+    catalog->lower_visible = g_array_sized_new(FALSE, FALSE, sizeof(guint), lower_count);
+    catalog_update_lower(catalog);
+}
+
+const Catalog* catalog_get_lower(const Catalog *catalog) {
+    return catalog ? catalog->lower : NULL;
+}
+
+guint catalog_get_visible_count(const Catalog *catalog) {
+    if (!catalog) return 0;
+    return catalog->count + (catalog->lower_visible ? catalog->lower_visible->len : 0);
+}
+
+gboolean catalog_is_visible_corrupt(const Catalog *catalog, guint index) {
+    if (index < catalog->count) {
+        return catalog_is_corrupt(catalog, index);
+    }
+
+    index -= catalog->count;
+    return catalog->lower_visible && index < catalog->lower_visible->len &&
+           catalog_is_corrupt(catalog->lower, g_array_index(catalog->lower_visible, guint, index));
+}
+
+// Full path for an entry of either layer, ours first (caller frees)
+char* catalog_get_visible_path(const Catalog *catalog, guint index) {
+    if (index < catalog->count) {
+        return catalog_get_path(catalog, index);
+    }
+
+    index -= catalog->count;
+    if (!catalog->lower_visible || index >= catalog->lower_visible->len) {
+        return NULL;
+    }
+    return catalog_get_path(catalog->lower, g_array_index(catalog->lower_visible, guint, index));
+}
+
+// Dimensions of an entry of ours; FALSE if its header couldn't be read
+gboolean catalog_get_dimensions(const Catalog *catalog, guint index, int *width, int *height) {
+    if (index >= catalog->count || catalog->entries[index].width == 0) {
+        return FALSE;
+    }
+    *width = (int)catalog->entries[index].width;
+    *height = (int)catalog->entries[index].height;
+    return TRUE;
+}
+
+ImageFormat catalog_get_format(const Catalog *catalog, guint index) {
+    if (index >= catalog->count) return IMAGE_FORMAT_UNKNOWN;
+    return (ImageFormat)catalog->entries[index].format;
+}
+
+// Whether an entry's header couldn't be read: not an image despite its
+// extension, truncated, or damaged
+gboolean catalog_is_corrupt(const Catalog *catalog, guint index) {
+    return index < catalog->count && catalog->entries[index].width == 0;
+}
+
+// The name of path if it's directly inside directory, else NULL
+static const char* name_in_directory(const char *directory, const char *path) {
+    if (!g_str_has_prefix(path, directory)) return NULL;
+
+    const char *name = path + strlen(directory);
+    if (*name != G_DIR_SEPARATOR && name[-1] != G_DIR_SEPARATOR) return NULL;
+    while (*name == G_DIR_SEPARATOR) {
+        name++;
+    }
+    return *name && !strchr(name, G_DIR_SEPARATOR) ? name : NULL;
+}
+
+// Dimensions of a full path in either layer; FALSE if it isn't in the
+// catalog or is corrupt
+gboolean catalog_lookup_dimensions(Catalog *catalog, const char *path, int *width, int *height) {
+    const char *name = name_in_directory(catalog->directory, path);
+    if (name) {
+        catalog_ensure_index(catalog);
+        guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->index, name));
+        return slot > 0 && catalog_get_dimensions(catalog, slot - 1, width, height);
+    }
+
+    name = catalog->lower ? name_in_directory(catalog->lower->directory, path) : NULL;
+    if (name) {
+        guint slot = GPOINTER_TO_UINT(g_hash_table_lookup(catalog->lower_names, name));
+        return slot > 0 && catalog_get_dimensions(catalog->lower, slot - 1, width, height);
+    }
+    return FALSE;
+}
+
+// How far an image would have to be upscaled to cover the screen, as a log
+// ratio, 0 if it's large enough
+static double cover_penalty(guint32 width, guint32 height, int screen_width, int screen_height) {
+    double scale = MAX((double)screen_width / width, (double)screen_height / height);
+    return scale > 1.0 ? log(scale) : 0.0;
+}
+
+gboolean catalog_image_fits(int width, int height, int screen_width, int screen_height) {
+    if (width <= 0 || height <= 0 || screen_width <= 0 || screen_height <= 0) {
+        return FALSE;
+    }
+    double skew = fabs(log((double)width / height) - log((double)screen_width / screen_height));
+    return skew <= log(1.0 + CATALOG_FIT_ASPECT) &&
+           width >= screen_width * CATALOG_FIT_SCALE && height >= screen_height * CATALOG_FIT_SCALE;
+}
+
+// A measured visible image, while building the aspect index
+typedef struct {
+    guint64 size;           // width << 32 | height
+    guint visible;
+} CatalogSized;
+
+static int compare_sized(gconstpointer a, gconstpointer b) {
+    const CatalogSized *left = a, *right = b;
+    if (left->size != right->size) {
+        return left->size < right->size ? -1 : 1;
+    }
+    return (left->visible > right->visible) - (left->visible < right->visible);
+}
+
+static int compare_aspects(gconstpointer a, gconstpointer b) {
+    double left = ((const CatalogAspect *)a)->aspect;
+    double right = ((const CatalogAspect *)b)->aspect;
+    return (left > right) - (left < right);
+}
+
+static void catalog_add_sized(GArray *sized, const Catalog *layer, guint index, guint visible) {
+    int width = 0, height = 0;
+    if (!catalog_get_dimensions(layer, index, &width, &height)) return;
+
+    CatalogSized entry = { (guint64)width << 32 | (guint32)height, visible };
+    g_array_append_val(sized, entry);
+}
+
+// Group the measured visible images by size, then order the sizes by aspect
+static const GArray* catalog_get_aspects(Catalog *catalog) {
+    if (catalog->aspects) {
+        return catalog->aspects;
+    }
+
+    GArray *sized = g_array_sized_new(FALSE, FALSE, sizeof(CatalogSized), catalog_get_visible_count(catalog));
+    for (guint i = 0; i < catalog->count; i++) {
+        catalog_add_sized(sized, catalog, i, i);
+    }
+    for (guint i = 0; catalog->lower_visible && i < catalog->lower_visible->len; i++) {
+        catalog_add_sized(sized, catalog->lower, g_array_index(catalog->lower_visible, guint, i), catalog->count + i);
+    }
+    g_array_sort(sized, compare_sized);
+
+    catalog->aspects = g_array_new(FALSE, FALSE, sizeof(CatalogAspect));
+    catalog->aspect_members = g_array_sized_new(FALSE, FALSE, sizeof(guint), sized->len);
+    for (guint i = 0; i < sized->len; i++) {
+        const CatalogSized *entry = &g_array_index(sized, CatalogSized, i);
+        if (i == 0 || entry->size != g_array_index(sized, CatalogSized, i - 1).size) {
+            CatalogAspect aspect;
+            aspect.width = (guint32)(entry->size >> 32);
+            aspect.height = (guint32)entry->size;
+            aspect.aspect = log((double)aspect.width / aspect.height);
+            aspect.first = i;
+            aspect.count = 0;
+            g_array_append_val(catalog->aspects, aspect);
+        }
+        g_array_index(catalog->aspects, CatalogAspect, catalog->aspects->len - 1).count++;
+        g_array_append_val(catalog->aspect_members, entry->visible);
+    }
+    g_array_free(sized, TRUE);
+
+    g_array_sort(catalog->aspects, compare_aspects);
+    return catalog->aspects;
+}
+
+// First aspect index position at or above aspect
+static guint lower_bound(const GArray *aspects, double aspect) {
+    guint low = 0, high = aspects->len;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (g_array_index(aspects, CatalogAspect, middle).aspect < aspect) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void append_members(const Catalog *catalog, const CatalogAspect *aspect, GArray *matches) {
+    g_array_append_vals(matches, &g_array_index(catalog->aspect_members, guint, aspect->first), aspect->count);
+}
+
+// Visible indices of the images that fit a screen, O(log sizes + matches)
+GArray* catalog_find_fitting(Catalog *catalog, int screen_width, int screen_height) {
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(guint));
+    if (screen_width <= 0 || screen_height <= 0) {
+        return matches;
+    }
+
+    const GArray *aspects = catalog_get_aspects(catalog);
+    double target = log((double)screen_width / screen_height);
+    double spread = log(1.0 + CATALOG_FIT_ASPECT);
+    for (guint i = lower_bound(aspects, target - spread); i < aspects->len; i++) {
+        const CatalogAspect *aspect = &g_array_index(aspects, CatalogAspect, i);
+        if (aspect->aspect > target + spread) break;
+        if (catalog_image_fits((int)aspect->width, (int)aspect->height, screen_width, screen_height)) {
+            append_members(catalog, aspect, matches);
+        }
+    }
+    return matches;
+}
+
+// Visible indices of the images closest to fitting a screen, all of one
+// size: aspect ratio difference plus how far the image would have to be
+// upscaled, both as log ratios. Empty if no image has been measured.
+// Searches outwards from the screen's aspect ratio and stops once the
+// ratio alone can't win.
+GArray* catalog_find_closest(Catalog *catalog, int screen_width, int screen_height) {
+    GArray *matches = g_array_new(FALSE, FALSE, sizeof(guint));
+    if (screen_width <= 0 || screen_height <= 0) {
+        return matches;
+    }
+
+    const GArray *aspects = catalog_get_aspects(catalog);
+    double target = log((double)screen_width / screen_height);
+    guint start = lower_bound(aspects, target);
+    double best_score = G_MAXDOUBLE;
+    const CatalogAspect *best = NULL;
+
+    for (guint i = start; i < aspects->len; i++) {
+        const CatalogAspect *aspect = &g_array_index(aspects, CatalogAspect, i);
+        double skew = aspect->aspect - target;
+        if (skew >= best_score) break;
+        double score = skew + cover_penalty(aspect->width, aspect->height, screen_width, screen_height);
+        if (score < best_score) {
+            best_score = score;
+            best = aspect;
+        }
+    }
+    for (guint i = start; i-- > 0;) {
+        const CatalogAspect *aspect = &g_array_index(aspects, CatalogAspect, i);
+        double skew = target - aspect->aspect;
+        if (skew >= best_score) break;
+        double score = skew + cover_penalty(aspect->width, aspect->height, screen_width, screen_height);
+        if (score < best_score) {
+            best_score = score;
+            best = aspect;
+        }
+    }
+
+    if (best) {
+        append_members(catalog, best, matches);
+    }
+    return matches;
+}
+
+// One file per directory, so switching directories doesn't throw away the
+// other's scan. The file records its directory; catalog_open() ignores one
+// that describes another.
+char* catalog_get_cache_path(const char *directory) {
+    char *digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, directory, -1);
+    char *file_name = g_strdup_printf("catalog-%.16s.bin", digest);
+    char *path = g_build_filename(g_get_home_dir(), ".dp", "cache", file_name, NULL);
+    g_free(file_name);
+    g_free(digest);
+    return path;
+}
+
+int catalog_is_image_file(const char *filename) {
+    // Get file extension
+    const char *dot = strrchr(filename, '.');
+    if (!dot || dot == filename) return 0;
+
+    // Check if extension matches supported image formats (case insensitive)
+    const char *ext = dot + 1;
+    return (strcasecmp(ext, "jpg") == 0 ||
+            strcasecmp(ext, "jpeg") == 0 ||
+            strcasecmp(ext, "png") == 0 ||
+            strcasecmp(ext, "bmp") == 0 ||
+            strcasecmp(ext, "gif") == 0);
+}
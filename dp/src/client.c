@@ -0,0 +1,187 @@
+/*
+ * dp - command-line client for a running Dpaper
+ *
+ * Copyright 2026 Dpaper Project
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the MIT License.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include "service.h"
+#include "metrics.h"
+#include "ratings.h"
+
+static void print_usage(FILE *out) {
+    fprintf(out,
+            "Usage: dp [COMMAND]\n"
+            "\n"
+            "Without a command, starts dpaper. Commands talk to the running instance:\n"
+            "  next                  Apply the next random wallpaper\n"
+            "  set IMAGE             Set IMAGE on all desktops\n"
+            "  set-desktop N IMAGE   Set IMAGE on desktop N (1 is the first)\n"
+            "  import PATH...        Add images, or the images in directories, to the library\n"
+            "  rate STARS [IMAGE]    Rate IMAGE, or the current wallpaper, 1-5 stars (0 clears)\n"
+            "  stats                 Print call counts and latency percentiles\n");
+}
+
+// The daemon has its own working directory, so send absolute paths
+static char* client_absolute_path(const char *path) {
+    return g_canonicalize_filename(path, NULL);
+}
+
+static int client_fail(GError *error) {
+    if (g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+        g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+        fprintf(stderr, "dp: dpaper is not running\n");
+    } else {
+        fprintf(stderr, "dp: %s\n", error->message);
+    }
+    g_error_free(error);
+    return 1;
+}
+
+static int command_next(void) {
+    GError *error = NULL;
+    GVariant *reply = service_call("Next", NULL, G_VARIANT_TYPE("(s)"), &error);
+    if (!reply) {
+        return client_fail(error);
+    }
+
+    const char *image;
+    g_variant_get(reply, "(&s)", &image);
+    printf("%s\n", image);
+    g_variant_unref(reply);
+    return 0;
+}
+
+static int command_set(int desktop_index, const char *image_path) {
+    char *path = client_absolute_path(image_path);
+    GVariant *parameters = desktop_index < 0
+                           ? g_variant_new("(s)", path)
+                           : g_variant_new("(is)", desktop_index, path);
+    g_free(path);
+
+    GError *error = NULL;
+    GVariant *reply = service_call(desktop_index < 0 ? "Set" : "SetDesktop", parameters, NULL, &error);
+    if (!reply) {
+        return client_fail(error);
+    }
+    g_variant_unref(reply);
+    return 0;
+}
+
+static int command_import(char **paths, int count) {
+    int status = 0;
+
+    for (int i = 0; i < count; i++) {
+        char *path = client_absolute_path(paths[i]);
+        GError *error = NULL;
+        GVariant *reply = service_call("Import", g_variant_new("(s)", path), G_VARIANT_TYPE("(u)"), &error);
+        if (reply) {
+            guint queued;
+            g_variant_get(reply, "(u)", &queued);
+            printf("Importing %u file%s from %s\n", queued, queued == 1 ? "" : "s", path);
+            g_variant_unref(reply);
+        } else {
+            status = client_fail(error);
+        }
+        g_free(path);
+    }
+
+    return status;
+}
+
+static int command_rate(int stars, const char *image_path) {
+    char *path = image_path ? client_absolute_path(image_path) : g_strdup("");
+    GError *error = NULL;
+    GVariant *reply = service_call("Rate", g_variant_new("(su)", path, (guint32)stars), G_VARIANT_TYPE("(s)"), &error);
+    g_free(path);
+    if (!reply) {
+        return client_fail(error);
+    }
+
+    const char *rated;
+    g_variant_get(reply, "(&s)", &rated);
+    printf("%s\n", rated);
+    g_variant_unref(reply);
+    return 0;
+}
+
+static int command_stats(void) {
+    GError *error = NULL;
+    GVariant *stats = service_get_stats(&error);
+    if (!stats) {
+        return client_fail(error);
+    }
+
+    char *text = metrics_format(stats);
+    fputs(text, stdout);
+    g_free(text);
+    g_variant_unref(stats);
+    return 0;
+}
+
+// Whole number in [min, max]
+static gboolean parse_number(const char *text, long min, long max, int *number) {
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < min || value > max) {
+        return FALSE;
+    }
+    *number = (int)value;
+    return TRUE;
+}
+
+// Desktop numbers are 1-based on the command line and 0-based on the bus
+static gboolean parse_desktop(const char *text, int *desktop_index) {
+    if (!parse_number(text, 1, G_MAXINT, desktop_index)) {
+        return FALSE;
+    }
+    (*desktop_index)--;
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    // `dp` on its own is still the short way to start the tray app
+    if (argc < 2) {
+        execlp("dpaper", "dpaper", (char *)NULL);
+        fprintf(stderr, "dp: could not start dpaper: %s\n", g_strerror(errno));
+        return 1;
+    }
+
+    const char *command = argv[1];
+    int desktop_index;
+    int stars;
+
+    if (strcmp(command, "next") == 0 && argc == 2) {
+        return command_next();
+    } else if (strcmp(command, "set") == 0 && argc == 3) {
+        return command_set(-1, argv[2]);
+    } else if (strcmp(command, "set-desktop") == 0 && argc == 4 && parse_desktop(argv[2], &desktop_index)) {
+        return command_set(desktop_index, argv[3]);
+    } else if (strcmp(command, "import") == 0 && argc >= 3) {
+        return command_import(argv + 2, argc - 2);
+    } else if (strcmp(command, "rate") == 0 && (argc == 3 || argc == 4) && parse_number(argv[2], 0, RATINGS_MAX_STARS, &stars)) {
+        return command_rate(stars, argc == 4 ? argv[3] : NULL);
+    } else if (strcmp(command, "stats") == 0 && argc == 2) {
+        return command_stats();
+    } else if (strcmp(command, "help") == 0 || strcmp(command, "--help") == 0 || strcmp(command, "-h") == 0) {
+        print_usage(stdout);
+        return 0;
+    }
+
+    print_usage(stderr);
+    return 2;
+}
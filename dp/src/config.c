@@ -1,4 +1,6 @@
 #include "config.h"
+#include "metrics.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +9,25 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 
+// Nesting allowed when skipping values of unknown keys
+#define CONFIG_MAX_DEPTH 64
+
+// Idle window before changes are written, and the longest a change may wait
+#define CONFIG_SAVE_DELAY_SECONDS 2
+#define CONFIG_SAVE_MAX_DELAY_SECONDS 10
+
+// Read position in the config file
+typedef struct {
+    const char *p;
+    const char *end;
+} JsonCursor;
+
+// Photo list keys from older versions, which saved it; dropped on the next write
+typedef struct {
+    gboolean found;
+    char *photos_file;      // Separate list to delete, relative to the config
+} ConfigLegacy;
+
 // Create new configuration with defaults
 Config* config_new(void) {
     Config *config = g_new0(Config, 1);
@@ -17,7 +38,7 @@ Config* config_new(void) {
 // Set default configuration values
 void config_set_defaults(Config *config) {
     // Default wallpaper directory
-    config->wallpaper_directory = g_strdup(g_build_filename(g_get_home_dir(), ".dp", NULL));
+    config->wallpaper_directory = g_build_filename(g_get_home_dir(), ".dp", NULL);
 
     // Supported formats
     config->supported_formats = g_ptr_array_new_with_free_func(g_free);
@@ -27,12 +48,18 @@ void config_set_defaults(Config *config) {
     g_ptr_array_add(config->supported_formats, g_strdup("bmp"));
     g_ptr_array_add(config->supported_formats, g_strdup("gif"));
 
-    // Installed photos
+    // Installed photos, with filename -> array index + 1 for O(1) lookups.
+    // Rebuilt from the library catalog at startup, so never saved.
     config->installed_photos = g_ptr_array_new_with_free_func(g_free);
+    config->photo_index = g_hash_table_new(g_str_hash, g_str_equal);
 
     // Auto-rotate settings
     config->auto_rotate_interval = 300; // 5 minutes
     config->auto_rotate_enabled = FALSE;
+    config->pause_on_battery_below = 20;
+
+    // Random picks go through a shuffle bag
+    config->rotation_policy = SELECTOR_MODE_SHUFFLE;
 
     // Desktop settings
     config->last_desktop_index = 0;
@@ -45,14 +72,31 @@ void config_set_defaults(Config *config) {
     config->boot_screen_image = NULL; // NULL means random
 }
 
+// Release everything config_set_defaults() allocated
+static void config_clear(Config *config) {
+    if (config->save_source_id != 0) {
+        g_source_remove(config->save_source_id);
+    }
+    g_free(config->wallpaper_directory);
+    g_free(config->boot_screen_image);
+    g_free(config->path);
+    if (config->supported_formats) {
+        g_ptr_array_free(config->supported_formats, TRUE);
+    }
+    if (config->photo_index) {
+        g_hash_table_destroy(config->photo_index);
+    }
+    if (config->installed_photos) {
+        g_ptr_array_free(config->installed_photos, TRUE);
+    }
+    memset(config, 0, sizeof(*config));
+}
+
 // Free configuration memory
 void config_free(Config *config) {
     if (!config) return;
 
-    g_free(config->wallpaper_directory);
-    g_free(config->boot_screen_image);
-    g_ptr_array_free(config->supported_formats, TRUE);
-    g_ptr_array_free(config->installed_photos, TRUE);
+    config_clear(config);
     g_free(config);
 }
 
@@ -68,112 +112,380 @@ void config_ensure_directory(const char *path) {
     g_free(dir);
 }
 
+static void json_skip_whitespace(JsonCursor *cursor) {
+    while (cursor->p < cursor->end &&
+           (*cursor->p == ' ' || *cursor->p == '\t' || *cursor->p == '\n' || *cursor->p == '\r')) {
+        cursor->p++;
+    }
+}
+
+// Consume an expected punctuation character
+static gboolean json_expect(JsonCursor *cursor, char c) {
+    json_skip_whitespace(cursor);
+    if (cursor->p < cursor->end && *cursor->p == c) {
+        cursor->p++;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean json_match_literal(JsonCursor *cursor, const char *literal) {
+    gsize length = strlen(literal);
+    if ((gsize)(cursor->end - cursor->p) >= length && memcmp(cursor->p, literal, length) == 0) {
+        cursor->p += length;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static int json_hex_digit(char c) {
+    return g_ascii_xdigit_value(c);
+}
+
+static gboolean json_parse_hex4(JsonCursor *cursor, gunichar *value) {
+    if (cursor->end - cursor->p < 4) return FALSE;
+
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = json_hex_digit(cursor->p[i]);
+        if (digit < 0) return FALSE;
+        *value = (*value << 4) | (gunichar)digit;
+    }
+    cursor->p += 4;
+    return TRUE;
+}
+
+// Parse a string into out (reset first). Runs without escapes are copied in one go.
+static gboolean json_parse_string(JsonCursor *cursor, GString *out) {
+    json_skip_whitespace(cursor);
+    if (cursor->p >= cursor->end || *cursor->p != '"') return FALSE;
+    cursor->p++;
+
+    g_string_truncate(out, 0);
+    for (;;) {
+        const char *run = cursor->p;
+        while (cursor->p < cursor->end && *cursor->p != '"' && *cursor->p != '\\') {
+            cursor->p++;
+        }
+        g_string_append_len(out, run, cursor->p - run);
+
+        if (cursor->p >= cursor->end) return FALSE;
+        if (*cursor->p == '"') {
+            cursor->p++;
+            return TRUE;
+        }
+
+        // Escape sequence
+        cursor->p++;
+        if (cursor->p >= cursor->end) return FALSE;
+        char escape = *cursor->p++;
+        switch (escape) {
+            case '"':  g_string_append_c(out, '"'); break;
+            case '\\': g_string_append_c(out, '\\'); break;
+            case '/':  g_string_append_c(out, '/'); break;
+            case 'b':  g_string_append_c(out, '\b'); break;
+            case 'f':  g_string_append_c(out, '\f'); break;
+            case 'n':  g_string_append_c(out, '\n'); break;
+            case 'r':  g_string_append_c(out, '\r'); break;
+            case 't':  g_string_append_c(out, '\t'); break;
+            case 'u': {
+                gunichar c;
+                if (!json_parse_hex4(cursor, &c)) return FALSE;
+
+                // Combine a UTF-16 surrogate pair
+                if (c >= 0xD800 && c <= 0xDBFF && json_match_literal(cursor, "\\u")) {
+                    gunichar low;
+                    if (!json_parse_hex4(cursor, &low) || low < 0xDC00 || low > 0xDFFF) return FALSE;
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                }
+                g_string_append_unichar(out, c);
+                break;
+            }
+            default:
+                return FALSE;
+        }
+    }
+}
+
+static gboolean json_parse_int(JsonCursor *cursor, int *value) {
+    json_skip_whitespace(cursor);
+
+    const char *start = cursor->p;
+    if (cursor->p < cursor->end && *cursor->p == '-') cursor->p++;
+    while (cursor->p < cursor->end && g_ascii_isdigit(*cursor->p)) cursor->p++;
+    if (cursor->p == start) return FALSE;
+
+    char buffer[32];
+    gsize length = MIN((gsize)(cursor->p - start), sizeof(buffer) - 1);
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    *value = (int)g_ascii_strtoll(buffer, NULL, 10);
+    return TRUE;
+}
+
+static gboolean json_parse_bool(JsonCursor *cursor, gboolean *value) {
+    json_skip_whitespace(cursor);
+    if (json_match_literal(cursor, "true")) {
+        *value = TRUE;
+        return TRUE;
+    }
+    if (json_match_literal(cursor, "false")) {
+        *value = FALSE;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Skip any value, for keys this version doesn't know
+static gboolean json_skip_value(JsonCursor *cursor, GString *scratch, int depth) {
+    if (depth > CONFIG_MAX_DEPTH) return FALSE;
+
+    json_skip_whitespace(cursor);
+    if (cursor->p >= cursor->end) return FALSE;
+
+    switch (*cursor->p) {
+        case '"':
+            return json_parse_string(cursor, scratch);
+        case '{':
+        case '[': {
+            char close = (*cursor->p == '{') ? '}' : ']';
+            gboolean is_object = (close == '}');
+            cursor->p++;
+            if (json_expect(cursor, close)) return TRUE;
+            do {
+                if (is_object && (!json_parse_string(cursor, scratch) || !json_expect(cursor, ':'))) {
+                    return FALSE;
+                }
+                if (!json_skip_value(cursor, scratch, depth + 1)) return FALSE;
+            } while (json_expect(cursor, ','));
+            return json_expect(cursor, close);
+        }
+        default:
+            if (json_match_literal(cursor, "null") || json_match_literal(cursor, "true") ||
+                json_match_literal(cursor, "false")) {
+                return TRUE;
+            }
+            // Number
+            {
+                const char *start = cursor->p;
+                while (cursor->p < cursor->end && strchr("+-0123456789.eE", *cursor->p)) cursor->p++;
+                return cursor->p != start;
+            }
+    }
+}
+
+// Parse an array of strings, calling add for each element
+static gboolean json_parse_string_array(JsonCursor *cursor, GString *scratch,
+                                        void (*add)(Config *, const char *), Config *config) {
+    if (!json_expect(cursor, '[')) return FALSE;
+    if (json_expect(cursor, ']')) return TRUE;
+
+    do {
+        if (!json_parse_string(cursor, scratch)) return FALSE;
+        add(config, scratch->str);
+    } while (json_expect(cursor, ','));
+
+    return json_expect(cursor, ']');
+}
+
+static void config_add_format(Config *config, const char *format) {
+    g_ptr_array_add(config->supported_formats, g_strdup(format));
+}
+
+// Parse the value for one top-level key into the config
+static gboolean config_parse_member(JsonCursor *cursor, const char *key, GString *scratch, Config *config,
+                                    ConfigLegacy *legacy) {
+    if (strcmp(key, "wallpaper_directory") == 0) {
+        if (!json_parse_string(cursor, scratch)) return FALSE;
+        g_free(config->wallpaper_directory);
+        config->wallpaper_directory = g_strdup(scratch->str);
+    } else if (strcmp(key, "supported_formats") == 0) {
+        g_ptr_array_set_size(config->supported_formats, 0);
+        return json_parse_string_array(cursor, scratch, config_add_format, config);
+    } else if (strcmp(key, "installed_photos") == 0) {
+        legacy->found = TRUE;
+        return json_skip_value(cursor, scratch, 0);
+    } else if (strcmp(key, "auto_rotate_interval") == 0) {
+        return json_parse_int(cursor, &config->auto_rotate_interval);
+    } else if (strcmp(key, "auto_rotate_enabled") == 0) {
+        return json_parse_bool(cursor, &config->auto_rotate_enabled);
+    } else if (strcmp(key, "pause_on_battery_below") == 0) {
+        return json_parse_int(cursor, &config->pause_on_battery_below);
+    } else if (strcmp(key, "rotation") == 0) {
+        if (!json_parse_string(cursor, scratch)) return FALSE;
+        // Unknown policies keep the current one
+        selector_mode_from_name(scratch->str, &config->rotation_policy);
+    } else if (strcmp(key, "shuffle") == 0) {
+        // Older configs only had a shuffle switch
+        gboolean shuffle;
+        if (!json_parse_bool(cursor, &shuffle)) return FALSE;
+        config->rotation_policy = shuffle ? SELECTOR_MODE_SHUFFLE : SELECTOR_MODE_RANDOM;
+    } else if (strcmp(key, "use_default_wallpapers") == 0) {
+        return json_parse_bool(cursor, &config->use_default_wallpapers);
+    } else if (strcmp(key, "boot_screen_enabled") == 0) {
+        return json_parse_bool(cursor, &config->boot_screen_enabled);
+    } else if (strcmp(key, "boot_screen_image") == 0) {
+        json_skip_whitespace(cursor);
+        g_free(config->boot_screen_image);
+        config->boot_screen_image = NULL;
+        if (json_match_literal(cursor, "null")) return TRUE;
+        if (!json_parse_string(cursor, scratch)) return FALSE;
+        // Empty means random
+        if (scratch->len > 0) {
+            config->boot_screen_image = g_strdup(scratch->str);
+        }
+    } else if (strcmp(key, "photos_file") == 0) {
+        if (!json_parse_string(cursor, scratch)) return FALSE;
+        legacy->found = TRUE;
+        g_free(legacy->photos_file);
+        legacy->photos_file = scratch->len > 0 ? g_strdup(scratch->str) : NULL;
+    } else if (strcmp(key, "last_desktop_index") == 0) {
+        return json_parse_int(cursor, &config->last_desktop_index);
+    } else {
+        return json_skip_value(cursor, scratch, 0);
+    }
+    return TRUE;
+}
+
+// Parse a whole config document in one pass
+static gboolean config_parse(Config *config, const char *contents, gsize length, ConfigLegacy *legacy) {
+    JsonCursor cursor = { contents, contents + length };
+    GString *key = g_string_sized_new(64);
+    GString *scratch = g_string_sized_new(256);
+    gboolean success = FALSE;
+
+    if (!json_expect(&cursor, '{')) goto out;
+    if (json_expect(&cursor, '}')) {
+        success = TRUE;
+        goto out;
+    }
+
+    do {
+        if (!json_parse_string(&cursor, key) || !json_expect(&cursor, ':')) goto out;
+        if (!config_parse_member(&cursor, key->str, scratch, config, legacy)) goto out;
+    } while (json_expect(&cursor, ','));
+
+    success = json_expect(&cursor, '}');
+
+out:
+    g_string_free(key, TRUE);
+    g_string_free(scratch, TRUE);
+    return success;
+}
+
+// Delete the photo list an older version kept next to the config
+static void config_remove_legacy_photos(const char *filename, const char *photos_file) {
+    char *path;
+    if (g_path_is_absolute(photos_file)) {
+        path = g_strdup(photos_file);
+    } else {
+        char *directory = g_path_get_dirname(filename);
+        path = g_build_filename(directory, photos_file, NULL);
+        g_free(directory);
+    }
+    if (g_unlink(path) == 0) {
+        log_info("Removed %s; the photo list now comes from the library catalog", path);
+    }
+    g_free(path);
+}
+
 // Load configuration from JSON file
-gboolean config_load(Config *config, const char *filename) {
+static gboolean config_read(Config *config, const char *filename) {
+    // Start from defaults; keys missing from the file keep them
+    config_clear(config);
+    config_set_defaults(config);
+
     if (!g_file_test(filename, G_FILE_TEST_EXISTS)) {
         // File doesn't exist, use defaults
-        config_set_defaults(config);
+        config->path = g_strdup(filename);
         return TRUE;
     }
 
     GError *error = NULL;
     char *contents = NULL;
+    gsize length = 0;
 
-    if (!g_file_get_contents(filename, &contents, NULL, &error)) {
-        g_warning("Failed to load config file %s: %s", filename, error->message);
+    if (!g_file_get_contents(filename, &contents, &length, &error)) {
+        log_warning("Failed to load config file %s: %s", filename, error->message);
         g_error_free(error);
-        config_set_defaults(config);
+        config->path = g_strdup(filename);
         return FALSE;
     }
 
-    // Parse basic JSON fields manually (simple implementation)
-    config_set_defaults(config);
+    ConfigLegacy legacy = { FALSE, NULL };
+    gboolean success = config_parse(config, contents, length, &legacy);
+    g_free(contents);
 
-    // Parse auto_rotate_interval
-    char *interval_line = g_strstr_len(contents, -1, "auto_rotate_interval");
-    if (interval_line) {
-        int interval = 0;
-        if (sscanf(interval_line, "auto_rotate_interval%*[^0-9]%d", &interval) == 1) {
-            config->auto_rotate_interval = interval;
-        }
+    if (!success) {
+        log_warning("Failed to parse config file %s, using defaults", filename);
+        config_clear(config);
+        config_set_defaults(config);
+    } else if (legacy.photos_file) {
+        config_remove_legacy_photos(filename, legacy.photos_file);
     }
+    g_free(legacy.photos_file);
 
-    // Parse auto_rotate_enabled (boolean)
-    if (g_strstr_len(contents, -1, "\"auto_rotate_enabled\": true")) {
-        config->auto_rotate_enabled = TRUE;
-    } else if (g_strstr_len(contents, -1, "\"auto_rotate_enabled\": false")) {
-        config->auto_rotate_enabled = FALSE;
+    // Loading itself isn't a change, but an older config sheds its photo list
+    config->path = g_strdup(filename);
+    config->dirty = 0;
+    if (success && legacy.found) {
+        config_mark_dirty(config, CONFIG_DIRTY_SETTINGS);
     }
+    return success;
+}
 
-    // Parse use_default_wallpapers (boolean)
-    if (g_strstr_len(contents, -1, "\"use_default_wallpapers\": false")) {
-        config->use_default_wallpapers = FALSE;
-    } else {
-        config->use_default_wallpapers = TRUE;
-    }
-
-    // Parse boot_screen_enabled (boolean)
-    if (g_strstr_len(contents, -1, "\"boot_screen_enabled\": true")) {
-        config->boot_screen_enabled = TRUE;
-    } else if (g_strstr_len(contents, -1, "\"boot_screen_enabled\": false")) {
-        config->boot_screen_enabled = FALSE;
-    }
-
-    // Parse boot_screen_image
-    char *boot_img_start = g_strstr_len(contents, -1, "\"boot_screen_image\": \"");
-    if (boot_img_start) {
-        boot_img_start += strlen("\"boot_screen_image\": \"");
-        char *boot_img_end = g_strstr_len(boot_img_start, -1, "\"");
-        if (boot_img_end) {
-            gsize boot_img_len = boot_img_end - boot_img_start;
-            char *boot_image = g_strndup(boot_img_start, boot_img_len);
-            g_free(config->boot_screen_image);
-            config->boot_screen_image = boot_image;
+// Append a JSON string literal; runs that need no escaping are copied in one go
+static void json_append_string(GString *json, const char *value) {
+    g_string_append_c(json, '"');
+    const char *p = value;
+    for (;;) {
+        const char *run = p;
+        while ((unsigned char)*p >= 0x20 && *p != '"' && *p != '\\') {
+            p++;
         }
-    }
-
-    // Parse wallpaper_directory
-    char *dir_start = g_strstr_len(contents, -1, "\"wallpaper_directory\": \"");
-    if (dir_start) {
-        dir_start += strlen("\"wallpaper_directory\": \"");
-        char *dir_end = g_strstr_len(dir_start, -1, "\"");
-        if (dir_end) {
-            gsize dir_len = dir_end - dir_start;
-            char *directory = g_strndup(dir_start, dir_len);
-            g_free(config->wallpaper_directory);
-            config->wallpaper_directory = directory;
+        g_string_append_len(json, run, p - run);
+        if (*p == '\0') break;
+
+        unsigned char c = (unsigned char)*p++;
+        switch (c) {
+            case '"':  g_string_append(json, "\\\""); break;
+            case '\\': g_string_append(json, "\\\\"); break;
+            case '\n': g_string_append(json, "\\n"); break;
+            case '\r': g_string_append(json, "\\r"); break;
+            case '\t': g_string_append(json, "\\t"); break;
+            default:   g_string_append_printf(json, "\\u%04x", c); break;
         }
     }
-
-    g_free(contents);
-    return TRUE;
+    g_string_append_c(json, '"');
 }
 
-// Save configuration to JSON file
-gboolean config_save(const Config *config, const char *filename) {
-    config_ensure_directory(filename);
+// Replace a file atomically: temp file, fsync, rename
+static gboolean config_write_file(const char *path, const GString *contents) {
+    GError *error = NULL;
+    gboolean success = g_file_set_contents_full(path, contents->str, contents->len,
+                                                G_FILE_SET_CONTENTS_CONSISTENT | G_FILE_SET_CONTENTS_DURABLE,
+                                                0644, &error);
+    if (!success) {
+        log_warning("Failed to save %s: %s", path, error->message);
+        g_error_free(error);
+    }
+    return success;
+}
 
-    GString *json = g_string_new("{\n");
+static gboolean config_write_settings(const Config *config, const char *filename) {
+    GString *json = g_string_sized_new(1024);
+    g_string_append(json, "{\n");
 
     // Wallpaper directory
-    g_string_append_printf(json, "  \"wallpaper_directory\": \"%s\",\n",
-                          config->wallpaper_directory);
+    g_string_append(json, "  \"wallpaper_directory\": ");
+    json_append_string(json, config->wallpaper_directory);
+    g_string_append(json, ",\n");
 
     // Supported formats
     g_string_append(json, "  \"supported_formats\": [");
     for (guint i = 0; i < config->supported_formats->len; i++) {
         if (i > 0) g_string_append(json, ", ");
-        g_string_append_printf(json, "\"%s\"",
-                              (char*)g_ptr_array_index(config->supported_formats, i));
-    }
-    g_string_append(json, "],\n");
-
-    // Installed photos
-    g_string_append(json, "  \"installed_photos\": [");
-    for (guint i = 0; i < config->installed_photos->len; i++) {
-        if (i > 0) g_string_append(json, ", ");
-        g_string_append_printf(json, "\"%s\"",
-                              (char*)g_ptr_array_index(config->installed_photos, i));
+        json_append_string(json, g_ptr_array_index(config->supported_formats, i));
     }
     g_string_append(json, "],\n");
 
@@ -182,6 +494,11 @@ gboolean config_save(const Config *config, const char *filename) {
                           config->auto_rotate_interval);
     g_string_append_printf(json, "  \"auto_rotate_enabled\": %s,\n",
                           config->auto_rotate_enabled ? "true" : "false");
+    g_string_append_printf(json, "  \"pause_on_battery_below\": %d,\n",
+                          config->pause_on_battery_below);
+    g_string_append(json, "  \"rotation\": ");
+    json_append_string(json, selector_mode_get_name(config->rotation_policy));
+    g_string_append(json, ",\n");
 
     // Default wallpapers setting
     g_string_append_printf(json, "  \"use_default_wallpapers\": %s,\n",
@@ -190,8 +507,9 @@ gboolean config_save(const Config *config, const char *filename) {
     // Boot screen settings
     g_string_append_printf(json, "  \"boot_screen_enabled\": %s,\n",
                           config->boot_screen_enabled ? "true" : "false");
-    g_string_append_printf(json, "  \"boot_screen_image\": \"%s\",\n",
-                          config->boot_screen_image ? config->boot_screen_image : "");
+    g_string_append(json, "  \"boot_screen_image\": ");
+    json_append_string(json, config->boot_screen_image ? config->boot_screen_image : "");
+    g_string_append(json, ",\n");
 
     // Last desktop index
     g_string_append_printf(json, "  \"last_desktop_index\": %d\n",
@@ -199,43 +517,122 @@ gboolean config_save(const Config *config, const char *filename) {
 
     g_string_append(json, "}\n");
 
-    GError *error = NULL;
-    gboolean success = g_file_set_contents(filename, json->str, -1, &error);
+    gboolean success = config_write_file(filename, json);
+    g_string_free(json, TRUE);
+    return success;
+}
 
+// Save configuration to JSON file
+static gboolean config_write(const Config *config, const char *filename) {
+    config_ensure_directory(filename);
+    return config_write_settings(config, filename);
+}
+
+static void config_record(MetricId id, gint64 start_time, gboolean success) {
+    metrics_record_since(id, start_time);
     if (!success) {
-        g_warning("Failed to save config file %s: %s", filename, error->message);
-        g_error_free(error);
+        metrics_add_error(id);
     }
+}
 
-    g_string_free(json, TRUE);
+gboolean config_load(Config *config, const char *filename) {
+    gint64 start_time = g_get_monotonic_time();
+    gboolean success = config_read(config, filename);
+    config_record(METRIC_CONFIG_LOAD, start_time, success);
+    return success;
+}
+
+gboolean config_save(const Config *config, const char *filename) {
+    gint64 start_time = g_get_monotonic_time();
+    gboolean success = config_write(config, filename);
+    config_record(METRIC_CONFIG_SAVE, start_time, success);
     return success;
 }
 
-// Photo management functions
+static gboolean config_save_timeout(gpointer data) {
+    Config *config = data;
+    config->save_source_id = 0;
+    config_flush(config);
+    return G_SOURCE_REMOVE;
+}
+
+void config_mark_dirty(Config *config, guint flags) {
+    gint64 now = g_get_monotonic_time();
+    if (config->dirty == 0) {
+        config->dirty_since = now;
+    }
+    config->dirty |= flags;
+
+    // Not loaded yet, so there is nowhere to flush to
+    if (!config->path) return;
+
+    // Each change restarts the idle window, unless the oldest one has waited long enough
+    if (config->save_source_id != 0) {
+        if (now - config->dirty_since >= (gint64)CONFIG_SAVE_MAX_DELAY_SECONDS * G_USEC_PER_SEC) {
+            return;
+        }
+        g_source_remove(config->save_source_id);
+    }
+    config->save_source_id = g_timeout_add_seconds(CONFIG_SAVE_DELAY_SECONDS, config_save_timeout, config);
+}
+
+// Write whatever changed since the last flush
+gboolean config_flush(Config *config) {
+    if (config->save_source_id != 0) {
+        g_source_remove(config->save_source_id);
+        config->save_source_id = 0;
+    }
+    if (config->dirty == 0 || !config->path) {
+        return TRUE;
+    }
+
+    gint64 start_time = g_get_monotonic_time();
+    gboolean success = config_write(config, config->path);
+
+    // On failure the changes stay dirty for the next attempt
+    if (success) {
+        config->dirty = 0;
+    }
+    config_record(METRIC_CONFIG_SAVE, start_time, success);
+    return success;
+}
+
+// Photo management functions. The list mirrors the library catalog and
+// isn't saved, so changing it doesn't make the config dirty.
 void config_add_photo(Config *config, const char *filename) {
     if (!config_has_photo(config, filename)) {
-        g_ptr_array_add(config->installed_photos, g_strdup(filename));
+        char *photo = g_strdup(filename);
+        g_ptr_array_add(config->installed_photos, photo);
+        g_hash_table_insert(config->photo_index, photo, GUINT_TO_POINTER(config->installed_photos->len));
     }
 }
 
+// Swaps the last photo into the removed slot, so the list order isn't kept
 void config_remove_photo(Config *config, const char *filename) {
-    for (guint i = 0; i < config->installed_photos->len; i++) {
-        const char *photo = (const char*)g_ptr_array_index(config->installed_photos, i);
-        if (g_strcmp0(photo, filename) == 0) {
-            g_ptr_array_remove_index(config->installed_photos, i);
-            break;
-        }
+    gpointer value;
+    if (!g_hash_table_lookup_extended(config->photo_index, filename, NULL, &value)) {
+        return;
     }
+
+    guint i = GPOINTER_TO_UINT(value) - 1;
+    guint last = config->installed_photos->len - 1;
+    g_hash_table_remove(config->photo_index, filename);
+    if (i != last) {
+        g_hash_table_insert(config->photo_index, g_ptr_array_index(config->installed_photos, last),
+                            GUINT_TO_POINTER(i + 1));
+    }
+    g_ptr_array_remove_index_fast(config->installed_photos, i);
+}
+
+void config_clear_photos(Config *config) {
+    if (config->installed_photos->len == 0) return;
+
+    g_hash_table_remove_all(config->photo_index);
+    g_ptr_array_set_size(config->installed_photos, 0);
 }
 
 gboolean config_has_photo(const Config *config, const char *filename) {
-    for (guint i = 0; i < config->installed_photos->len; i++) {
-        const char *photo = (const char*)g_ptr_array_index(config->installed_photos, i);
-        if (g_strcmp0(photo, filename) == 0) {
-            return TRUE;
-        }
-    }
-    return FALSE;
+    return g_hash_table_contains(config->photo_index, filename);
 }
 
 GPtrArray* config_get_photos(const Config *config) {
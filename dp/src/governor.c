@@ -0,0 +1,389 @@
+#include "governor.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOGIND_NAME              "org.freedesktop.login1"
+#define LOGIND_PATH              "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define LOGIND_SESSION_INTERFACE "org.freedesktop.login1.Session"
+#define UPOWER_NAME              "org.freedesktop.UPower"
+#define UPOWER_PATH              "/org/freedesktop/UPower"
+#define UPOWER_INTERFACE         "org.freedesktop.UPower"
+#define UPOWER_DISPLAY_PATH      "/org/freedesktop/UPower/devices/DisplayDevice"
+#define UPOWER_DEVICE_INTERFACE  "org.freedesktop.UPower.Device"
+#define PROPERTIES_INTERFACE     "org.freedesktop.DBus.Properties"
+
+// Default battery percentage below which rotation pauses
+#define GOVERNOR_BATTERY_THRESHOLD 20
+
+enum {
+    SUBSCRIPTION_SLEEP,
+    SUBSCRIPTION_UPOWER,
+    SUBSCRIPTION_DISPLAY,
+    SUBSCRIPTION_SESSION,
+    SUBSCRIPTION_COUNT
+};
+
+struct _Governor {
+    GovernorHandlers handlers;
+    GDBusConnection *connection;
+    GCancellable *cancellable;      // Pending bus calls
+    guint subscriptions[SUBSCRIPTION_COUNT];
+    char *session_path;
+
+    // Last reported state
+    gboolean locked;
+    gboolean idle;
+    gboolean sleeping;
+    gboolean on_battery;
+    double battery_percentage;      // < 0 until known
+    int battery_threshold;
+    guint reasons;                  // GovernorPause flags
+
+    gboolean running;
+    guint interval;                 // Seconds
+    gint64 next_due;                // Wall-clock time of the next rotation, µs
+    guint timer_id;
+};
+
+static gboolean governor_tick(gpointer data);
+
+static guint governor_compute_reasons(const Governor *governor) {
+    guint reasons = 0;
+    if (governor->locked) reasons |= GOVERNOR_PAUSE_LOCKED;
+    if (governor->idle) reasons |= GOVERNOR_PAUSE_IDLE;
+    if (governor->sleeping) reasons |= GOVERNOR_PAUSE_SLEEP;
+    if (governor->on_battery && governor->battery_percentage >= 0 &&
+        governor->battery_percentage < governor->battery_threshold) {
+        reasons |= GOVERNOR_PAUSE_BATTERY;
+    }
+    return reasons;
+}
+
+static void governor_disarm(Governor *governor) {
+    if (governor->timer_id != 0) {
+        g_source_remove(governor->timer_id);
+        governor->timer_id = 0;
+    }
+}
+
+// Sleep until the next rotation is due. Due times are wall-clock, so time
+// spent suspended counts; a clock set back can't push one past an interval.
+static void governor_arm(Governor *governor) {
+    if (!governor->running || governor->reasons != 0 || governor->timer_id != 0) {
+        return;
+    }
+
+    gint64 now = g_get_real_time();
+    gint64 interval = (gint64)governor->interval * G_USEC_PER_SEC;
+    if (governor->next_due > now + interval) {
+        governor->next_due = now + interval;
+    }
+    gint64 delay = (governor->next_due - now + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+    delay = CLAMP(delay, 1, (gint64)governor->interval);
+    governor->timer_id = g_timeout_add_seconds((guint)delay, governor_tick, governor);
+}
+
+static void governor_rotate(Governor *governor) {
+    governor->next_due = g_get_real_time() + (gint64)governor->interval * G_USEC_PER_SEC;
+    governor_arm(governor);
+    if (governor->handlers.rotate) {
+        governor->handlers.rotate();
+    }
+}
+
+static gboolean governor_tick(gpointer data) {
+    Governor *governor = data;
+    governor->timer_id = 0;
+
+    // Coalesced timeouts may fire a little early
+    if (g_get_real_time() + G_USEC_PER_SEC / 2 < governor->next_due) {
+        governor_arm(governor);
+    } else {
+        governor_rotate(governor);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static char* describe_reasons(guint reasons) {
+    GString *text = g_string_new(NULL);
+    static const struct {
+        guint flag;
+        const char *name;
+    } names[] = {
+        { GOVERNOR_PAUSE_LOCKED, "locked" },
+        { GOVERNOR_PAUSE_IDLE, "idle" },
+        { GOVERNOR_PAUSE_SLEEP, "sleeping" },
+        { GOVERNOR_PAUSE_BATTERY, "low battery" }
+    };
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+        if (reasons & names[i].flag) {
+            g_string_append_printf(text, "%s%s", text->len ? ", " : "", names[i].name);
+        }
+    }
+    return g_string_free(text, FALSE);
+}
+
+// Pause or resume after a state change; a rotation missed while paused
+// happens now
+static void governor_update(Governor *governor) {
+    guint reasons = governor_compute_reasons(governor);
+    if (reasons == governor->reasons) return;
+
+    guint previous = governor->reasons;
+    governor->reasons = reasons;
+    if (reasons != 0) {
+        governor_disarm(governor);
+        if (previous == 0 && governor->running) {
+            char *text = describe_reasons(reasons);
+            log_info("Auto-rotate paused (%s)", text);
+            g_free(text);
+        }
+        return;
+    }
+
+    if (!governor->running) return;
+    log_info("Auto-rotate resumed");
+    if (g_get_real_time() >= governor->next_due) {
+        governor_rotate(governor);
+    } else {
+        governor_arm(governor);
+    }
+}
+
+// Properties from GetAll replies and PropertiesChanged signals
+static void governor_apply_properties(Governor *governor, const char *interface, GVariant *properties) {
+    GVariantIter iter;
+    const char *name;
+    GVariant *value;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_loop(&iter, "{&sv}", &name, &value)) {
+        if (strcmp(interface, LOGIND_SESSION_INTERFACE) == 0) {
+            if (strcmp(name, "LockedHint") == 0 && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+                governor->locked = g_variant_get_boolean(value);
+            } else if (strcmp(name, "IdleHint") == 0 && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+                governor->idle = g_variant_get_boolean(value);
+            }
+        } else if (strcmp(interface, UPOWER_INTERFACE) == 0) {
+            if (strcmp(name, "OnBattery") == 0 && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+                governor->on_battery = g_variant_get_boolean(value);
+            }
+        } else if (strcmp(interface, UPOWER_DEVICE_INTERFACE) == 0) {
+            if (strcmp(name, "Percentage") == 0 && g_variant_is_of_type(value, G_VARIANT_TYPE_DOUBLE)) {
+                governor->battery_percentage = g_variant_get_double(value);
+            }
+        }
+    }
+    governor_update(governor);
+}
+
+static void on_get_all(GObject *source, GAsyncResult *result, gpointer data) {
+    char *interface = data;
+    GError *error = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+    if (!reply) {
+        // A missing service (no UPower on a desktop) just never pauses
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            log_debug("Governor: no %s properties: %s", interface, error->message);
+        }
+        g_error_free(error);
+        g_free(interface);
+        return;
+    }
+
+    Governor *governor = g_object_get_data(source, "dp-governor");
+    if (governor) {
+        GVariant *properties = g_variant_get_child_value(reply, 0);
+        governor_apply_properties(governor, interface, properties);
+        g_variant_unref(properties);
+    }
+    g_variant_unref(reply);
+    g_free(interface);
+}
+
+static void governor_fetch(Governor *governor, const char *name, const char *path, const char *interface) {
+    g_dbus_connection_call(governor->connection, name, path, PROPERTIES_INTERFACE, "GetAll",
+                           g_variant_new("(s)", interface), G_VARIANT_TYPE("(a{sv})"),
+                           G_DBUS_CALL_FLAGS_NONE, -1, governor->cancellable, on_get_all, g_strdup(interface));
+}
+
+static void on_properties_changed(GDBusConnection *connection, const char *sender, const char *path,
+                                  const char *interface, const char *signal, GVariant *parameters,
+                                  gpointer data) {
+    (void)connection;
+    (void)sender;
+    (void)interface;
+    (void)signal;
+    Governor *governor = data;
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sa{sv}as)"))) return;
+
+    const char *changed_interface;
+    GVariant *changed;
+    GVariant *invalidated;
+    g_variant_get(parameters, "(&s@a{sv}@as)", &changed_interface, &changed, &invalidated);
+    governor_apply_properties(governor, changed_interface, changed);
+
+    // Properties announced without their values are fetched
+    if (g_variant_n_children(invalidated) > 0) {
+        const char *name = g_str_has_prefix(changed_interface, UPOWER_INTERFACE) ? UPOWER_NAME : LOGIND_NAME;
+        governor_fetch(governor, name, path, changed_interface);
+    }
+    g_variant_unref(changed);
+    g_variant_unref(invalidated);
+}
+
+static void on_prepare_for_sleep(GDBusConnection *connection, const char *sender, const char *path,
+                                 const char *interface, const char *signal, GVariant *parameters,
+                                 gpointer data) {
+    (void)connection;
+    (void)sender;
+    (void)path;
+    (void)interface;
+    (void)signal;
+    Governor *governor = data;
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)"))) return;
+
+    gboolean sleeping;
+    g_variant_get(parameters, "(b)", &sleeping);
+    governor->sleeping = sleeping;
+    governor_update(governor);
+    if (!sleeping && governor->handlers.woke) {
+        governor->handlers.woke();
+    }
+}
+
+static void on_session_found(GObject *source, GAsyncResult *result, gpointer data) {
+    (void)data;
+    GError *error = NULL;
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), result, &error);
+    if (!reply) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            log_info("Governor: no login session to follow: %s", error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    Governor *governor = g_object_get_data(source, "dp-governor");
+    if (governor) {
+        g_variant_get(reply, "(o)", &governor->session_path);
+        governor->subscriptions[SUBSCRIPTION_SESSION] =
+            g_dbus_connection_signal_subscribe(governor->connection, LOGIND_NAME, PROPERTIES_INTERFACE,
+                                               "PropertiesChanged", governor->session_path,
+                                               LOGIND_SESSION_INTERFACE, G_DBUS_SIGNAL_FLAGS_NONE,
+                                               on_properties_changed, governor, NULL);
+        governor_fetch(governor, LOGIND_NAME, governor->session_path, LOGIND_SESSION_INTERFACE);
+    }
+    g_variant_unref(reply);
+}
+
+// Drop the connection and everything pending on it
+static void governor_unwatch(Governor *governor) {
+    if (!governor->connection) return;
+
+    g_cancellable_cancel(governor->cancellable);
+    g_clear_object(&governor->cancellable);
+    for (int i = 0; i < SUBSCRIPTION_COUNT; i++) {
+        if (governor->subscriptions[i] != 0) {
+            g_dbus_connection_signal_unsubscribe(governor->connection, governor->subscriptions[i]);
+            governor->subscriptions[i] = 0;
+        }
+    }
+    g_object_set_data(G_OBJECT(governor->connection), "dp-governor", NULL);
+    g_clear_object(&governor->connection);
+    g_free(governor->session_path);
+    governor->session_path = NULL;
+}
+
+Governor* governor_new(const GovernorHandlers *handlers) {
+    Governor *governor = g_new0(Governor, 1);
+    governor->handlers = *handlers;
+    governor->battery_percentage = -1;
+    governor->battery_threshold = GOVERNOR_BATTERY_THRESHOLD;
+    governor->interval = 1;
+    return governor;
+}
+
+void governor_free(Governor *governor) {
+    if (!governor) return;
+
+    governor_disarm(governor);
+    governor_unwatch(governor);
+    g_free(governor);
+}
+
+void governor_watch(Governor *governor, GDBusConnection *connection) {
+    governor_unwatch(governor);
+    governor->connection = g_object_ref(connection);
+    governor->cancellable = g_cancellable_new();
+
+    // Replies find the governor through the connection, so one that
+    // arrives after governor_unwatch() is dropped
+    g_object_set_data(G_OBJECT(connection), "dp-governor", governor);
+
+    governor->subscriptions[SUBSCRIPTION_SLEEP] =
+        g_dbus_connection_signal_subscribe(connection, LOGIND_NAME, LOGIND_MANAGER_INTERFACE, "PrepareForSleep",
+                                           LOGIND_PATH, NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                           on_prepare_for_sleep, governor, NULL);
+    // Only the display device speaks for the battery; mice and phones
+    // report their own Percentage on other paths
+    governor->subscriptions[SUBSCRIPTION_UPOWER] =
+        g_dbus_connection_signal_subscribe(connection, UPOWER_NAME, PROPERTIES_INTERFACE, "PropertiesChanged",
+                                           UPOWER_PATH, UPOWER_INTERFACE, G_DBUS_SIGNAL_FLAGS_NONE,
+                                           on_properties_changed, governor, NULL);
+    governor->subscriptions[SUBSCRIPTION_DISPLAY] =
+        g_dbus_connection_signal_subscribe(connection, UPOWER_NAME, PROPERTIES_INTERFACE, "PropertiesChanged",
+                                           UPOWER_DISPLAY_PATH, UPOWER_DEVICE_INTERFACE, G_DBUS_SIGNAL_FLAGS_NONE,
+                                           on_properties_changed, governor, NULL);
+    governor_fetch(governor, UPOWER_NAME, UPOWER_PATH, UPOWER_INTERFACE);
+    governor_fetch(governor, UPOWER_NAME, UPOWER_DISPLAY_PATH, UPOWER_DEVICE_INTERFACE);
+
+    // Desktop sessions export XDG_SESSION_ID; processes started from a
+    // systemd user unit aren't in the session themselves
+    const char *session_id = g_getenv("XDG_SESSION_ID");
+    if (session_id && *session_id) {
+        g_dbus_connection_call(connection, LOGIND_NAME, LOGIND_PATH, LOGIND_MANAGER_INTERFACE, "GetSession",
+                               g_variant_new("(s)", session_id), G_VARIANT_TYPE("(o)"),
+                               G_DBUS_CALL_FLAGS_NONE, -1, governor->cancellable, on_session_found, NULL);
+    } else {
+        g_dbus_connection_call(connection, LOGIND_NAME, LOGIND_PATH, LOGIND_MANAGER_INTERFACE, "GetSessionByPID",
+                               g_variant_new("(u)", (guint32)getpid()), G_VARIANT_TYPE("(o)"),
+                               G_DBUS_CALL_FLAGS_NONE, -1, governor->cancellable, on_session_found, NULL);
+    }
+}
+
+void governor_start(Governor *governor, guint interval) {
+    governor->running = TRUE;
+    governor->interval = MAX(interval, 1);
+    governor->next_due = g_get_real_time() + (gint64)governor->interval * G_USEC_PER_SEC;
+    governor_disarm(governor);
+    governor_arm(governor);
+}
+
+void governor_stop(Governor *governor) {
+    governor->running = FALSE;
+    governor_disarm(governor);
+}
+
+void governor_set_interval(Governor *governor, guint interval) {
+    if (governor->running) {
+        governor_start(governor, interval);
+    } else {
+        governor->interval = MAX(interval, 1);
+    }
+}
+
+gboolean governor_is_running(const Governor *governor) {
+    return governor->running;
+}
+
+void governor_set_battery_threshold(Governor *governor, int percent) {
+    governor->battery_threshold = CLAMP(percent, 0, 100);
+    governor_update(governor);
+}
+
+guint governor_get_pause_reasons(const Governor *governor) {
+    return governor->reasons;
+}
@@ -0,0 +1,177 @@
+#include "hash.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define HASH_READ_SIZE (256 * 1024)
+
+static inline guint64 rotl64(guint64 value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline guint64 read64(const guint8 *p) {
+    guint64 value;
+    memcpy(&value, p, sizeof(value));
+    return GUINT64_FROM_LE(value);
+}
+
+static inline guint32 read32(const guint8 *p) {
+    guint32 value;
+    memcpy(&value, p, sizeof(value));
+    return GUINT32_FROM_LE(value);
+}
+
+static inline guint64 hash_round(guint64 acc, guint64 input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline guint64 hash_merge_round(guint64 acc, guint64 value) {
+    acc ^= hash_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+// Consume whole 32-byte stripes. The four lanes are independent, so the
+// compiler can keep them in flight together.
+static const guint8* hash_consume(guint64 *lanes, const guint8 *p, const guint8 *limit) {
+    guint64 v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while (p + 32 <= limit) {
+        v1 = hash_round(v1, read64(p));
+        v2 = hash_round(v2, read64(p + 8));
+        v3 = hash_round(v3, read64(p + 16));
+        v4 = hash_round(v4, read64(p + 24));
+        p += 32;
+    }
+    lanes[0] = v1; lanes[1] = v2; lanes[2] = v3; lanes[3] = v4;
+    return p;
+}
+
+void hash_init(HashState *state, guint64 seed) {
+    memset(state, 0, sizeof(*state));
+    state->seed = seed;
+    state->lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    state->lanes[1] = seed + PRIME64_2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - PRIME64_1;
+}
+
+void hash_update(HashState *state, const void *data, gsize length) {
+    const guint8 *p = data;
+    const guint8 *end = p + length;
+    state->total_length += length;
+
+    // Top up a partial stripe first
+    if (state->buffered > 0) {
+        gsize needed = 32 - state->buffered;
+        if (length < needed) {
+            memcpy(state->buffer + state->buffered, p, length);
+            state->buffered += length;
+            return;
+        }
+        memcpy(state->buffer + state->buffered, p, needed);
+        hash_consume(state->lanes, state->buffer, state->buffer + 32);
+        p += needed;
+        state->buffered = 0;
+    }
+
+    p = hash_consume(state->lanes, p, end);
+
+    if (p < end) {
+        memcpy(state->buffer, p, end - p);
+        state->buffered = end - p;
+    }
+}
+
+guint64 hash_digest(const HashState *state) {
+    guint64 h;
+    if (state->total_length >= 32) {
+        const guint64 *v = state->lanes;
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        h = hash_merge_round(h, v[0]);
+        h = hash_merge_round(h, v[1]);
+        h = hash_merge_round(h, v[2]);
+        h = hash_merge_round(h, v[3]);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+    h += state->total_length;
+
+    const guint8 *p = state->buffer;
+    const guint8 *end = p + state->buffered;
+    while (p + 8 <= end) {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (guint64)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+guint64 hash_bytes(const void *data, gsize length, guint64 seed) {
+    HashState state;
+    hash_init(&state, seed);
+    hash_update(&state, data, length);
+    return hash_digest(&state);
+}
+
+// Hash a whole file in large sequential reads
+gboolean hash_file(const char *path, guint64 *hash, guint64 *size, GError **error) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        int saved_errno = errno;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to open %s: %s", path, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    HashState state;
+    hash_init(&state, 0);
+
+    guint8 *buffer = g_malloc(HASH_READ_SIZE);
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, HASH_READ_SIZE, file)) > 0) {
+        hash_update(&state, buffer, bytes);
+    }
+    gboolean failed = ferror(file);
+    fclose(file);
+    g_free(buffer);
+
+    if (failed) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed to read %s", path);
+        return FALSE;
+    }
+
+    *hash = hash_digest(&state);
+    if (size) {
+        *size = state.total_length;
+    }
+    return TRUE;
+}
+
+char* hash_to_string(guint64 hash) {
+    return g_strdup_printf("%016" G_GINT64_MODIFIER "x", hash);
+}
@@ -0,0 +1,352 @@
+#include "hashindex.h"
+#include "binfile.h"
+#include "hash.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define HASHINDEX_MAGIC   0x58485044u  // "DPHX"
+#define HASHINDEX_VERSION 1
+
+// On-disk records; the binfile pool starts with the indexed directory
+typedef struct {
+    guint64 hash;
+    guint64 size;
+    gint64 mtime;
+    guint32 name_offset;
+    guint32 name_length;
+} HashIndexRecord;
+
+static const BinfileFormat hashindex_format = {
+    HASHINDEX_MAGIC, HASHINDEX_VERSION, 0, sizeof(HashIndexRecord)
+};
+
+typedef struct {
+    char *name;
+    guint64 hash;
+    guint64 size;
+    gint64 mtime;
+} HashIndexEntry;
+
+// Key of the content table
+typedef struct {
+    guint64 hash;
+    guint64 size;
+} HashIndexContent;
+
+struct _HashIndex {
+    char *directory;
+    char *cache_path;
+    GMutex lock;
+    GHashTable *entries;    // Name -> HashIndexEntry
+    GHashTable *contents;   // HashIndexContent -> filename, or NULL while an import holds it
+    gboolean dirty;
+};
+
+static guint content_hash(gconstpointer key) {
+    const HashIndexContent *content = key;
+    return (guint)(content->hash ^ (content->hash >> 32));
+}
+
+static gboolean content_equal(gconstpointer a, gconstpointer b) {
+    const HashIndexContent *x = a, *y = b;
+    return x->hash == y->hash && x->size == y->size;
+}
+
+static void entry_free(gpointer data) {
+    HashIndexEntry *entry = data;
+    g_free(entry->name);
+    g_free(entry);
+}
+
+static HashIndexContent* content_new(guint64 hash, guint64 size) {
+    HashIndexContent *content = g_new(HashIndexContent, 1);
+    content->hash = hash;
+    content->size = size;
+    return content;
+}
+
+char* hashindex_get_default_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "cache", "hashes.bin", NULL);
+}
+
+const char* hashindex_get_directory(const HashIndex *index) {
+    return index->directory;
+}
+
+// Add an entry and make it the content's filename if it has none yet. Lock held.
+static void hashindex_insert_locked(HashIndex *index, const char *name, guint64 hash, guint64 size, gint64 mtime) {
+    HashIndexEntry *entry = g_new(HashIndexEntry, 1);
+    entry->name = g_strdup(name);
+    entry->hash = hash;
+    entry->size = size;
+    entry->mtime = mtime;
+    g_hash_table_replace(index->entries, entry->name, entry);
+
+    HashIndexContent key = { hash, size };
+    if (g_hash_table_lookup(index->contents, &key) == NULL) {
+        g_hash_table_replace(index->contents, content_new(hash, size), g_strdup(name));
+    }
+}
+
+// Remove an entry and the content mapping that points at it. Lock held.
+static void hashindex_remove_locked(HashIndex *index, const char *name) {
+    HashIndexEntry *entry = g_hash_table_lookup(index->entries, name);
+    if (!entry) return;
+
+    HashIndexContent key = { entry->hash, entry->size };
+    const char *owner = g_hash_table_lookup(index->contents, &key);
+    if (owner && strcmp(owner, name) == 0) {
+        g_hash_table_remove(index->contents, &key);
+    }
+    g_hash_table_remove(index->entries, name);
+}
+
+static gboolean hashindex_load(HashIndex *index) {
+    BinfileView view;
+    char *data = binfile_load(&hashindex_format, index->cache_path, &view);
+    if (!data) {
+        return FALSE;
+    }
+    if (view.pool_size == 0 || strcmp(view.pool, index->directory) != 0) {
+        g_free(data);
+        return FALSE;
+    }
+
+    const HashIndexRecord *records = view.records;
+    for (guint32 i = 0; i < view.count; i++) {
+        const char *name = binfile_string(&view, records[i].name_offset, records[i].name_length);
+        if (!name) {
+            break;
+        }
+        hashindex_insert_locked(index, name, records[i].hash, records[i].size, records[i].mtime);
+    }
+
+    g_free(data);
+    return TRUE;
+}
+
+HashIndex* hashindex_open(const char *directory, const char *cache_path) {
+    HashIndex *index = g_new0(HashIndex, 1);
+    index->directory = g_strdup(directory);
+    index->cache_path = g_strdup(cache_path);
+    g_mutex_init(&index->lock);
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, entry_free);
+    index->contents = g_hash_table_new_full(content_hash, content_equal, g_free, g_free);
+
+    hashindex_load(index);
+    return index;
+}
+
+void hashindex_free(HashIndex *index) {
+    if (!index) return;
+
+    g_hash_table_destroy(index->contents);
+    g_hash_table_destroy(index->entries);
+    g_mutex_clear(&index->lock);
+    g_free(index->directory);
+    g_free(index->cache_path);
+    g_free(index);
+}
+
+// Write the index if anything changed since it was loaded or last saved
+gboolean hashindex_save(HashIndex *index) {
+    g_mutex_lock(&index->lock);
+    if (!index->dirty) {
+        g_mutex_unlock(&index->lock);
+        return TRUE;
+    }
+
+    guint count = g_hash_table_size(index->entries);
+    GArray *records = g_array_sized_new(FALSE, FALSE, sizeof(HashIndexRecord), count);
+    GString *names = g_string_sized_new(4096);
+    guint32 length;
+    binfile_pool_append(names, index->directory, &length);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, index->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        HashIndexEntry *entry = value;
+        HashIndexRecord record;
+        record.hash = entry->hash;
+        record.size = entry->size;
+        record.mtime = entry->mtime;
+        record.name_offset = binfile_pool_append(names, entry->name, &record.name_length);
+        g_array_append_val(records, record);
+    }
+    index->dirty = FALSE;
+    g_mutex_unlock(&index->lock);
+
+    GError *error = NULL;
+    gboolean success = binfile_save(&hashindex_format, index->cache_path, NULL, records->data, records->len,
+                                    names->str, names->len, &error);
+    if (!success) {
+        log_warning("Failed to save hash index %s: %s", index->cache_path, error->message);
+        g_error_free(error);
+
+        g_mutex_lock(&index->lock);
+        index->dirty = TRUE;
+        g_mutex_unlock(&index->lock);
+    }
+
+    g_array_free(records, TRUE);
+    g_string_free(names, TRUE);
+    return success;
+}
+
+// Whether the library file still has the indexed size. Lock held.
+static gboolean hashindex_file_present(HashIndex *index, const char *name, guint64 size) {
+    char *path = g_build_filename(index->directory, name, NULL);
+    struct stat st;
+    gboolean present = g_stat(path, &st) == 0 && S_ISREG(st.st_mode) && (guint64)st.st_size == size;
+    g_free(path);
+    return present;
+}
+
+gboolean hashindex_claim(HashIndex *index, guint64 hash, guint64 size, char **existing) {
+    HashIndexContent key = { hash, size };
+    gboolean claimed = TRUE;
+
+    g_mutex_lock(&index->lock);
+    gpointer owner = NULL;
+    if (g_hash_table_lookup_extended(index->contents, &key, NULL, &owner)) {
+        if (owner == NULL) {
+            // Another import of the same bytes is in progress
+            if (existing) *existing = NULL;
+            claimed = FALSE;
+        } else if (hashindex_file_present(index, owner, size)) {
+            if (existing) *existing = g_strdup(owner);
+            claimed = FALSE;
+        } else {
+            // The file went away without us hearing about it
+            char *stale = g_strdup(owner);
+            hashindex_remove_locked(index, stale);
+            g_free(stale);
+            index->dirty = TRUE;
+        }
+    }
+
+    if (claimed) {
+        g_hash_table_replace(index->contents, content_new(hash, size), NULL);
+    }
+    g_mutex_unlock(&index->lock);
+
+    return claimed;
+}
+
+void hashindex_release(HashIndex *index, guint64 hash, guint64 size) {
+    HashIndexContent key = { hash, size };
+
+    g_mutex_lock(&index->lock);
+    gpointer owner = NULL;
+    if (g_hash_table_lookup_extended(index->contents, &key, NULL, &owner) && owner == NULL) {
+        g_hash_table_remove(index->contents, &key);
+    }
+    g_mutex_unlock(&index->lock);
+}
+
+void hashindex_set(HashIndex *index, const char *name, guint64 hash, guint64 size, gint64 mtime) {
+    g_mutex_lock(&index->lock);
+    hashindex_remove_locked(index, name);
+
+    // A claim for this content is settled by the new file
+    HashIndexContent key = { hash, size };
+    gpointer owner = NULL;
+    if (g_hash_table_lookup_extended(index->contents, &key, NULL, &owner) && owner == NULL) {
+        g_hash_table_remove(index->contents, &key);
+    }
+
+    hashindex_insert_locked(index, name, hash, size, mtime);
+    index->dirty = TRUE;
+    g_mutex_unlock(&index->lock);
+}
+
+void hashindex_remove(HashIndex *index, const char *name) {
+    g_mutex_lock(&index->lock);
+    if (g_hash_table_contains(index->entries, name)) {
+        hashindex_remove_locked(index, name);
+        index->dirty = TRUE;
+    }
+    g_mutex_unlock(&index->lock);
+}
+
+void hashindex_rename(HashIndex *index, const char *old_name, const char *new_name) {
+    g_mutex_lock(&index->lock);
+    HashIndexEntry *entry = g_hash_table_lookup(index->entries, old_name);
+    if (entry) {
+        HashIndexEntry moved = *entry;
+        hashindex_remove_locked(index, old_name);
+        hashindex_remove_locked(index, new_name);
+        hashindex_insert_locked(index, new_name, moved.hash, moved.size, moved.mtime);
+        index->dirty = TRUE;
+    }
+    g_mutex_unlock(&index->lock);
+}
+
+gboolean hashindex_lookup(HashIndex *index, const char *name, guint64 size, gint64 mtime, guint64 *hash) {
+    g_mutex_lock(&index->lock);
+    HashIndexEntry *entry = g_hash_table_lookup(index->entries, name);
+    gboolean found = entry && entry->size == size && entry->mtime == mtime;
+    if (found) {
+        *hash = entry->hash;
+
+        // A duplicate whose twin was removed takes over the content
+        HashIndexContent key = { entry->hash, entry->size };
+        if (!g_hash_table_contains(index->contents, &key)) {
+            g_hash_table_replace(index->contents, content_new(entry->hash, entry->size), g_strdup(name));
+        }
+    }
+    g_mutex_unlock(&index->lock);
+    return found;
+}
+
+gboolean hashindex_hash_file(HashIndex *index, const char *name, guint64 *hash) {
+    char *path = g_build_filename(index->directory, name, NULL);
+    struct stat st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        g_free(path);
+        return FALSE;
+    }
+
+    if (hashindex_lookup(index, name, st.st_size, st.st_mtime, hash)) {
+        g_free(path);
+        return TRUE;
+    }
+
+    guint64 size = 0;
+    gboolean success = hash_file(path, hash, &size, NULL);
+    if (success) {
+        hashindex_set(index, name, *hash, st.st_size, st.st_mtime);
+    }
+    g_free(path);
+    return success;
+}
+
+guint hashindex_prune(HashIndex *index, GHashTable *present_names) {
+    g_mutex_lock(&index->lock);
+    GPtrArray *stale = g_ptr_array_new_with_free_func(g_free);
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, index->entries);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (!g_hash_table_contains(present_names, key)) {
+            g_ptr_array_add(stale, g_strdup(key));
+        }
+    }
+    for (guint i = 0; i < stale->len; i++) {
+        hashindex_remove_locked(index, g_ptr_array_index(stale, i));
+    }
+    if (stale->len > 0) {
+        index->dirty = TRUE;
+    }
+    g_mutex_unlock(&index->lock);
+
+    guint removed = stale->len;
+    g_ptr_array_free(stale, TRUE);
+    return removed;
+}
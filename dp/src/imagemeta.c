@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include "imagemeta.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+// Segments to walk looking for a JPEG frame header before giving up
+#define JPEG_MAX_SEGMENTS 256
+
+// A pread window over the file
+typedef struct {
+    int fd;
+    guint8 data[IMAGEMETA_READ_SIZE];
+    guint64 start;
+    gsize length;
+    int error;              // errno of a failed read, 0 if none
+} HeaderReader;
+
+static const char *format_names[] = { "unknown", "jpeg", "png", "gif", "bmp" };
+
+// The length bytes at offset, reading a new window there if they aren't
+// in the current one. NULL at end of file or on a read error.
+static const guint8* reader_at(HeaderReader *reader, guint64 offset, gsize length) {
+    if (offset >= reader->start && offset + length <= reader->start + reader->length) {
+        return reader->data + (offset - reader->start);
+    }
+
+    ssize_t result;
+    do {
+        result = pread(reader->fd, reader->data, sizeof(reader->data), (off_t)offset);
+    } while (result < 0 && errno == EINTR);
+    reader->start = offset;
+    reader->length = result > 0 ? (gsize)result : 0;
+    if (result < 0) {
+        reader->error = errno;
+    }
+    return reader->length >= length ? reader->data : NULL;
+}
+
+static guint16 read_be16(const guint8 *p) {
+    return (guint16)(p[0] << 8 | p[1]);
+}
+
+static guint32 read_be32(const guint8 *p) {
+    return (guint32)p[0] << 24 | (guint32)p[1] << 16 | (guint32)p[2] << 8 | p[3];
+}
+
+static guint16 read_le16(const guint8 *p) {
+    return (guint16)(p[0] | p[1] << 8);
+}
+
+static guint32 read_le32(const guint8 *p) {
+    return (guint32)p[0] | (guint32)p[1] << 8 | (guint32)p[2] << 16 | (guint32)p[3] << 24;
+}
+
+static gboolean set_dimensions(ImageMeta *meta, guint32 width, guint32 height) {
+    if (width == 0 || height == 0 || width > G_MAXINT || height > G_MAXINT) {
+        return FALSE;
+    }
+    meta->width = (int)width;
+    meta->height = (int)height;
+    return TRUE;
+}
+
+// EXIF Orientation (tag 0x0112) from the TIFF structure in an APP1
+// segment: byte order, magic 42, then the IFD0 entries. Anything past the
+// segment end is ignored. 1 (upright) when absent or unreadable.
+static int read_exif_orientation(HeaderReader *reader, guint64 offset, guint16 length) {
+    guint64 end = offset + 2 + length;
+    guint64 tiff = offset + 10;
+    const guint8 *p = reader_at(reader, offset + 4, 14);
+    if (!p || tiff + 8 > end || memcmp(p, "Exif\0\0", 6) != 0) {
+        return 1;
+    }
+
+    gboolean big_endian;
+    if (p[6] == 'M' && p[7] == 'M') {
+        big_endian = TRUE;
+    } else if (p[6] == 'I' && p[7] == 'I') {
+        big_endian = FALSE;
+    } else {
+        return 1;
+    }
+    guint16 (*read16)(const guint8*) = big_endian ? read_be16 : read_le16;
+    guint32 (*read32)(const guint8*) = big_endian ? read_be32 : read_le32;
+    if (read16(p + 8) != 42) {
+        return 1;
+    }
+
+    guint64 ifd = tiff + read32(p + 10);
+    p = ifd + 2 <= end ? reader_at(reader, ifd, 2) : NULL;
+    if (!p) {
+        return 1;
+    }
+    guint16 count = read16(p);
+    for (guint16 i = 0; i < count; i++) {
+        // Tag, type, count, then the value inline
+        guint64 entry = ifd + 2 + (guint64)i * 12;
+        p = entry + 12 <= end ? reader_at(reader, entry, 12) : NULL;
+        if (!p) {
+            return 1;
+        }
+        if (read16(p) == 0x0112) {
+            guint16 orientation = read16(p + 2) == 3 ? read16(p + 8) : 0;
+            return orientation >= 1 && orientation <= 8 ? orientation : 1;
+        }
+    }
+    return 1;
+}
+
+// Walk the marker segments up to the first frame header, picking up the
+// EXIF orientation on the way
+static gboolean read_jpeg(HeaderReader *reader, ImageMeta *meta) {
+    guint64 offset = 2;
+    for (int segment = 0; segment < JPEG_MAX_SEGMENTS; segment++) {
+        const guint8 *p = reader_at(reader, offset, 2);
+        if (!p || p[0] != 0xFF) {
+            return FALSE;
+        }
+
+        guint8 marker = p[1];
+        if (marker == 0xFF) {
+            // Fill byte before the marker
+            offset++;
+            continue;
+        }
+        if (marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) {
+            // No length field
+            offset += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            // Image data or end of image before any frame header
+            return FALSE;
+        }
+
+        // SOF0-SOF15 except DHT (C4), JPG (C8) and DAC (CC): precision,
+        // then height and width
+        gboolean frame = marker >= 0xC0 && marker <= 0xCF &&
+                         marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        p = reader_at(reader, offset, frame ? 9 : 4);
+        if (!p) {
+            return FALSE;
+        }
+        guint16 length = read_be16(p + 2);
+        if (length < 2) {
+            return FALSE;
+        }
+        if (frame) {
+            // Orientations 5-8 turn the stored image a quarter
+            if (meta->orientation >= 5) {
+                return set_dimensions(meta, read_be16(p + 5), read_be16(p + 7));
+            }
+            return set_dimensions(meta, read_be16(p + 7), read_be16(p + 5));
+        }
+        if (marker == 0xE1 && meta->orientation == 1) {
+            meta->orientation = read_exif_orientation(reader, offset, length);
+        }
+        offset += 2 + (guint64)length;
+    }
+    return FALSE;
+}
+
+gboolean imagemeta_read_fd(int fd, ImageMeta *meta, GError **error) {
+    meta->format = IMAGE_FORMAT_UNKNOWN;
+    meta->width = 0;
+    meta->height = 0;
+    meta->orientation = 1;
+
+    HeaderReader reader = { .fd = fd, .start = G_MAXUINT64 };
+    reader_at(&reader, 0, 2);
+    if (reader.error != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(reader.error),
+                    "Failed to read image header: %s", g_strerror(reader.error));
+        return FALSE;
+    }
+
+    // The signature checks see the first window; read_jpeg() may move it
+    static const guint8 png_signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    const guint8 *data = reader.data;
+    gsize length = reader.length;
+    gboolean success = FALSE;
+
+    if (length >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+        meta->format = IMAGE_FORMAT_JPEG;
+        success = read_jpeg(&reader, meta);
+    } else if (length >= sizeof(png_signature) && memcmp(data, png_signature, sizeof(png_signature)) == 0) {
+        // The first chunk must be IHDR: length, type, width, height
+        meta->format = IMAGE_FORMAT_PNG;
+        success = length >= 24 && memcmp(data + 12, "IHDR", 4) == 0 &&
+                  set_dimensions(meta, read_be32(data + 16), read_be32(data + 20));
+    } else if (length >= 6 && (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0)) {
+        meta->format = IMAGE_FORMAT_GIF;
+        success = length >= 10 && set_dimensions(meta, read_le16(data + 6), read_le16(data + 8));
+    } else if (length >= 2 && data[0] == 'B' && data[1] == 'M') {
+        // OS/2 core headers have 16-bit sizes; later ones are 32-bit, with
+        // a negative height for top-down bitmaps
+        meta->format = IMAGE_FORMAT_BMP;
+        guint32 header_size = length >= 18 ? read_le32(data + 14) : 0;
+        if (header_size == 12 && length >= 22) {
+            success = set_dimensions(meta, read_le16(data + 18), read_le16(data + 20));
+        } else if (header_size >= 40 && length >= 26) {
+            gint32 height = (gint32)read_le32(data + 22);
+            success = set_dimensions(meta, read_le32(data + 18), (guint32)ABS((gint64)height));
+        }
+    }
+
+    if (!success) {
+        if (meta->format == IMAGE_FORMAT_UNKNOWN) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Not a JPEG, PNG, GIF or BMP image");
+        } else {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Corrupt or truncated %s header",
+                        imagemeta_format_name(meta->format));
+        }
+    }
+    return success;
+}
+
+gboolean imagemeta_read_at(int dir_fd, const char *name, ImageMeta *meta, GError **error) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        int saved_errno = errno;
+        meta->format = IMAGE_FORMAT_UNKNOWN;
+        meta->width = 0;
+        meta->height = 0;
+        meta->orientation = 1;
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                    "Failed to open %s: %s", name, g_strerror(saved_errno));
+        return FALSE;
+    }
+
+    gboolean success = imagemeta_read_fd(fd, meta, error);
+    close(fd);
+    return success;
+}
+
+gboolean imagemeta_read(const char *path, ImageMeta *meta, GError **error) {
+    return imagemeta_read_at(AT_FDCWD, path, meta, error);
+}
+
+const char* imagemeta_format_name(ImageFormat format) {
+    return (guint)format < G_N_ELEMENTS(format_names) ? format_names[format] : format_names[0];
+}
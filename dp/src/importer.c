@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include "importer.h"
+#include "hash.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define IMPORTER_BUFFER_SIZE  (1024 * 1024)
+#define IMPORTER_MAX_ATTEMPTS 100
+
+// One import batch, shared by the pool threads
+typedef struct {
+    const char *dest_dir;
+    HashIndex *index;
+    guint total;
+    gint done;
+    gint duplicates;
+    GMutex lock;
+    GPtrArray *imported;
+    ImporterProgressFunc progress;
+    gpointer user_data;
+    GCancellable *cancellable;
+} ImportBatch;
+
+static gint link_counter = 0;
+
+const char* importer_method_name(ImportMethod method) {
+    switch (method) {
+        case IMPORT_METHOD_CLONE:      return "reflink";
+        case IMPORT_METHOD_LINK:       return "hardlink";
+        case IMPORT_METHOD_COPY_RANGE: return "copy_file_range";
+        case IMPORT_METHOD_COPY:       return "copy";
+        case IMPORT_METHOD_DUPLICATE:  return "duplicate";
+    }
+    return "unknown";
+}
+
+// Name to try for an import: the original first, then with a timestamp suffix
+static char* importer_candidate_name(const char *filename, guint attempt, gint64 stamp) {
+    if (attempt == 0) {
+        return g_strdup(filename);
+    }
+
+    const char *dot = strrchr(filename, '.');
+    int base_length = dot ? (int)(dot - filename) : (int)strlen(filename);
+    const char *extension = dot ? dot : "";
+
+    if (attempt == 1) {
+        return g_strdup_printf("%.*s_%" G_GINT64_FORMAT "%s", base_length, filename, stamp, extension);
+    }
+    return g_strdup_printf("%.*s_%" G_GINT64_FORMAT "_%u%s", base_length, filename, stamp, attempt, extension);
+}
+
+static gboolean importer_write_all(int fd, const char *buffer, gsize length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+        buffer += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+// Copy the whole source into an empty destination once cloning and
+// linking are ruled out
+static gboolean importer_copy_data(int src_fd, int dest_fd, gint64 size, ImportMethod *method, GError **error) {
+    // Let the kernel move the data; it may still reflink or offload the copy
+    gint64 copied = 0;
+    while (copied < size) {
+        ssize_t result = copy_file_range(src_fd, NULL, dest_fd, NULL, size - copied, 0);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (result == 0) {
+            break;
+        }
+        copied += result;
+    }
+    if (copied == size) {
+        *method = IMPORT_METHOD_COPY_RANGE;
+        return TRUE;
+    }
+
+    // Start over in userspace from wherever copy_file_range gave up
+    if (lseek(src_fd, copied, SEEK_SET) < 0 || lseek(dest_fd, copied, SEEK_SET) < 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno));
+        return FALSE;
+    }
+
+    char *buffer = g_malloc(IMPORTER_BUFFER_SIZE);
+    gboolean success = TRUE;
+    for (;;) {
+        ssize_t bytes = read(src_fd, buffer, IMPORTER_BUFFER_SIZE);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            success = (bytes == 0);
+            break;
+        }
+        if (!importer_write_all(dest_fd, buffer, bytes)) {
+            success = FALSE;
+            break;
+        }
+    }
+    if (!success) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno));
+    }
+    g_free(buffer);
+
+    *method = IMPORT_METHOD_COPY;
+    return success;
+}
+
+// Replace the reserved (empty) destination with a hardlink to the source
+static gboolean importer_link_over(const char *src_path, const char *dest_path, const char *dest_dir) {
+    char *temp_name = g_strdup_printf(".dp-import-%d-%d", (int)getpid(), g_atomic_int_add(&link_counter, 1));
+    char *temp_path = g_build_filename(dest_dir, temp_name, NULL);
+    g_free(temp_name);
+
+    gboolean linked = link(src_path, temp_path) == 0;
+    if (linked && rename(temp_path, dest_path) != 0) {
+        unlink(temp_path);
+        linked = FALSE;
+    }
+
+    g_free(temp_path);
+    return linked;
+}
+
+gboolean importer_import_file(const char *src_path, const char *dest_dir, HashIndex *index,
+                              char **dest_name, ImportMethod *method, GError **error) {
+    int src_fd = open(src_path, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                    "Failed to open source file %s: %s", src_path, g_strerror(errno));
+        return FALSE;
+    }
+
+    struct stat src_st, dir_st;
+    if (fstat(src_fd, &src_st) != 0 || !S_ISREG(src_st.st_mode) || stat(dest_dir, &dir_st) != 0) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Cannot import %s", src_path);
+        close(src_fd);
+        return FALSE;
+    }
+
+    // Skip content the library already has; identical files in one batch
+    // are caught too, since the first one holds the claim
+    guint64 hash = 0;
+    gboolean claimed = FALSE;
+    if (index && hash_file(src_path, &hash, NULL, NULL)) {
+        char *existing = NULL;
+        if (!hashindex_claim(index, hash, src_st.st_size, &existing)) {
+            if (dest_name) *dest_name = existing; else g_free(existing);
+            if (method) *method = IMPORT_METHOD_DUPLICATE;
+            close(src_fd);
+            return TRUE;
+        }
+        claimed = TRUE;
+    }
+
+    char *filename = g_path_get_basename(src_path);
+    gint64 stamp = time(NULL);
+    gboolean success = FALSE;
+
+    // Reserve a free name atomically so concurrent imports never clobber each other
+    for (guint attempt = 0; attempt < IMPORTER_MAX_ATTEMPTS; attempt++) {
+        char *name = importer_candidate_name(filename, attempt, stamp);
+        char *dest_path = g_build_filename(dest_dir, name, NULL);
+
+        int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (dest_fd < 0) {
+            int saved_errno = errno;
+            g_free(dest_path);
+            g_free(name);
+            if (saved_errno == EEXIST) continue;
+
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                        "Failed to create destination file in %s: %s", dest_dir, g_strerror(saved_errno));
+            break;
+        }
+
+        // A reflink shares the source's blocks until either side is written
+        ImportMethod used = IMPORT_METHOD_COPY;
+        if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+            used = IMPORT_METHOD_CLONE;
+            success = TRUE;
+        } else if (src_st.st_dev == dir_st.st_dev && importer_link_over(src_path, dest_path, dest_dir)) {
+            used = IMPORT_METHOD_LINK;
+            success = TRUE;
+        } else {
+            success = importer_copy_data(src_fd, dest_fd, src_st.st_size, &used, error);
+        }
+
+        if (close(dest_fd) != 0 && success && used != IMPORT_METHOD_LINK) {
+            g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                        "Failed to write %s: %s", dest_path, g_strerror(errno));
+            success = FALSE;
+        }
+
+        if (success) {
+            struct stat dest_st;
+            if (claimed && stat(dest_path, &dest_st) == 0) {
+                hashindex_set(index, name, hash, dest_st.st_size, dest_st.st_mtime);
+                claimed = FALSE;
+            }
+            if (dest_name) *dest_name = name; else g_free(name);
+            if (method) *method = used;
+        } else {
+            unlink(dest_path);
+            g_free(name);
+        }
+        g_free(dest_path);
+        break;
+    }
+
+    if (!success && error && !*error) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_EXIST, "No free name for %s in %s", filename, dest_dir);
+    }
+    if (claimed) {
+        hashindex_release(index, hash, src_st.st_size);
+    }
+
+    g_free(filename);
+    close(src_fd);
+    return success;
+}
+
+// Pool thread: import one file and report progress
+static void importer_task_run(gpointer data, gpointer user_data) {
+    char *src_path = data;
+    ImportBatch *batch = user_data;
+
+    if (!g_cancellable_is_cancelled(batch->cancellable)) {
+        char *name = NULL;
+        ImportMethod method;
+        GError *error = NULL;
+
+        if (!importer_import_file(src_path, batch->dest_dir, batch->index, &name, &method, &error)) {
+            log_warning("%s", error->message);
+            g_error_free(error);
+        } else if (method == IMPORT_METHOD_DUPLICATE) {
+            log_info("Skipped duplicate: %s (same as %s)", src_path, name ? name : "another file in this import");
+            g_atomic_int_inc(&batch->duplicates);
+            g_free(name);
+        } else {
+            log_info("Imported (%s): %s -> %s/%s", importer_method_name(method), src_path, batch->dest_dir, name);
+            g_mutex_lock(&batch->lock);
+            g_ptr_array_add(batch->imported, name);
+            g_mutex_unlock(&batch->lock);
+        }
+    }
+
+    guint done = g_atomic_int_add(&batch->done, 1) + 1;
+    if (batch->progress) {
+        batch->progress(done, batch->total, batch->user_data);
+    }
+}
+
+GPtrArray* importer_import(GSList *files, const char *dest_dir, HashIndex *index, guint max_workers,
+                           ImporterProgressFunc progress, gpointer user_data,
+                           guint *duplicates, GCancellable *cancellable) {
+    ImportBatch batch = {
+        .dest_dir = dest_dir,
+        .index = index,
+        .total = g_slist_length(files),
+        .done = 0,
+        .duplicates = 0,
+        .imported = g_ptr_array_new_with_free_func(g_free),
+        .progress = progress,
+        .user_data = user_data,
+        .cancellable = cancellable,
+    };
+    g_mutex_init(&batch.lock);
+
+    GThreadPool *pool = g_thread_pool_new(importer_task_run, &batch, MAX(1, max_workers), FALSE, NULL);
+    for (GSList *l = files; l != NULL; l = l->next) {
+        g_thread_pool_push(pool, l->data, NULL);
+    }
+
+    // Wait for every queued file
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_mutex_clear(&batch.lock);
+
+    if (duplicates) {
+        *duplicates = batch.duplicates;
+    }
+    return batch.imported;
+}
@@ -0,0 +1,254 @@
+#include "log.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define LOG_RING_SLOTS 512              // Must be a power of two
+#define LOG_MESSAGE_MAX 512             // Longer messages are truncated
+#define LOG_FLUSH_INTERVAL_MS 250
+#define LOG_MAX_SIZE (1024 * 1024)      // Rotate once the file reaches this size
+#define LOG_MAX_FILES 3                 // error.log, error.log.1, error.log.2
+
+typedef struct {
+    gint sequence;      // Ring position this slot is waiting for, see log_write()
+    LogLevel level;
+    gint64 time;        // Wall clock, microseconds
+    char message[LOG_MESSAGE_MAX];
+} LogSlot;
+
+// Bounded multi-producer queue (Vyukov). A slot is free for position pos
+// when its sequence equals pos, and holds a message once it reaches pos + 1.
+// The producer and consumer positions sit on separate cache lines.
+typedef struct {
+    gint enqueue_pos;
+    char pad1[64 - sizeof(gint)];
+    guint dequeue_pos;  // Flusher only
+    gint dropped;       // Messages lost to a full ring
+    char pad2[64 - 2 * sizeof(gint)];
+    LogSlot slots[LOG_RING_SLOTS];
+} LogRing;
+
+static LogRing ring;
+static gint log_level =
+#ifdef DEBUG
+    LOG_LEVEL_DEBUG;
+#else
+    LOG_LEVEL_INFO;
+#endif
+
+// Flusher state
+static GMutex log_lock;
+static GCond log_cond;
+static GThread *log_thread = NULL;
+static gboolean log_stopping = FALSE;
+static FILE *log_file = NULL;
+static char *log_path = NULL;
+static gint64 log_size = 0;
+
+static const char *level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+// Distance between two ring positions; they wrap around together
+static inline gint log_distance(gint sequence, guint pos) {
+    return (gint)((guint)sequence - pos);
+}
+
+static void log_ring_init(void) {
+    static gsize initialized = 0;
+    if (g_once_init_enter(&initialized)) {
+        for (guint i = 0; i < LOG_RING_SLOTS; i++) {
+            ring.slots[i].sequence = (gint)i;
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+char* log_get_default_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "error.log", NULL);
+}
+
+void log_set_level(LogLevel level) {
+    g_atomic_int_set(&log_level, level);
+}
+
+gboolean log_enabled(LogLevel level) {
+    return (gint)level >= g_atomic_int_get(&log_level);
+}
+
+// Claim a slot, format into it and publish it. No locks and no file I/O;
+// if the flusher has fallen a full ring behind, the message is dropped.
+void log_write(LogLevel level, const char *format, ...) {
+    if (!log_enabled(level)) return;
+    log_ring_init();
+
+    guint pos = (guint)g_atomic_int_get(&ring.enqueue_pos);
+    LogSlot *slot;
+    for (;;) {
+        slot = &ring.slots[pos & (LOG_RING_SLOTS - 1)];
+        gint distance = log_distance(g_atomic_int_get(&slot->sequence), pos);
+
+        if (distance == 0) {
+            if (g_atomic_int_compare_and_exchange(&ring.enqueue_pos, (gint)pos, (gint)(pos + 1))) {
+                break;
+            }
+        } else if (distance < 0) {
+            g_atomic_int_inc(&ring.dropped);
+            return;
+        }
+        // Another thread took this position
+        pos = (guint)g_atomic_int_get(&ring.enqueue_pos);
+    }
+
+    slot->level = level;
+    slot->time = g_get_real_time();
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->message, sizeof(slot->message), format, args);
+    va_end(args);
+
+    g_atomic_int_set(&slot->sequence, (gint)(pos + 1));
+
+    // Wake the flusher early during bursts, once per half ring
+    if ((pos & (LOG_RING_SLOTS / 2 - 1)) == LOG_RING_SLOTS / 2 - 1) {
+        g_cond_signal(&log_cond);
+    }
+}
+
+// Shift error.log -> error.log.1 -> error.log.2 and start a new file
+static void log_rotate(void) {
+    if (log_file) {
+        fclose(log_file);
+    }
+
+    for (int i = LOG_MAX_FILES - 1; i > 0; i--) {
+        char *from = (i == 1) ? g_strdup(log_path) : g_strdup_printf("%s.%d", log_path, i - 1);
+        char *to = g_strdup_printf("%s.%d", log_path, i);
+        g_rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+
+    log_file = fopen(log_path, "a");
+    log_size = 0;
+}
+
+// Write one message; timestamps are formatted here rather than by the caller
+static void log_write_slot(const LogSlot *slot) {
+    static gint64 cached_second = -1;
+    static char timestamp[32];
+
+    if (!log_file) return;
+
+    gint64 second = slot->time / G_USEC_PER_SEC;
+    if (second != cached_second) {
+        GDateTime *date = g_date_time_new_from_unix_local(second);
+        char *text = date ? g_date_time_format(date, "%Y-%m-%d %H:%M:%S") : NULL;
+        g_strlcpy(timestamp, text ? text : "?", sizeof(timestamp));
+        g_free(text);
+        if (date) {
+            g_date_time_unref(date);
+        }
+        cached_second = second;
+    }
+
+    int written = fprintf(log_file, "%s.%03d %-5s %s\n", timestamp,
+                          (int)(slot->time % G_USEC_PER_SEC / 1000),
+                          level_names[slot->level], slot->message);
+    if (written > 0) {
+        log_size += written;
+    }
+}
+
+// Flusher side: empty the ring into the file
+static void log_drain(void) {
+    guint count = 0;
+
+    for (;;) {
+        guint pos = ring.dequeue_pos;
+        LogSlot *slot = &ring.slots[pos & (LOG_RING_SLOTS - 1)];
+        if (log_distance(g_atomic_int_get(&slot->sequence), pos + 1) != 0) {
+            break;
+        }
+
+        log_write_slot(slot);
+        g_atomic_int_set(&slot->sequence, (gint)(pos + LOG_RING_SLOTS));
+        ring.dequeue_pos = pos + 1;
+        count++;
+
+        if (log_size >= LOG_MAX_SIZE) {
+            log_rotate();
+        }
+    }
+
+    gint dropped = g_atomic_int_get(&ring.dropped);
+    while (dropped > 0 && !g_atomic_int_compare_and_exchange(&ring.dropped, dropped, 0)) {
+        dropped = g_atomic_int_get(&ring.dropped);
+    }
+    if (dropped > 0 && log_file) {
+        log_size += fprintf(log_file, "(%d log messages dropped)\n", dropped);
+    }
+
+    if ((count > 0 || dropped > 0) && log_file) {
+        fflush(log_file);
+    }
+}
+
+static gpointer log_flusher_run(gpointer data) {
+    (void)data;
+
+    g_mutex_lock(&log_lock);
+    while (!log_stopping) {
+        g_cond_wait_until(&log_cond, &log_lock,
+                          g_get_monotonic_time() + LOG_FLUSH_INTERVAL_MS * G_TIME_SPAN_MILLISECOND);
+        g_mutex_unlock(&log_lock);
+        log_drain();
+        g_mutex_lock(&log_lock);
+    }
+    g_mutex_unlock(&log_lock);
+
+    return NULL;
+}
+
+void log_init(const char *path) {
+    if (log_thread) return;
+    log_ring_init();
+
+    char *directory = g_path_get_dirname(path);
+    g_mkdir_with_parents(directory, 0755);
+    g_free(directory);
+
+    log_path = g_strdup(path);
+    log_file = fopen(log_path, "a");
+    if (log_file) {
+        fseek(log_file, 0, SEEK_END);
+        log_size = ftell(log_file);
+        if (log_size >= LOG_MAX_SIZE) {
+            log_rotate();
+        }
+    }
+
+    log_stopping = FALSE;
+    log_thread = g_thread_new("log-flusher", log_flusher_run, NULL);
+}
+
+// Stop the flusher and write out everything still queued
+void log_shutdown(void) {
+    if (!log_thread) return;
+
+    g_mutex_lock(&log_lock);
+    log_stopping = TRUE;
+    g_cond_signal(&log_cond);
+    g_mutex_unlock(&log_lock);
+
+    g_thread_join(log_thread);
+    log_thread = NULL;
+
+    log_drain();
+    if (log_file) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+    g_free(log_path);
+    log_path = NULL;
+}
@@ -20,20 +20,149 @@
 #include <pwd.h>
 #include <string.h>
 #include <dirent.h>
-#include <time.h>
 #include <strings.h>  // For strcasecmp
 #include <glib.h>
 #include "config.h"
+#include "catalog.h"
+#include "watcher.h"
+#include "plasma.h"
+#include "worker.h"
+#include "scalecache.h"
+#include "importer.h"
+#include "hashindex.h"
+#include "similar.h"
+#include "log.h"
+#include "metrics.h"
+#include "service.h"
+#include "selector.h"
+#include "ratings.h"
+#include "scheduler.h"
+#include "governor.h"
 
 // Global variables
+static GtkApplication *app = NULL;
 static Config *app_config = NULL;
-static guint auto_rotate_timer_id = 0;
+static Governor *app_governor = NULL;       // Paces auto-rotate
+static Catalog *app_catalog = NULL;
+static Watcher *app_watcher = NULL;
+static guint catalog_save_id = 0;
+static gboolean catalog_scan_pending = FALSE;
+static struct {
+    gboolean active;
+    gboolean each_desktop;
+    int desktop_index;
+    gboolean report_empty;
+} pending_pick;                             // Asked for while a scan was filling an empty catalog
+static char *prefetched_image = NULL;
+static guint prefetch_generation = 0;
+static AppIndicator *app_indicator = NULL;
+static gint task_progress_done = 0;
+static gint task_progress_total = 0;
+static gint task_progress_pending = 0;
+static const char *task_progress_verb = "Importing";
+static guint task_label_clear_id = 0;
+static gboolean similar_scan_pending = FALSE;
+static HashIndex *io_hash_index = NULL;     // Only touched from I/O worker jobs
+static Catalog *system_catalog = NULL;      // Lower layer of app_catalog with default wallpapers on
+static gboolean system_scan_pending = FALSE;
+static gint64 app_start_time = 0;
+static Selector *app_selector = NULL;
+static gboolean selector_stale = TRUE;      // Visible images changed since the last sync
+static guint selector_save_id = 0;
+static gint64 weights_refresh_time = 0;
+static Ratings *app_ratings = NULL;
+static guint ratings_save_id = 0;
+static char *current_image = NULL;          // Last image applied to the first desktop
+static gint64 current_image_time = 0;
+static gboolean current_image_skipped = FALSE;
+static Scheduler *app_scheduler = NULL;     // NULL without a schedule file
+
+// Bundled wallpapers, shared by every user and served from here without copying
+#define SYSTEM_WALLPAPER_DIR "/opt/dp/dp/data/wallpaper"
+
+// Images to pick for Randomize Each Desktop before the desktop count is known
+#define RANDOMIZE_POOL_SIZE 20
+
+// Picks to try when prefetching before giving up until the next tick
+#define PREFETCH_ATTEMPTS 3
+
+// Concurrent files for imports and similarity scans, and how long a
+// background task's result stays in the tray
+#define IMPORT_MAX_WORKERS 8
+#define TASK_LABEL_SECONDS 5
+
+// Replacing a wallpaper by hand this soon after it appeared counts as a skip
+#define SKIP_WINDOW_SECONDS 60
+
+// Weighted picks re-read every weight this often, as history decays
+#define WEIGHT_REFRESH_SECONDS 3600
+
+// Draws the rotation policy gets to find an image that fits a screen
+// before falling back to the catalog's aspect index
+#define SCREEN_MATCH_TRIES 16
+
+// A wallpaper apply handed to the worker thread
+typedef struct {
+    GPtrArray *images;      // Image paths
+    int desktop_index;      // -1 means all desktops
+    gboolean each_desktop;  // Spread the images across every desktop
+    gboolean applied;       // Plasma took the wallpaper; set by the worker
+} ApplyRequest;
+
+// A photo import handed to the worker thread
+typedef struct {
+    GSList *files;          // Source paths
+    char *dest_dir;
+    GPtrArray *imported;    // Filenames that were added to dest_dir
+    guint duplicates;       // Files skipped because the library already has them
+} ImportRequest;
+
+// A catalog rescan handed to the worker thread
+typedef struct {
+    char *directory;
+    Catalog *catalog;
+} ScanRequest;
+
+// The next auto-rotate image, warmed up on the I/O worker
+typedef struct {
+    char *image_path;
+    guint generation;       // prefetch_generation when queued
+    guint attempt;
+    gboolean valid;         // Readable and decodable
+} PrefetchRequest;
+
+// A near-duplicate scan of the photo list
+typedef struct {
+    char *directory;
+    GPtrArray *names;       // Library filenames
+    SimilarInfo *infos;     // Parallel to names
+    GPtrArray *clusters;    // GArray of indices into names, two or more each
+} SimilarRequest;
+
+// Library files to bring into the content-hash index
+typedef struct {
+    char *directory;
+    GPtrArray *names;
+} HashSyncRequest;
+
+// Images whose scaled variants should be generated in the background
+typedef struct {
+    GPtrArray *images;      // Image paths
+} ScaleRequest;
 
 // Forward declarations
 AppIndicator* create_tray_icon(void);
+static GtkWidget* create_rotation_menu(void);
+static GtkWidget* create_rating_menu(void);
 static void set_random_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void set_all_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata);
+static void randomize_each_desktop_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void set_selected_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata);
+static void apply_random_wallpaper(int desktop_index, gboolean report_empty);
+static void randomize_each_desktop(gboolean report_empty);
+static gboolean defer_pick(gboolean each_desktop, int desktop_index, gboolean report_empty);
+static void run_pending_pick(void);
+static void show_no_images_dialog(const char *library_dir);
 static void set_selected_all_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void find_photos_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void remove_photos_callback(GtkMenuItem *menuitem, gpointer userdata);
@@ -43,31 +172,167 @@ static void configure_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void about_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void quit_callback(GtkMenuItem *menuitem, gpointer userdata);
 static char* get_default_wallpaper_directory(void);
+static char* get_library_directory(void);
 static int create_default_directory(void);
+static Catalog* get_wallpaper_catalog(const char *directory);
 static char* get_random_image_from_directory(const char *directory);
-static int is_image_file(const char *filename);
+static GPtrArray* get_random_images_from_directory(const char *directory, guint count);
+static GPtrArray* get_images_for_screens(const char *directory, GArray *screens);
+static char* pick_image_for_screen(Catalog *catalog, const PlasmaScreen *screen);
+static gboolean image_fits_screen(const char *image_path, gpointer userdata);
+static Selector* get_selector(Catalog *catalog);
+static void schedule_selector_save(void);
+static gboolean save_selector_timeout(gpointer data);
+static Ratings* get_ratings(void);
+static double get_image_weight(const char *image_path, gpointer userdata);
+static void note_images_shown(GPtrArray *images, guint count);
+static void note_skip(void);
+static void schedule_ratings_save(void);
+static gboolean save_ratings_timeout(gpointer data);
+static void start_schedule(void);
+static void on_schedule_slot(TimeSlot *slot, gpointer userdata);
+static char* pick_rotation_image(gboolean advance);
+static void commit_rotation_image(const char *image);
 static int set_kde_wallpaper(const char *image_path);
 static int set_kde_wallpaper_desktop(const char *image_path, int desktop_index);
+static int set_kde_wallpaper_batch(const PlasmaAssignment *assignments, guint count);
+static void record_apply(gint64 start_time, guint desktops, gboolean success);
+static int print_stats(void);
+static void on_startup(GApplication *application, gpointer userdata);
+static int on_command_line(GApplication *application, GApplicationCommandLine *command_line, gpointer userdata);
+static void on_shutdown(GApplication *application, gpointer userdata);
+static char* get_command_line_path(GApplicationCommandLine *command_line, const char *arg);
+static void submit_apply(const char *image_path, int desktop_index);
+static void submit_apply_each_desktop(GPtrArray *images);
+static void apply_request_run(gpointer data, GCancellable *cancellable);
+static void apply_request_done(gpointer data, gboolean cancelled);
+static void apply_request_free(gpointer data);
+static void submit_scale(GPtrArray *images);
+static void scale_request_run(gpointer data, GCancellable *cancellable);
+static void scale_request_free(gpointer data);
+static void update_scale_target(void);
+static void scale_prune_run(gpointer data, GCancellable *cancellable);
+static void schedule_prefetch(guint attempt);
+static void cancel_prefetch(void);
+static void prefetch_request_run(gpointer data, GCancellable *cancellable);
+static void prefetch_request_done(gpointer data, gboolean cancelled);
+static void prefetch_request_free(gpointer data);
+static void on_monitors_changed(GdkDisplay *display, GdkMonitor *monitor, gpointer userdata);
+static void import_request_run(gpointer data, GCancellable *cancellable);
+static void import_request_done(gpointer data, gboolean cancelled);
+static void import_request_free(gpointer data);
+static void begin_task_progress(const char *verb, guint total);
+static void on_task_progress(guint done, guint total, gpointer userdata);
+static gboolean update_task_progress(gpointer data);
+static void show_task_result(const char *message);
+static gboolean clear_task_label(gpointer data);
+static void find_similar_callback(GtkMenuItem *menuitem, gpointer userdata);
+static void similar_request_run(gpointer data, GCancellable *cancellable);
+static void similar_request_done(gpointer data, gboolean cancelled);
+static void similar_request_free(gpointer data);
+static void request_catalog_scan(const char *directory);
+static void scan_request_run(gpointer data, GCancellable *cancellable);
+static void scan_request_done(gpointer data, gboolean cancelled);
+static void scan_request_free(gpointer data);
+static void fill_installed_photos_from_catalog(Catalog *catalog);
+static HashIndex* get_hash_index(const char *directory);
+static void request_hash_sync(void);
+static void hash_sync_request_run(gpointer data, GCancellable *cancellable);
+static void hash_sync_request_free(gpointer data);
 static void copy_files_to_wallpaper_directory(GSList *file_list);
 static void update_installed_photos_from_directory(void);
-static void install_default_wallpapers(void);
+static void on_library_changed(WatcherEventType type, const char *name, const char *new_name, gpointer userdata);
+static void update_selector(Catalog *catalog, const char *name, gboolean added, guint visible_before);
+static void rename_in_selector(Catalog *catalog, const char *name, const char *new_name);
+static void rename_rating(const char *name, const char *new_name);
+static gboolean save_catalog_timeout(gpointer data);
+static void load_default_wallpapers(void);
+static Catalog* get_system_catalog(void);
+static char* get_system_catalog_path(void);
+static void attach_system_layer(Catalog *catalog);
+static void system_scan_request_run(gpointer data, GCancellable *cancellable);
+static void system_scan_request_done(gpointer data, gboolean cancelled);
+static gboolean finish_startup(gpointer data);
 static void show_configuration_dialog(void);
-static gboolean auto_rotate_timer_callback(gpointer data);
+static Governor* get_governor(void);
+static gboolean auto_rotate_running(void);
+static void auto_rotate_tick(void);
+static void on_system_woke(void);
+static void on_system_bus_ready(GObject *source, GAsyncResult *result, gpointer userdata);
+static char* advance_wallpaper(void);
 static void start_auto_rotate(void);
 static void stop_auto_rotate(void);
 static void toggle_default_wallpapers_callback(GtkMenuItem *menuitem, gpointer userdata);
+static void rotation_policy_callback(GtkCheckMenuItem *menuitem, gpointer userdata);
+static void rate_current_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void toggle_boot_screen_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void set_boot_screen_random_callback(GtkMenuItem *menuitem, gpointer userdata);
 static void set_boot_screen_selected_callback(GtkMenuItem *menuitem, gpointer userdata);
+static char* service_next(GError **error);
+static gboolean service_set(const char *image_path, int desktop_index, GError **error);
+static guint service_import(const char *path, GError **error);
+static char* service_rate(const char *image_path, int stars, GError **error);
+
+// What the `dp` client and other D-Bus callers can ask for
+static const ServiceHandlers service_handlers = {
+    service_next,
+    service_set,
+    service_import,
+    service_rate
+};
 
 int main(int argc, char *argv[]) {
+    // Print the running instance's metrics and exit
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+        return print_stats();
+    }
+
     // Suppress libayatana-appindicator deprecation warnings
     g_setenv("G_DEBUG", "fatal-warnings", TRUE);
+    metrics_init();
+    app_start_time = g_get_monotonic_time();
+
+    // One instance per session: a later launch hands its arguments to the
+    // running one and exits without initializing GTK
+    app = gtk_application_new(SERVICE_BUS_NAME, G_APPLICATION_HANDLES_COMMAND_LINE);
+    g_signal_connect(app, "startup", G_CALLBACK(on_startup), NULL);
+    g_signal_connect(app, "command-line", G_CALLBACK(on_command_line), NULL);
+    g_signal_connect(app, "shutdown", G_CALLBACK(on_shutdown), NULL);
+
+    int status = g_application_run(G_APPLICATION(app), argc, argv);
+    g_object_unref(app);
+    app = NULL;
+
+    return status;
+}
+
+// Primary instance only; GTK is initialized by now. Only what the tray icon
+// and the boot wallpaper need runs here; library housekeeping waits for
+// finish_startup().
+static void on_startup(GApplication *application, gpointer userdata) {
+    (void)userdata;
 
-    // Initialize GTK
-    gtk_init(&argc, &argv);
+    // Log through the buffered writer; workers log from their own threads
+    char *log_path = log_get_default_path();
+    log_init(log_path);
+    g_free(log_path);
 
-    // Load configuration
+    // Start the background workers before anything queues jobs
+    worker_init();
+
+    // Answer `dp`, `dpaper --stats` and other D-Bus clients
+    service_start(g_application_get_dbus_connection(application), &service_handlers);
+
+    // Pre-scaled wallpapers follow the current monitor layout
+    update_scale_target();
+    GdkDisplay *display = gdk_display_get_default();
+    if (display) {
+        g_signal_connect(display, "monitor-added", G_CALLBACK(on_monitors_changed), NULL);
+        g_signal_connect(display, "monitor-removed", G_CALLBACK(on_monitors_changed), NULL);
+    }
+
+    // Load configuration. The photo list is rebuilt from the catalog by
+    // finish_startup().
     app_config = config_new();
     char *config_path = config_get_config_path();
     if (!config_load(app_config, config_path)) {
@@ -75,6 +340,15 @@ int main(int argc, char *argv[]) {
     }
     g_free(config_path);
 
+    // Create the system tray icon
+    AppIndicator *indicator = create_tray_icon();
+    app_indicator = indicator;
+
+    // Set status to active to show the icon
+    app_indicator_set_status(indicator, APP_INDICATOR_STATUS_ACTIVE);
+    metrics_record_since(METRIC_STARTUP, app_start_time);
+    log_info("Tray icon ready %.1f ms after launch", (g_get_monotonic_time() - app_start_time) / 1000.0);
+
     // Restart auto-rotate if it was enabled (silently)
     if (app_config->auto_rotate_enabled) {
         start_auto_rotate();
@@ -84,50 +358,176 @@ int main(int argc, char *argv[]) {
     if (app_config->boot_screen_enabled) {
         if (app_config->boot_screen_image && strlen(app_config->boot_screen_image) > 0) {
             // Use specific image
-            set_kde_wallpaper(app_config->boot_screen_image);
+            submit_apply(app_config->boot_screen_image, -1);
         } else {
-            // Use random image
-            char *default_dir = get_default_wallpaper_directory();
-            char *random_image = get_random_image_from_directory(default_dir);
-
-            if (random_image != NULL) {
-                set_kde_wallpaper(random_image);
-                free(random_image);
-            }
-
-            free(default_dir);
+            // Use random image, once the library is scanned on a first run
+            apply_random_wallpaper(-1, FALSE);
         }
     }
 
     // Show welcome message
     printf("Welcome to Dynamic Wallpaper! Look for the camera icon in your system tray to select your photos.\n");
 
+    // Library install and scan once the main loop has shown the icon
+    g_idle_add_full(G_PRIORITY_LOW, finish_startup, NULL, NULL);
+
+    // There is no window to keep the application alive; released on Quit
+    g_application_hold(application);
+}
+
+// Runs in the primary instance for its own arguments and for every later launch
+static int on_command_line(GApplication *application, GApplicationCommandLine *command_line, gpointer userdata) {
+    (void)application;
+    (void)userdata;
+
+    int argc;
+    char **argv = g_application_command_line_get_arguments(command_line, &argc);
+    const char *command = argc > 1 ? argv[1] : NULL;
+    GError *error = NULL;
+    int status = 0;
+
+    if (!command) {
+        if (g_application_command_line_get_is_remote(command_line)) {
+            g_application_command_line_print(command_line, "dpaper is already running\n");
+        }
+    } else if (strcmp(command, "next") == 0 && argc == 2) {
+        char *image = service_next(&error);
+        if (image) {
+            g_application_command_line_print(command_line, "%s\n", image);
+            g_free(image);
+        }
+    } else if (strcmp(command, "set") == 0 && argc == 3) {
+        char *path = get_command_line_path(command_line, argv[2]);
+        service_set(path, -1, &error);
+        g_free(path);
+    } else if (strcmp(command, "set-desktop") == 0 && argc == 4 && atoi(argv[2]) > 0) {
+        char *path = get_command_line_path(command_line, argv[3]);
+        service_set(path, atoi(argv[2]) - 1, &error);
+        g_free(path);
+    } else if (strcmp(command, "import") == 0 && argc >= 3) {
+        for (int i = 2; i < argc && !error; i++) {
+            char *path = get_command_line_path(command_line, argv[i]);
+            service_import(path, &error);
+            g_free(path);
+        }
+    } else if (strcmp(command, "rate") == 0 && (argc == 3 || argc == 4) &&
+               strlen(argv[2]) == 1 && g_ascii_isdigit(argv[2][0])) {
+        char *path = argc == 4 ? get_command_line_path(command_line, argv[3]) : g_strdup("");
+        char *rated = service_rate(path, argv[2][0] - '0', &error);
+        if (rated) {
+            g_application_command_line_print(command_line, "%s\n", rated);
+            g_free(rated);
+        }
+        g_free(path);
+    } else {
+        g_application_command_line_printerr(command_line,
+                                            "Usage: dpaper [--stats | next | set IMAGE | set-desktop N IMAGE | import PATH... | rate STARS [IMAGE]]\n");
+        status = 2;
+    }
+
+    if (error) {
+        g_application_command_line_printerr(command_line, "dpaper: %s\n", error->message);
+        g_error_free(error);
+        status = 1;
+    }
+
+    g_strfreev(argv);
+    return status;
+}
+
+// Relative paths are relative to the launching process, which may be another instance
+static char* get_command_line_path(GApplicationCommandLine *command_line, const char *arg) {
+    GFile *file = g_application_command_line_create_file_for_arg(command_line, arg);
+    char *path = g_file_get_path(file);
+    g_object_unref(file);
+    return path ? path : g_strdup(arg);
+}
+
+// Second startup phase, from an idle callback
+static gboolean finish_startup(gpointer data) {
+    (void)data;
+
     // Create default directory if it doesn't exist
     create_default_directory();
 
-    // Install default wallpapers if enabled
-    install_default_wallpapers();
-
-    // Scan and update installed photos
+    // Check the bundled wallpapers for changes, then scan the library
+    load_default_wallpapers();
     update_installed_photos_from_directory();
 
-    // Create the system tray icon
-    AppIndicator *indicator = create_tray_icon();
+    // Applies the active slot's image right away
+    start_schedule();
 
-    // Set status to active to show the icon
-    app_indicator_set_status(indicator, APP_INDICATOR_STATUS_ACTIVE);
+    // Session lock, idle, sleep and battery state for the governor
+    g_bus_get(G_BUS_TYPE_SYSTEM, NULL, on_system_bus_ready, NULL);
+
+    return G_SOURCE_REMOVE;
+}
 
-    // Start the GTK main loop
-    gtk_main();
+// Primary instance, after the main loop has stopped
+static void on_shutdown(GApplication *application, gpointer userdata) {
+    (void)application;
+    (void)userdata;
 
-    // Save configuration on exit
-    config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    // Cancel background jobs and wait for them before saving state
+    worker_shutdown();
+    if (io_hash_index) {
+        hashindex_save(io_hash_index);
+        hashindex_free(io_hash_index);
+        io_hash_index = NULL;
+    }
+
+    // Write any pending configuration changes
+    config_flush(app_config);
 
     // Cleanup
+    if (catalog_save_id != 0) {
+        g_source_remove(catalog_save_id);
+        save_catalog_timeout(NULL);
+    }
+    if (selector_save_id != 0) {
+        g_source_remove(selector_save_id);
+        selector_save_id = 0;
+    }
+    if (app_selector) {
+        selector_save(app_selector);
+        selector_free(app_selector);
+    }
+    if (ratings_save_id != 0) {
+        g_source_remove(ratings_save_id);
+        ratings_save_id = 0;
+    }
+    if (app_ratings) {
+        ratings_save(app_ratings);
+        ratings_free(app_ratings);
+    }
+    g_free(current_image);
+    scheduler_free(app_scheduler);
+    governor_free(app_governor);
+    watcher_free(app_watcher);
+    catalog_free(app_catalog);
+    catalog_free(system_catalog);
     config_free(app_config);
+    plasma_shutdown();
+    scalecache_shutdown();
+    g_free(prefetched_image);
+    service_stop();
+    log_shutdown();
+}
+
+// `dpaper --stats`: ask the running instance over D-Bus
+static int print_stats(void) {
+    GError *error = NULL;
+    GVariant *stats = service_get_stats(&error);
+    if (!stats) {
+        fprintf(stderr, "dpaper is not running: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
 
+    char *text = metrics_format(stats);
+    fputs(text, stdout);
+    g_free(text);
+    g_variant_unref(stats);
     return 0;
 }
 
@@ -142,6 +542,15 @@ static char* get_default_wallpaper_directory(void) {
     return default_dir;
 }
 
+// The configured wallpaper directory, which imports and the photo list use
+// too; picks come from it so they share one catalog
+static char* get_library_directory(void) {
+    if (app_config && app_config->wallpaper_directory) {
+        return g_strdup(app_config->wallpaper_directory);
+    }
+    return g_build_filename(g_get_home_dir(), ".dp", NULL);
+}
+
 static int create_default_directory(void) {
     char *default_dir = get_default_wallpaper_directory();
     
@@ -161,6 +570,51 @@ static int create_default_directory(void) {
     return 0;
 }
 
+// One radio item per rotation policy
+static GtkWidget* create_rotation_menu(void) {
+    static const struct {
+        SelectorMode mode;
+        const char *label;
+    } policies[] = {
+        { SELECTOR_MODE_SHUFFLE, "Shuffle (No Repeats)" },
+        { SELECTOR_MODE_WEIGHTED, "Weighted by Rating" },
+        { SELECTOR_MODE_RANDOM, "Random" }
+    };
+
+    GtkWidget *menu = gtk_menu_new();
+    GSList *group = NULL;
+    for (guint i = 0; i < G_N_ELEMENTS(policies); i++) {
+        GtkWidget *item = gtk_radio_menu_item_new_with_label(group, policies[i].label);
+        group = gtk_radio_menu_item_get_group(GTK_RADIO_MENU_ITEM(item));
+        gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(item), app_config->rotation_policy == policies[i].mode);
+        g_signal_connect(item, "toggled", G_CALLBACK(rotation_policy_callback), GINT_TO_POINTER(policies[i].mode));
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+        gtk_widget_show(item);
+    }
+    return menu;
+}
+
+// Five stars down to one, then a way to clear the rating
+static GtkWidget* create_rating_menu(void) {
+    GtkWidget *menu = gtk_menu_new();
+    for (int stars = RATINGS_MAX_STARS; stars >= 0; stars--) {
+        GString *label = g_string_new(NULL);
+        for (int i = 1; i <= RATINGS_MAX_STARS && stars > 0; i++) {
+            g_string_append(label, i <= stars ? "\u2605" : "\u2606");
+        }
+        if (stars == 0) {
+            g_string_append(label, "Clear Rating");
+        }
+
+        GtkWidget *item = gtk_menu_item_new_with_label(label->str);
+        g_signal_connect(item, "activate", G_CALLBACK(rate_current_callback), GINT_TO_POINTER(stars));
+        gtk_menu_shell_append(GTK_MENU_SHELL(menu), item);
+        gtk_widget_show(item);
+        g_string_free(label, TRUE);
+    }
+    return menu;
+}
+
 AppIndicator* create_tray_icon(void) {
     // Try to use custom icon if available, otherwise use default
     // System tray needs PNG at 48x48, desktop can use SVG
@@ -194,12 +648,18 @@ AppIndicator* create_tray_icon(void) {
     // Create menu items
     GtkWidget *set_random_item = gtk_menu_item_new_with_label("Set Random (Current Desktop)");
     GtkWidget *set_all_item = gtk_menu_item_new_with_label("Set Random (All Desktops)");
+    GtkWidget *randomize_each_item = gtk_menu_item_new_with_label("Randomize Each Desktop");
     GtkWidget *set_selected_item = gtk_menu_item_new_with_label("Set Selected (Current Desktop)");
     GtkWidget *set_selected_all_item = gtk_menu_item_new_with_label("Set Selected (All Desktops)");
     GtkWidget *find_photos_item = gtk_menu_item_new_with_label("Find Photos");
     GtkWidget *remove_photos_item = gtk_menu_item_new_with_label("Remove Photos");
+    GtkWidget *find_similar_item = gtk_menu_item_new_with_label("Find Similar Photos");
     GtkWidget *start_auto_rotate_item = gtk_menu_item_new_with_label("Start Auto-Rotate (5 min)");
     GtkWidget *stop_auto_rotate_item = gtk_menu_item_new_with_label("Stop Auto-Rotate");
+    GtkWidget *rotation_item = gtk_menu_item_new_with_label("Rotation");
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(rotation_item), create_rotation_menu());
+    GtkWidget *rate_item = gtk_menu_item_new_with_label("Rate Current Wallpaper");
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(rate_item), create_rating_menu());
     GtkWidget *separator3 = gtk_separator_menu_item_new();
     GtkWidget *boot_screen_item = gtk_check_menu_item_new_with_label("Boot Screen Enabled");
     gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(boot_screen_item), app_config->boot_screen_enabled);
@@ -217,13 +677,17 @@ AppIndicator* create_tray_icon(void) {
     // Add items to menu
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), set_random_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), set_all_item);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), randomize_each_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), set_selected_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), set_selected_all_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), find_photos_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), remove_photos_item);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), find_similar_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator1);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), start_auto_rotate_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), stop_auto_rotate_item);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), rotation_item);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), rate_item);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator2);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), separator3);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), boot_screen_item);
@@ -238,13 +702,17 @@ AppIndicator* create_tray_icon(void) {
     // Show all menu items
     gtk_widget_show(set_random_item);
     gtk_widget_show(set_all_item);
+    gtk_widget_show(randomize_each_item);
     gtk_widget_show(set_selected_item);
     gtk_widget_show(set_selected_all_item);
     gtk_widget_show(find_photos_item);
     gtk_widget_show(remove_photos_item);
+    gtk_widget_show(find_similar_item);
     gtk_widget_show(separator1);
     gtk_widget_show(start_auto_rotate_item);
     gtk_widget_show(stop_auto_rotate_item);
+    gtk_widget_show(rotation_item);
+    gtk_widget_show(rate_item);
     gtk_widget_show(separator2);
     gtk_widget_show(separator3);
     gtk_widget_show(boot_screen_item);
@@ -262,10 +730,12 @@ AppIndicator* create_tray_icon(void) {
     // Connect signals
     g_signal_connect(set_random_item, "activate", G_CALLBACK(set_random_wallpaper_callback), NULL);
     g_signal_connect(set_all_item, "activate", G_CALLBACK(set_all_wallpaper_callback), NULL);
+    g_signal_connect(randomize_each_item, "activate", G_CALLBACK(randomize_each_desktop_callback), NULL);
     g_signal_connect(set_selected_item, "activate", G_CALLBACK(set_selected_wallpaper_callback), NULL);
     g_signal_connect(set_selected_all_item, "activate", G_CALLBACK(set_selected_all_wallpaper_callback), NULL);
     g_signal_connect(find_photos_item, "activate", G_CALLBACK(find_photos_callback), NULL);
     g_signal_connect(remove_photos_item, "activate", G_CALLBACK(remove_photos_callback), NULL);
+    g_signal_connect(find_similar_item, "activate", G_CALLBACK(find_similar_callback), NULL);
     g_signal_connect(start_auto_rotate_item, "activate", G_CALLBACK(start_auto_rotate_callback), NULL);
     g_signal_connect(stop_auto_rotate_item, "activate", G_CALLBACK(stop_auto_rotate_callback), NULL);
     g_signal_connect(boot_screen_item, "activate", G_CALLBACK(toggle_boot_screen_callback), NULL);
@@ -280,52 +750,109 @@ AppIndicator* create_tray_icon(void) {
 }
 
 static void set_random_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata) {
+    (void)userdata;
+    // Auto-rotate calls in without a menu item; only a manual change is a skip
+    if (menuitem != NULL) {
+        note_skip();
+    }
+    // Set random wallpaper on current desktop (desktop 0)
+    apply_random_wallpaper(0, TRUE);
+}
+
+static void set_all_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata) {
+    note_skip();
+    // Set same random wallpaper on all desktops
+    apply_random_wallpaper(-1, TRUE);
+}
+
+static void randomize_each_desktop_callback(GtkMenuItem *menuitem, gpointer userdata) {
     (void)menuitem;
     (void)userdata;
-    char *default_dir = get_default_wallpaper_directory();
-    char *random_image = get_random_image_from_directory(default_dir);
+
+    note_skip();
+    randomize_each_desktop(TRUE);
+}
+
+// Apply a random library image. An empty pick while the catalog is still
+// being filled is retried when the scan lands; only a scan that found
+// nothing is reported.
+static void apply_random_wallpaper(int desktop_index, gboolean report_empty) {
+    char *library_dir = get_library_directory();
+    char *random_image = get_random_image_from_directory(library_dir);
 
     if (random_image != NULL) {
-        // Set random wallpaper on current desktop (desktop 0)
-        // Note: We use fallback logic, so this should always succeed
-        set_kde_wallpaper_desktop(random_image, 0);
-        free(random_image);
+        submit_apply(random_image, desktop_index);
+        g_free(random_image);
+    } else if (!defer_pick(FALSE, desktop_index, report_empty) && report_empty) {
+        show_no_images_dialog(library_dir);
+    }
+
+    g_free(library_dir);
+}
+
+static void randomize_each_desktop(gboolean report_empty) {
+    // An image fitted to each desktop's screen once the screens are known;
+    // before that one per desktop if the count is, else a fixed pool
+    char *library_dir = get_library_directory();
+    GArray *screens = plasma_peek_screens();
+    GPtrArray *images = NULL;
+    if (screens && screens->len > 0) {
+        images = get_images_for_screens(library_dir, screens);
     } else {
-        // Show error notification for no images
-        GtkWidget *dialog = gtk_message_dialog_new(NULL,
-                                                   GTK_DIALOG_MODAL,
-                                                   GTK_MESSAGE_WARNING,
-                                                   GTK_BUTTONS_OK,
-                                                   "No images found in directory:\n%s\n\nPlease add some images using 'Find Photos'.",
-                                                   default_dir);
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
+        int desktop_count = plasma_peek_desktop_count();
+        guint wanted = desktop_count > 0 ? (guint)desktop_count : RANDOMIZE_POOL_SIZE;
+        images = get_random_images_from_directory(library_dir, wanted);
+    }
+    if (screens) {
+        g_array_free(screens, TRUE);
     }
 
-    free(default_dir);
+    if (images->len > 0) {
+        submit_apply_each_desktop(images);
+    } else {
+        g_ptr_array_free(images, TRUE);
+        if (!defer_pick(TRUE, -1, report_empty) && report_empty) {
+            show_no_images_dialog(library_dir);
+        }
+    }
+
+    g_free(library_dir);
 }
 
-static void set_all_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata) {
-    char *default_dir = get_default_wallpaper_directory();
-    char *random_image = get_random_image_from_directory(default_dir);
+// Remember a pick that came up empty while a scan is filling the catalog,
+// e.g. on a first run or after the library moved. The newest request wins.
+static gboolean defer_pick(gboolean each_desktop, int desktop_index, gboolean report_empty) {
+    if (!catalog_scan_pending && !system_scan_pending) {
+        return FALSE;
+    }
+    pending_pick.active = TRUE;
+    pending_pick.each_desktop = each_desktop;
+    pending_pick.desktop_index = desktop_index;
+    pending_pick.report_empty = report_empty;
+    return TRUE;
+}
 
-    if (random_image != NULL) {
-        // Set same random wallpaper on all desktops
-        set_kde_wallpaper(random_image);
-        free(random_image);
+// A scan landed: make the pick that was waiting for it
+static void run_pending_pick(void) {
+    if (!pending_pick.active) return;
+    pending_pick.active = FALSE;
+
+    if (pending_pick.each_desktop) {
+        randomize_each_desktop(pending_pick.report_empty);
     } else {
-        // Show error notification for no images
-        GtkWidget *dialog = gtk_message_dialog_new(NULL,
-                                                   GTK_DIALOG_MODAL,
-                                                   GTK_MESSAGE_WARNING,
-                                                   GTK_BUTTONS_OK,
-                                                   "No images found in directory:\n%s\n\nPlease add some images using 'Find Photos'.",
-                                                   default_dir);
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
+        apply_random_wallpaper(pending_pick.desktop_index, pending_pick.report_empty);
     }
+}
 
-    free(default_dir);
+static void show_no_images_dialog(const char *library_dir) {
+    GtkWidget *dialog = gtk_message_dialog_new(NULL,
+                                               GTK_DIALOG_MODAL,
+                                               GTK_MESSAGE_WARNING,
+                                               GTK_BUTTONS_OK,
+                                               "No images found in directory:\n%s\n\nPlease add some images using 'Find Photos'.",
+                                               library_dir);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
 }
 
 static void set_selected_wallpaper_callback(GtkMenuItem *menuitem, gpointer userdata) {
@@ -362,7 +889,7 @@ static void set_selected_wallpaper_callback(GtkMenuItem *menuitem, gpointer user
         char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
         if (filename) {
             // Set selected wallpaper on current desktop
-            set_kde_wallpaper_desktop(filename, 0);
+            submit_apply(filename, 0);
             g_free(filename);
         }
     }
@@ -404,7 +931,7 @@ static void set_selected_all_wallpaper_callback(GtkMenuItem *menuitem, gpointer
         char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
         if (filename) {
             // Set selected wallpaper on all desktops
-            set_kde_wallpaper(filename);
+            submit_apply(filename, -1);
             g_free(filename);
         }
     }
@@ -434,7 +961,7 @@ static void about_callback(GtkMenuItem *menuitem, gpointer userdata) {
 
 static void quit_callback(GtkMenuItem *menuitem, gpointer userdata) {
     stop_auto_rotate(); // Stop auto-rotate when quitting
-    gtk_main_quit();
+    g_application_release(G_APPLICATION(app));
 }
 
 static void start_auto_rotate_callback(GtkMenuItem *menuitem, gpointer userdata) {
@@ -450,25 +977,23 @@ static void start_auto_rotate(void) {
         return;
     }
 
-    if (app_config->auto_rotate_enabled && auto_rotate_timer_id != 0) {
+    if (auto_rotate_running()) {
         return;
     }
 
     // Set wallpaper immediately
     set_random_wallpaper_callback(NULL, NULL);
 
-    // Start the timer (interval in milliseconds)
-    auto_rotate_timer_id = g_timeout_add(app_config->auto_rotate_interval * 1000, auto_rotate_timer_callback, NULL);
-    if (auto_rotate_timer_id == 0) {
-        return;
-    }
+    // Ticks pause while the session is locked, idle or short on battery
+    governor_start(get_governor(), (guint)MAX(app_config->auto_rotate_interval, 1));
+
+    // Get the next image ready while the current one is showing
+    schedule_prefetch(0);
 
     app_config->auto_rotate_enabled = TRUE;
 
     // Save configuration
-    char *config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 }
 
 static void stop_auto_rotate(void) {
@@ -480,25 +1005,236 @@ static void stop_auto_rotate(void) {
         return;
     }
 
-    if (auto_rotate_timer_id > 0) {
-        g_source_remove(auto_rotate_timer_id);
-        auto_rotate_timer_id = 0;
+    if (app_governor) {
+        governor_stop(app_governor);
     }
+    cancel_prefetch();
 
     app_config->auto_rotate_enabled = FALSE;
 
     // Save configuration
-    char *config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 }
 
-static gboolean auto_rotate_timer_callback(gpointer data) {
-    // Set random wallpaper
-    set_random_wallpaper_callback(NULL, NULL);
+static Governor* get_governor(void) {
+    static const GovernorHandlers handlers = {
+        auto_rotate_tick,
+        on_system_woke
+    };
 
-    // Return TRUE to continue the timer
-    return TRUE;
+    if (!app_governor) {
+        app_governor = governor_new(&handlers);
+        if (app_config) {
+            governor_set_battery_threshold(app_governor, app_config->pause_on_battery_below);
+        }
+    }
+    return app_governor;
+}
+
+static gboolean auto_rotate_running(void) {
+    return app_governor && governor_is_running(app_governor);
+}
+
+// Governor tick; also the single catch-up change after a pause
+static void auto_rotate_tick(void) {
+    char *image = advance_wallpaper();
+    if (!image) {
+        // Reports the empty library, or waits for the scan filling it
+        set_random_wallpaper_callback(NULL, NULL);
+    }
+    g_free(image);
+}
+
+// The monotonic clock stood still during sleep; the schedule's timer
+// needs re-arming from the wall clock
+static void on_system_woke(void) {
+    if (app_scheduler) {
+        scheduler_reschedule(app_scheduler);
+    }
+}
+
+static void on_system_bus_ready(GObject *source, GAsyncResult *result, gpointer userdata) {
+    (void)source;
+    (void)userdata;
+    GError *error = NULL;
+    GDBusConnection *connection = g_bus_get_finish(result, &error);
+    if (!connection) {
+        log_info("No system bus, auto-rotate won't pause: %s", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    governor_watch(get_governor(), connection);
+    g_object_unref(connection);
+}
+
+// Apply the prefetched image if it is still there, otherwise pick one now.
+// Returns the image, or NULL if the library is empty.
+static char* advance_wallpaper(void) {
+    char *image = prefetched_image;
+    prefetched_image = NULL;
+    if (!image || !g_file_test(image, G_FILE_TEST_EXISTS)) {
+        g_free(image);
+        image = pick_rotation_image(TRUE);
+    } else {
+        commit_rotation_image(image);
+    }
+    if (image) {
+        submit_apply(image, 0);
+    }
+
+    // Start on the one after; a prefetch still running for this tick is
+    // stale. Only auto-rotate uses it, so `dp next` alone doesn't warm one.
+    prefetch_generation++;
+    if (auto_rotate_running()) {
+        schedule_prefetch(0);
+    }
+    return image;
+}
+
+// Pick the next auto-rotate image and warm it up on the I/O worker
+static void schedule_prefetch(guint attempt) {
+    char *image = pick_rotation_image(FALSE);
+    if (!image) return;
+
+    PrefetchRequest *request = g_new0(PrefetchRequest, 1);
+    request->image_path = image;
+    request->generation = prefetch_generation;
+    request->attempt = attempt;
+    worker_submit(WORKER_LANE_IO, prefetch_request_run, prefetch_request_done, request, prefetch_request_free);
+}
+
+// Forget the prefetched image; results still in flight are ignored
+static void cancel_prefetch(void) {
+    prefetch_generation++;
+    g_free(prefetched_image);
+    prefetched_image = NULL;
+}
+
+// Auto-rotate's next image: from the active schedule slot if there is
+// one, otherwise from the library. A prefetch only peeks at the slot, so
+// a prefetched image that is never shown doesn't use up its turn.
+static char* pick_rotation_image(gboolean advance) {
+    TimeSlot *slot = app_scheduler ? scheduler_get_active_slot(app_scheduler, NULL) : NULL;
+    char *image = NULL;
+    if (slot) {
+        image = advance ? scheduler_next_image(slot) : scheduler_peek_image(slot);
+    }
+    if (!image) {
+        char *library_dir = get_library_directory();
+        image = get_random_image_from_directory(library_dir);
+        g_free(library_dir);
+    }
+    return image;
+}
+
+// A prefetched image is being applied: move its slot on past it, if it is
+// still the slot's next image
+static void commit_rotation_image(const char *image) {
+    TimeSlot *slot = app_scheduler ? scheduler_get_active_slot(app_scheduler, NULL) : NULL;
+    if (!slot) return;
+
+    char *next = scheduler_peek_image(slot);
+    if (g_strcmp0(next, image) == 0) {
+        g_free(scheduler_next_image(slot));
+    }
+    g_free(next);
+}
+
+// Time-of-day schedule from ~/.dp/schedule.ini, when the file exists
+static void start_schedule(void) {
+    char *path = scheduler_get_default_path();
+    GError *error = NULL;
+    app_scheduler = scheduler_load(path, &error);
+    if (app_scheduler) {
+        log_info("Schedule %s: %u slots", path, scheduler_get_slot_count(app_scheduler));
+        scheduler_start(app_scheduler, on_schedule_slot, NULL);
+    } else {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            log_warning("Ignoring schedule %s: %s", path, error->message);
+        }
+        g_error_free(error);
+    }
+    g_free(path);
+}
+
+// A slot began: its next image goes on every desktop, and auto-rotate
+// continues from the slot's images
+static void on_schedule_slot(TimeSlot *slot, gpointer userdata) {
+    (void)userdata;
+    cancel_prefetch();
+
+    char *image = scheduler_next_image(slot);
+    if (image) {
+        submit_apply(image, -1);
+        g_free(image);
+    } else {
+        log_warning("Schedule slot [%s] has no images", slot->name);
+    }
+
+    if (auto_rotate_running()) {
+        schedule_prefetch(0);
+    }
+}
+
+// Runs on the I/O worker: read the file into the page cache, check that it
+// decodes and produce its scaled variant, so the tick only has to apply it
+static void prefetch_request_run(gpointer data, GCancellable *cancellable) {
+    PrefetchRequest *request = data;
+
+    FILE *file = fopen(request->image_path, "rb");
+    if (!file) return;
+
+    char buffer[65536];
+    while (fread(buffer, 1, sizeof(buffer), file) > 0) {
+        if (g_cancellable_is_cancelled(cancellable)) break;
+    }
+    gboolean read_ok = !ferror(file);
+    fclose(file);
+
+    int width = 0, height = 0;
+    if (!read_ok || !gdk_pixbuf_get_file_info(request->image_path, &width, &height) ||
+        width <= 0 || height <= 0) {
+        return;
+    }
+
+    // Variants are only made for images that need one; a failure here means the image won't decode
+    GError *error = NULL;
+    char *variant = scalecache_prepare(request->image_path, &error);
+    if (error) {
+        log_warning("Prefetched image is not usable: %s: %s", request->image_path, error->message);
+        g_error_free(error);
+        return;
+    }
+    g_free(variant);
+
+    request->valid = TRUE;
+}
+
+// Back on the main loop: hold on to the image for the next tick
+static void prefetch_request_done(gpointer data, gboolean cancelled) {
+    PrefetchRequest *request = data;
+
+    if (cancelled || request->generation != prefetch_generation || !auto_rotate_running()) {
+        return;
+    }
+
+    if (!request->valid) {
+        if (request->attempt + 1 < PREFETCH_ATTEMPTS) {
+            schedule_prefetch(request->attempt + 1);
+        }
+        return;
+    }
+
+    g_free(prefetched_image);
+    prefetched_image = request->image_path;
+    request->image_path = NULL;
+}
+
+static void prefetch_request_free(gpointer data) {
+    PrefetchRequest *request = data;
+    g_free(request->image_path);
+    g_free(request);
 }
 
 static void find_photos_callback(GtkMenuItem *menuitem, gpointer userdata) {
@@ -634,11 +1370,6 @@ static void remove_photos_callback(GtkMenuItem *menuitem, gpointer userdata) {
                                                                "%s", message);
                 gtk_dialog_run(GTK_DIALOG(msg_dialog));
                 gtk_widget_destroy(msg_dialog);
-
-                // Save configuration
-                char *config_path = config_get_config_path();
-                config_save(app_config, config_path);
-                g_free(config_path);
             }
 
             // Free the file list
@@ -649,332 +1380,1248 @@ static void remove_photos_callback(GtkMenuItem *menuitem, gpointer userdata) {
     gtk_widget_destroy(dialog);
 }
 
-static void copy_files_to_wallpaper_directory(GSList *file_list) {
-    const char *dest_dir = app_config ? app_config->wallpaper_directory : NULL;
-    if (!dest_dir) {
-        char *fallback_dir = get_default_wallpaper_directory();
-        dest_dir = fallback_dir;
+static void find_similar_callback(GtkMenuItem *menuitem, gpointer userdata) {
+    (void)menuitem;
+    (void)userdata;
+
+    if (!app_config || similar_scan_pending) return;
+
+    if (app_config->installed_photos->len < 2) {
+        show_task_result("Not enough photos to compare");
+        return;
     }
 
-    int copied_count = 0;
+    // Hash a snapshot of the photo list on the I/O worker
+    SimilarRequest *request = g_new0(SimilarRequest, 1);
+    request->directory = g_strdup(app_config->wallpaper_directory);
+    request->names = g_ptr_array_new_full(app_config->installed_photos->len, g_free);
+    for (guint i = 0; i < app_config->installed_photos->len; i++) {
+        g_ptr_array_add(request->names, g_strdup(g_ptr_array_index(app_config->installed_photos, i)));
+    }
 
-    for (GSList *l = file_list; l != NULL; l = l->next) {
-        const char *src_path = (const char *)l->data;
+    similar_scan_pending = TRUE;
+    worker_submit(WORKER_LANE_IO, similar_request_run, similar_request_done, request, similar_request_free);
+}
 
-        // Get filename from path
-        const char *filename = strrchr(src_path, '/');
-        if (filename) {
-            filename++; // Skip the '/'
-        } else {
-            filename = src_path;
-        }
+// Runs on the I/O worker
+static void similar_request_run(gpointer data, GCancellable *cancellable) {
+    SimilarRequest *request = data;
 
-        // Create destination path
-        char dest_path[2048];
-        snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, filename);
-
-        // Check if file already exists
-        if (access(dest_path, F_OK) == 0) {
-            // File exists, ask to overwrite or skip
-            char new_filename[1024];
-            char *dot = strrchr(filename, '.');
-            if (dot) {
-                // Insert timestamp before extension
-                time_t t = time(NULL);
-                snprintf(new_filename, sizeof(new_filename), "%.*s_%ld%s",
-                        (int)(dot - filename), filename, t, dot);
-                filename = new_filename;
-            } else {
-                // No extension
-                time_t t = time(NULL);
-                snprintf(new_filename, sizeof(new_filename), "%s_%ld", filename, t);
-                filename = new_filename;
-            }
+    GPtrArray *paths = g_ptr_array_new_full(request->names->len, g_free);
+    for (guint i = 0; i < request->names->len; i++) {
+        g_ptr_array_add(paths, g_build_filename(request->directory, g_ptr_array_index(request->names, i), NULL));
+    }
 
-            snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, filename);
-        }
+    begin_task_progress("Comparing", paths->len);
+    request->infos = similar_hash_files(paths, g_get_num_processors(), on_task_progress, NULL, cancellable);
+    g_ptr_array_free(paths, TRUE);
 
-        // Copy file
-        FILE *src = fopen(src_path, "rb");
-        if (src) {
-            FILE *dest = fopen(dest_path, "wb");
-            if (dest) {
-                char buffer[8192];
-                size_t bytes;
-                while ((bytes = fread(buffer, 1, sizeof(buffer), src)) > 0) {
-                    fwrite(buffer, 1, bytes, dest);
-                }
-                fclose(dest);
-                copied_count++;
+    if (!g_cancellable_is_cancelled(cancellable)) {
+        request->clusters = similar_cluster(request->infos, request->names->len, SIMILAR_DEFAULT_THRESHOLD);
+    }
+}
 
-                // Add to configuration
-                if (app_config) {
-                    config_add_photo(app_config, filename);
-                }
+// Back on the main loop: offer to keep the best copy of each group
+static void similar_request_done(gpointer data, gboolean cancelled) {
+    SimilarRequest *request = data;
+    similar_scan_pending = FALSE;
 
-                printf("Copied: %s -> %s\n", src_path, dest_path);
-            } else {
-                printf("Failed to create destination file: %s\n", dest_path);
-            }
-            fclose(src);
-        } else {
-            printf("Failed to open source file: %s\n", src_path);
+    if (cancelled || !request->clusters) return;
+
+    if (request->clusters->len == 0) {
+        show_task_result("No similar photos found");
+        return;
+    }
+    clear_task_label(NULL);
+
+    // Describe every group, largest copy first
+    GString *details = g_string_new(NULL);
+    guint extra_count = 0;
+    for (guint c = 0; c < request->clusters->len; c++) {
+        GArray *members = g_ptr_array_index(request->clusters, c);
+        guint keep = g_array_index(members, guint, 0);
+
+        g_string_append_printf(details, "Keep %s (%dx%d)\n", (char *)g_ptr_array_index(request->names, keep),
+                               request->infos[keep].width, request->infos[keep].height);
+        for (guint i = 0; i < members->len; i++) {
+            guint member = g_array_index(members, guint, i);
+            if (member == keep) continue;
+            g_string_append_printf(details, "    remove %s (%dx%d)\n", (char *)g_ptr_array_index(request->names, member),
+                                   request->infos[member].width, request->infos[member].height);
+            extra_count++;
         }
     }
 
-    // Show success message
-    if (copied_count > 0) {
-        char message[256];
-        snprintf(message, sizeof(message), "Successfully added %d photo%s to wallpaper collection.",
-                copied_count, copied_count == 1 ? "" : "s");
+    GtkWidget *dialog = gtk_message_dialog_new(NULL,
+                                               GTK_DIALOG_MODAL,
+                                               GTK_MESSAGE_QUESTION,
+                                               GTK_BUTTONS_NONE,
+                                               "Found %u group%s of similar photos.\n\nKeep the largest photo of each group and remove the other %u?",
+                                               request->clusters->len, request->clusters->len == 1 ? "" : "s", extra_count);
+    gtk_dialog_add_buttons(GTK_DIALOG(dialog), "_Cancel", GTK_RESPONSE_CANCEL, "_Remove", GTK_RESPONSE_ACCEPT, NULL);
+
+    GtkWidget *text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(text_view), FALSE);
+    gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(text_view)), details->str, -1);
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_widget_set_size_request(scrolled, 480, 240);
+    gtk_container_add(GTK_CONTAINER(scrolled), text_view);
+    gtk_box_pack_start(GTK_BOX(gtk_message_dialog_get_message_area(GTK_MESSAGE_DIALOG(dialog))), scrolled, TRUE, TRUE, 0);
+    gtk_widget_show_all(scrolled);
+    g_string_free(details, TRUE);
 
-        GtkWidget *dialog = gtk_message_dialog_new(NULL,
-                                                   GTK_DIALOG_MODAL,
-                                                   GTK_MESSAGE_INFO,
-                                                   GTK_BUTTONS_OK,
-                                                   "%s", message);
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-    }
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        int removed_count = 0;
 
-    // Cleanup
-    if (!app_config) {
-        free((char*)dest_dir);
-    }
-}
+        for (guint c = 0; c < request->clusters->len; c++) {
+            GArray *members = g_ptr_array_index(request->clusters, c);
+            guint keep = g_array_index(members, guint, 0);
 
-static char* get_random_image_from_directory(const char *directory) {
-    DIR *dir;
-    struct dirent *ent;
-    char **image_files = NULL;
-    int image_count = 0;
-    int image_capacity = 10;
-    
-    // Allocate initial array for image files
-    image_files = malloc(image_capacity * sizeof(char*));
-    
-    // Open directory
-    if ((dir = opendir(directory)) != NULL) {
-        // Read all files in directory
-        while ((ent = readdir(dir)) != NULL) {
-            // Check if file is an image
-            if (is_image_file(ent->d_name)) {
-                // Expand array if needed
-                if (image_count >= image_capacity) {
-                    image_capacity *= 2;
-                    image_files = realloc(image_files, image_capacity * sizeof(char*));
+            for (guint i = 0; i < members->len; i++) {
+                guint member = g_array_index(members, guint, i);
+                if (member == keep) continue;
+
+                const char *filename = g_ptr_array_index(request->names, member);
+                char *path = g_build_filename(request->directory, filename, NULL);
+                if (remove(path) == 0) {
+                    removed_count++;
+                    printf("Removed: %s\n", path);
+                    config_remove_photo(app_config, filename);
+                } else {
+                    printf("Failed to remove: %s\n", path);
                 }
-                
-                // Allocate memory for full path
-                image_files[image_count] = malloc(strlen(directory) + strlen(ent->d_name) + 2);
-                strcpy(image_files[image_count], directory);
-                strcat(image_files[image_count], "/");
-                strcat(image_files[image_count], ent->d_name);
-                
-                image_count++;
+                g_free(path);
             }
         }
-        closedir(dir);
-    } else {
-        // Could not open directory
-        if (image_files) {
-            free(image_files);
+
+        if (removed_count > 0) {
+            char message[128];
+            snprintf(message, sizeof(message), "Removed %d similar photo%s", removed_count, removed_count == 1 ? "" : "s");
+            show_task_result(message);
         }
-        return NULL;
     }
-    
-    // If no images found, return NULL
-    if (image_count == 0) {
-        if (image_files) {
-            free(image_files);
-        }
+
+    gtk_widget_destroy(dialog);
+}
+
+static void similar_request_free(gpointer data) {
+    SimilarRequest *request = data;
+    if (request->clusters) {
+        g_ptr_array_free(request->clusters, TRUE);
+    }
+    g_free(request->infos);
+    g_ptr_array_free(request->names, TRUE);
+    g_free(request->directory);
+    g_free(request);
+}
+
+static void copy_files_to_wallpaper_directory(GSList *file_list) {
+    const char *dest_dir = app_config ? app_config->wallpaper_directory : NULL;
+
+    // Copy on the I/O worker; the library is updated when it finishes
+    ImportRequest *request = g_new0(ImportRequest, 1);
+    request->dest_dir = dest_dir ? g_strdup(dest_dir) : get_default_wallpaper_directory();
+    request->imported = g_ptr_array_new_with_free_func(g_free);
+    for (GSList *l = file_list; l != NULL; l = l->next) {
+        request->files = g_slist_prepend(request->files, g_strdup(l->data));
+    }
+    request->files = g_slist_reverse(request->files);
+
+    worker_submit(WORKER_LANE_IO, import_request_run, import_request_done, request, import_request_free);
+}
+
+// D-Bus Next: the same step as an auto-rotate tick
+static char* service_next(GError **error) {
+    note_skip();
+    char *image = advance_wallpaper();
+    if (!image && (catalog_scan_pending || system_scan_pending)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY, "The wallpaper directory is still being scanned");
+    } else if (!image) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No images in the wallpaper directory");
+    }
+    return image;
+}
+
+// D-Bus Set and SetDesktop: any image file, not only library ones
+static gboolean service_set(const char *image_path, int desktop_index, GError **error) {
+    if (!g_path_is_absolute(image_path) || !g_file_test(image_path, G_FILE_TEST_IS_REGULAR)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No such file: %s", image_path);
+        return FALSE;
+    }
+    if (!catalog_is_image_file(image_path)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Not a supported image: %s", image_path);
+        return FALSE;
+    }
+
+    // Only checked once the desktop count is known; Plasma ignores bad indices anyway
+    int desktop_count = plasma_peek_desktop_count();
+    if (desktop_count > 0 && desktop_index >= desktop_count) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "No desktop %d (there are %d)",
+                    desktop_index + 1, desktop_count);
+        return FALSE;
+    }
+
+    submit_apply(image_path, desktop_index);
+    return TRUE;
+}
+
+// D-Bus Rate: an image, or the current wallpaper for an empty path
+static char* service_rate(const char *image_path, int stars, GError **error) {
+    if (stars < 0 || stars > RATINGS_MAX_STARS) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Ratings go from 1 to %d stars, 0 clears",
+                    RATINGS_MAX_STARS);
         return NULL;
     }
-    
-    // Select random image
-    srand(time(NULL));
-    int random_index = rand() % image_count;
-    
-    // Copy the selected image path
-    char *selected_image = malloc(strlen(image_files[random_index]) + 1);
-    strcpy(selected_image, image_files[random_index]);
-    
-    // Free allocated memory
-    for (int i = 0; i < image_count; i++) {
-        free(image_files[i]);
+
+    const char *image = image_path && *image_path ? image_path : current_image;
+    if (!image) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No wallpaper has been set yet");
+        return NULL;
     }
-    free(image_files);
-    
-    return selected_image;
+    if (!g_path_is_absolute(image)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Not an absolute path: %s", image);
+        return NULL;
+    }
+
+    ratings_set_stars(get_ratings(), image, stars);
+    if (app_selector) {
+        selector_update_weight(app_selector, image);
+    }
+    schedule_ratings_save();
+    return g_strdup(image);
 }
 
-static int is_image_file(const char *filename) {
-    // Get file extension
-    const char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename) return 0;
-    
-    // Check if extension matches supported image formats (case insensitive)
-    const char *ext = dot + 1;
-    return (strcasecmp(ext, "jpg") == 0 || 
-            strcasecmp(ext, "jpeg") == 0 || 
-            strcasecmp(ext, "png") == 0 || 
-            strcasecmp(ext, "bmp") == 0 || 
-            strcasecmp(ext, "gif") == 0);
+// D-Bus Import: one image, or the images directly inside a directory
+static guint service_import(const char *path, GError **error) {
+    GSList *files = NULL;
+
+    if (!g_path_is_absolute(path)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Not an absolute path: %s", path);
+        return 0;
+    }
+
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        GDir *dir = g_dir_open(path, 0, error);
+        if (!dir) {
+            return 0;
+        }
+        const char *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (catalog_is_image_file(name)) {
+                files = g_slist_prepend(files, g_build_filename(path, name, NULL));
+            }
+        }
+        g_dir_close(dir);
+    } else if (g_file_test(path, G_FILE_TEST_IS_REGULAR) && catalog_is_image_file(path)) {
+        files = g_slist_prepend(files, g_strdup(path));
+    } else {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No image or directory at %s", path);
+        return 0;
+    }
+
+    if (!files) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No images in %s", path);
+        return 0;
+    }
+
+    files = g_slist_sort(files, (GCompareFunc)strcmp);
+    guint count = g_slist_length(files);
+    copy_files_to_wallpaper_directory(files);
+    g_slist_free_full(files, g_free);
+    return count;
 }
 
-static int set_kde_wallpaper(const char *image_path) {
-    return set_kde_wallpaper_desktop(image_path, -1); // -1 means all desktops
+// Runs on the I/O worker
+static void import_request_run(gpointer data, GCancellable *cancellable) {
+    ImportRequest *request = data;
+    gint64 start_time = g_get_monotonic_time();
+
+    guint workers = CLAMP(g_get_num_processors(), 2, IMPORT_MAX_WORKERS);
+    begin_task_progress("Importing", g_slist_length(request->files));
+
+    HashIndex *index = get_hash_index(request->dest_dir);
+    GPtrArray *imported = importer_import(request->files, request->dest_dir, index, workers,
+                                          on_task_progress, NULL, &request->duplicates, cancellable);
+    g_ptr_array_free(request->imported, TRUE);
+    request->imported = imported;
+    hashindex_save(index);
+
+    metrics_record_since(METRIC_IMPORT, start_time);
+    metrics_add_items(METRIC_IMPORT, imported->len);
 }
 
-static int set_kde_wallpaper_desktop(const char *image_path, int desktop_index) {
-    // Create error log file
-    char *log_path = NULL;
-    char *home_dir = getenv("HOME");
-    if (home_dir) {
-        log_path = malloc(strlen(home_dir) + strlen("/.dp/error.log") + 1);
-        sprintf(log_path, "%s/.dp/error.log", home_dir);
-    }
-
-    FILE *log_file = log_path ? fopen(log_path, "a") : NULL;
-    if (log_file) {
-        time_t now = time(NULL);
-        fprintf(log_file, "[%s] Setting wallpaper: %s (desktop: %d)\n",
-                ctime(&now), image_path, desktop_index);
-    }
-
-    if (desktop_index == -1) {
-        // Set wallpaper for all desktops (default behavior)
-        char command[1024];
-        snprintf(command, sizeof(command),
-                 "plasma-apply-wallpaperimage '%s' >/dev/null 2>&1",
-                 image_path);
-
-        if (log_file) {
-            fprintf(log_file, "Executing: %s\n", command);
+// Worker side: reset the tray progress for a new background task
+static void begin_task_progress(const char *verb, guint total) {
+    g_atomic_pointer_set(&task_progress_verb, verb);
+    g_atomic_int_set(&task_progress_done, 0);
+    g_atomic_int_set(&task_progress_total, total);
+}
+
+// Pool threads: remember the count and refresh the tray label at most once per main loop pass
+static void on_task_progress(guint done, guint total, gpointer userdata) {
+    (void)userdata;
+    g_atomic_int_set(&task_progress_done, done);
+    g_atomic_int_set(&task_progress_total, total);
+    if (g_atomic_int_compare_and_exchange(&task_progress_pending, 0, 1)) {
+        g_idle_add(update_task_progress, NULL);
+    }
+}
+
+static gboolean update_task_progress(gpointer data) {
+    (void)data;
+    g_atomic_int_set(&task_progress_pending, 0);
+
+    if (app_indicator) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s %d/%d", (const char *)g_atomic_pointer_get(&task_progress_verb),
+                 g_atomic_int_get(&task_progress_done), g_atomic_int_get(&task_progress_total));
+        app_indicator_set_label(app_indicator, label, "Importing 00000/00000");
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Report in the tray label instead of a dialog, then clear it after a while
+static void show_task_result(const char *message) {
+    printf("%s\n", message);
+
+    if (app_indicator) {
+        app_indicator_set_label(app_indicator, message, "Importing 00000/00000");
+        if (task_label_clear_id != 0) {
+            g_source_remove(task_label_clear_id);
         }
+        task_label_clear_id = g_timeout_add_seconds(TASK_LABEL_SECONDS, clear_task_label, NULL);
+    }
+}
 
-        int result = system(command);
+static gboolean clear_task_label(gpointer data) {
+    (void)data;
+    task_label_clear_id = 0;
+    if (app_indicator) {
+        app_indicator_set_label(app_indicator, "", "");
+    }
+    return G_SOURCE_REMOVE;
+}
 
-        if (log_file) {
-            fprintf(log_file, "Result: %d\n", result);
-            fclose(log_file);
+// Back on the main loop: record the new photos and report
+static void import_request_done(gpointer data, gboolean cancelled) {
+    (void)cancelled;
+    ImportRequest *request = data;
+    int copied_count = request->imported->len;
+    int duplicate_count = request->duplicates;
+    int failed_count = g_slist_length(request->files) - copied_count - duplicate_count;
+
+    // Add to configuration
+    if (app_config) {
+        for (guint i = 0; i < request->imported->len; i++) {
+            config_add_photo(app_config, g_ptr_array_index(request->imported, i));
         }
-        free(log_path);
+    }
 
-        return result == 0 ? 0 : -1;
-    } else {
-        // Set wallpaper for specific desktop using D-Bus
-        char command[2048];
-        snprintf(command, sizeof(command),
-                 "qdbus org.kde.plasmashell /PlasmaShell org.kde.PlasmaShell.evaluateScript '"
-                 "var allDesktops = desktops();"
-                 "if (%d < allDesktops.length) {"
-                 "  var desktop = allDesktops[%d];"
-                 "  desktop.wallpaperPlugin = \"org.kde.image\";"
-                 "  desktop.currentConfigGroup = [\"Wallpaper\", \"org.kde.image\", \"General\"];"
-                 "  desktop.writeConfig(\"Image\", \"file://%s\");"
-                 "}' >/dev/null 2>&1",
-                 desktop_index, desktop_index, image_path);
-
-        if (log_file) {
-            fprintf(log_file, "Executing: %s\n", command);
+    // Pre-scale the new photos in the background
+    GPtrArray *images = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < request->imported->len; i++) {
+        g_ptr_array_add(images, g_build_filename(request->dest_dir, g_ptr_array_index(request->imported, i), NULL));
+    }
+    submit_scale(images);
+
+    char message[128];
+    int length = snprintf(message, sizeof(message), "Added %d photo%s", copied_count, copied_count == 1 ? "" : "s");
+    if (duplicate_count > 0 && length < (int)sizeof(message)) {
+        length += snprintf(message + length, sizeof(message) - length, ", %d already in library", duplicate_count);
+    }
+    if (failed_count > 0 && length < (int)sizeof(message)) {
+        snprintf(message + length, sizeof(message) - length, ", %d failed", failed_count);
+    }
+    show_task_result(message);
+}
+
+// The content-hash index for a directory. I/O worker only: the lane runs one
+// job at a time, so the index is never swapped out from under a user.
+static HashIndex* get_hash_index(const char *directory) {
+    if (io_hash_index && g_strcmp0(hashindex_get_directory(io_hash_index), directory) != 0) {
+        hashindex_save(io_hash_index);
+        hashindex_free(io_hash_index);
+        io_hash_index = NULL;
+    }
+
+    if (!io_hash_index) {
+        char *cache_path = hashindex_get_default_path();
+        io_hash_index = hashindex_open(directory, cache_path);
+        g_free(cache_path);
+    }
+
+    return io_hash_index;
+}
+
+// Hash library files that are new or changed since they were last indexed
+static void request_hash_sync(void) {
+    if (!app_catalog) return;
+
+    HashSyncRequest *request = g_new0(HashSyncRequest, 1);
+    request->directory = g_strdup(catalog_get_directory(app_catalog));
+    request->names = g_ptr_array_new_full(catalog_get_count(app_catalog), g_free);
+    for (guint i = 0; i < catalog_get_count(app_catalog); i++) {
+        g_ptr_array_add(request->names, g_strdup(catalog_get_name(app_catalog, i)));
+    }
+
+    worker_submit(WORKER_LANE_IO, hash_sync_request_run, NULL, request, hash_sync_request_free);
+}
+
+// Runs on the I/O worker
+static void hash_sync_request_run(gpointer data, GCancellable *cancellable) {
+    HashSyncRequest *request = data;
+    HashIndex *index = get_hash_index(request->directory);
+
+    GHashTable *present = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < request->names->len; i++) {
+        const char *name = g_ptr_array_index(request->names, i);
+        g_hash_table_add(present, (gpointer)name);
+
+        // Unchanged files cost one stat
+        if (!g_cancellable_is_cancelled(cancellable)) {
+            guint64 hash;
+            hashindex_hash_file(index, name, &hash);
         }
+    }
 
-        int result = system(command);
+    if (!g_cancellable_is_cancelled(cancellable)) {
+        hashindex_prune(index, present);
+    }
+    g_hash_table_destroy(present);
+    hashindex_save(index);
+}
 
-        if (log_file) {
-            fprintf(log_file, "Result: %d\n", result);
+static void hash_sync_request_free(gpointer data) {
+    HashSyncRequest *request = data;
+    g_ptr_array_free(request->names, TRUE);
+    g_free(request->directory);
+    g_free(request);
+}
+
+static void import_request_free(gpointer data) {
+    ImportRequest *request = data;
+    g_slist_free_full(request->files, g_free);
+    g_ptr_array_free(request->imported, TRUE);
+    g_free(request->dest_dir);
+    g_free(request);
+}
+
+// Get the catalog for a directory, reopening it if the directory changed.
+// A stale catalog stays usable while a rescan runs on the I/O worker.
+static Catalog* get_wallpaper_catalog(const char *directory) {
+    if (app_catalog && g_strcmp0(catalog_get_directory(app_catalog), directory) != 0) {
+        catalog_free(app_catalog);
+        app_catalog = NULL;
+    }
+
+    if (!app_catalog) {
+        char *cache_path = catalog_get_cache_path(directory);
+        app_catalog = catalog_open(directory, cache_path);
+        g_free(cache_path);
+        attach_system_layer(app_catalog);
+
+        if (!catalog_is_current(app_catalog)) {
+            request_catalog_scan(directory);
+        }
+    } else if (!app_watcher || g_strcmp0(watcher_get_directory(app_watcher), directory) != 0) {
+        // Without a live watcher, fall back to checking the directory mtime
+        if (!catalog_is_current(app_catalog)) {
+            request_catalog_scan(directory);
         }
+    }
 
-        // If D-Bus fails, try fallback to all-desktops method
-        if (result != 0) {
-            if (log_file) {
-                fprintf(log_file, "D-Bus failed, trying fallback to all-desktops\n");
-            }
+    return app_catalog;
+}
+
+static void request_catalog_scan(const char *directory) {
+    if (catalog_scan_pending) return;
+    catalog_scan_pending = TRUE;
+
+    ScanRequest *request = g_new0(ScanRequest, 1);
+    request->directory = g_strdup(directory);
+    worker_submit(WORKER_LANE_IO, scan_request_run, scan_request_done, request, scan_request_free);
+}
+
+// Runs on the I/O worker with its own catalog instance
+static void scan_request_run(gpointer data, GCancellable *cancellable) {
+    (void)cancellable;
+    ScanRequest *request = data;
+    gint64 start_time = g_get_monotonic_time();
+    char *cache_path = catalog_get_cache_path(request->directory);
+    request->catalog = catalog_open(request->directory, cache_path);
+    catalog_refresh(request->catalog);
+    g_free(cache_path);
+
+    metrics_record_since(METRIC_SCAN, start_time);
+    metrics_add_items(METRIC_SCAN, catalog_get_count(request->catalog));
+
+    guint corrupt = 0;
+    for (guint i = 0; i < catalog_get_count(request->catalog); i++) {
+        if (catalog_is_corrupt(request->catalog, i)) {
+            log_debug("Unreadable image header: %s", catalog_get_name(request->catalog, i));
+            corrupt++;
+        }
+    }
+    if (corrupt > 0) {
+        log_warning("%u files in %s aren't readable images and won't be picked", corrupt, request->directory);
+    }
+}
+
+// Back on the main loop: swap in the fresh catalog
+static void scan_request_done(gpointer data, gboolean cancelled) {
+    ScanRequest *request = data;
+    catalog_scan_pending = FALSE;
+
+    if (cancelled || !request->catalog ||
+        !app_catalog || g_strcmp0(catalog_get_directory(app_catalog), request->directory) != 0) {
+        return;
+    }
+
+    catalog_free(app_catalog);
+    app_catalog = request->catalog;
+    request->catalog = NULL;
+    attach_system_layer(app_catalog);
+
+    if (app_config && g_strcmp0(app_config->wallpaper_directory, request->directory) == 0) {
+        fill_installed_photos_from_catalog(app_catalog);
+    }
+    request_hash_sync();
+
+    // Changes that landed while scanning get another pass
+    if (!catalog_is_current(app_catalog)) {
+        request_catalog_scan(request->directory);
+    }
+    run_pending_pick();
+}
+
+static void scan_request_free(gpointer data) {
+    ScanRequest *request = data;
+    catalog_free(request->catalog);
+    g_free(request->directory);
+    g_free(request);
+}
 
-            char fallback_command[1024];
-            snprintf(fallback_command, sizeof(fallback_command),
-                     "plasma-apply-wallpaperimage '%s' >/dev/null 2>&1",
-                     image_path);
+// Picks cover the library and the bundled wallpapers layered under it, and
+// fit the first desktop's screen once the screens are known
+static char* get_random_image_from_directory(const char *directory) {
+    gint64 start_time = g_get_monotonic_time();
+    Catalog *catalog = get_wallpaper_catalog(directory);
+    guint image_count = catalog_get_visible_count(catalog);
+
+    // If no images found, return NULL
+    if (image_count == 0) {
+        metrics_record_since(METRIC_PICK, start_time);
+        metrics_add_error(METRIC_PICK);
+        return NULL;
+    }
 
-            if (log_file) {
-                fprintf(log_file, "Executing fallback: %s\n", fallback_command);
+    GArray *screens = plasma_peek_screens();
+    char *image = NULL;
+    if (screens && screens->len > 0) {
+        image = pick_image_for_screen(catalog, &g_array_index(screens, PlasmaScreen, 0));
+    } else {
+        image = selector_next(get_selector(catalog));
+    }
+    if (screens) {
+        g_array_free(screens, TRUE);
+    }
+
+    schedule_selector_save();
+    metrics_record_since(METRIC_PICK, start_time);
+    metrics_add_items(METRIC_PICK, 1);
+    return image;
+}
+
+// Pick up to count distinct images, O(count)
+static GPtrArray* get_random_images_from_directory(const char *directory, guint count) {
+    gint64 start_time = g_get_monotonic_time();
+    Catalog *catalog = get_wallpaper_catalog(directory);
+    GPtrArray *images = selector_next_many(get_selector(catalog), count);
+    if (images->len > 0) {
+        schedule_selector_save();
+    }
+
+    metrics_record_since(METRIC_PICK, start_time);
+    metrics_add_items(METRIC_PICK, images->len);
+    return images;
+}
+
+// One image per desktop, each fitted to that desktop's screen and distinct
+// while the library allows
+static GPtrArray* get_images_for_screens(const char *directory, GArray *screens) {
+    gint64 start_time = g_get_monotonic_time();
+    Catalog *catalog = get_wallpaper_catalog(directory);
+    GPtrArray *images = g_ptr_array_new_with_free_func(g_free);
+    if (catalog_get_visible_count(catalog) == 0) {
+        metrics_record_since(METRIC_PICK, start_time);
+        return images;
+    }
+
+    GHashTable *picked = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < screens->len; i++) {
+        const PlasmaScreen *screen = &g_array_index(screens, PlasmaScreen, i);
+        char *image = pick_image_for_screen(catalog, screen);
+        if (image && g_hash_table_contains(picked, image)) {
+            char *retry = pick_image_for_screen(catalog, screen);
+            if (retry) {
+                g_free(image);
+                image = retry;
             }
+        }
+        if (!image) break;
+        g_hash_table_add(picked, image);
+        g_ptr_array_add(images, image);
+    }
+    g_hash_table_destroy(picked);
+
+    schedule_selector_save();
+    metrics_record_since(METRIC_PICK, start_time);
+    metrics_add_items(METRIC_PICK, images->len);
+    return images;
+}
+
+typedef struct {
+    Catalog *catalog;
+    const PlasmaScreen *screen;
+} ScreenMatch;
+
+// Images the catalog has no size for fit anywhere
+static gboolean image_fits_screen(const char *image_path, gpointer userdata) {
+    const ScreenMatch *match = userdata;
+    int width = 0, height = 0;
+    if (!catalog_lookup_dimensions(match->catalog, image_path, &width, &height)) {
+        return TRUE;
+    }
+    return catalog_image_fits(width, height, match->screen->width, match->screen->height);
+}
 
-            result = system(fallback_command);
+// The rotation policy's pick among the images that fit the screen. When
+// few do, a random one of those; when none do, one of the closest.
+static char* pick_image_for_screen(Catalog *catalog, const PlasmaScreen *screen) {
+    Selector *selector = get_selector(catalog);
+    if (screen->width <= 0 || screen->height <= 0) {
+        return selector_next(selector);
+    }
 
-            if (log_file) {
-                fprintf(log_file, "Fallback result: %d\n", result);
+    ScreenMatch match = { catalog, screen };
+    char *image = selector_next_matching(selector, image_fits_screen, &match, SCREEN_MATCH_TRIES);
+    if (image) {
+        return image;
+    }
+
+    GArray *matches = catalog_find_fitting(catalog, screen->width, screen->height);
+    if (matches->len == 0) {
+        g_array_free(matches, TRUE);
+        matches = catalog_find_closest(catalog, screen->width, screen->height);
+    }
+    if (matches->len == 0) {
+        g_array_free(matches, TRUE);
+        return selector_next(selector);
+    }
+
+    log_debug("No pick fit screen %d (%dx%d), using one of %u from the catalog",
+              screen->screen, screen->width, screen->height, matches->len);
+    guint index = g_array_index(matches, guint, g_random_int_range(0, (gint32)matches->len));
+    g_array_free(matches, TRUE);
+    return catalog_get_visible_path(catalog, index);
+}
+
+// The selector follows the visible images. Library and layer changes are
+// merged in at the next pick, which keeps the shuffle cycle where it was.
+static Selector* get_selector(Catalog *catalog) {
+    if (!app_selector) {
+        char *cache_path = selector_get_default_path();
+        app_selector = selector_open(cache_path);
+        g_free(cache_path);
+        selector_set_weight_func(app_selector, get_image_weight, NULL);
+        weights_refresh_time = g_get_monotonic_time();
+    }
+    selector_set_mode(app_selector, app_config ? app_config->rotation_policy : SELECTOR_MODE_SHUFFLE);
+
+    if (selector_stale) {
+        guint count = catalog_get_visible_count(catalog);
+        GPtrArray *paths = g_ptr_array_new_full(count, g_free);
+        for (guint i = 0; i < count; i++) {
+            if (!catalog_is_visible_corrupt(catalog, i)) {
+                g_ptr_array_add(paths, catalog_get_visible_path(catalog, i));
             }
         }
+        selector_sync(app_selector, paths);
+        g_ptr_array_free(paths, TRUE);
+        selector_stale = FALSE;
+    }
+
+    // Shows and skips wear off, so weights drift without any new events
+    if (selector_get_mode(app_selector) == SELECTOR_MODE_WEIGHTED &&
+        g_get_monotonic_time() - weights_refresh_time > (gint64)WEIGHT_REFRESH_SECONDS * G_USEC_PER_SEC) {
+        selector_refresh_weights(app_selector);
+        weights_refresh_time = g_get_monotonic_time();
+    }
+
+    return app_selector;
+}
+
+// A tick and its prefetch pick back to back; save once they settle
+static void schedule_selector_save(void) {
+    if (selector_save_id != 0) {
+        g_source_remove(selector_save_id);
+    }
+    selector_save_id = g_timeout_add_seconds(2, save_selector_timeout, NULL);
+}
 
-        if (log_file) {
-            fclose(log_file);
+static gboolean save_selector_timeout(gpointer data) {
+    (void)data;
+    selector_save_id = 0;
+    if (app_selector) {
+        selector_save(app_selector);
+    }
+    return FALSE;
+}
+
+static Ratings* get_ratings(void) {
+    if (!app_ratings) {
+        char *path = ratings_get_default_path();
+        app_ratings = ratings_open(path);
+        g_free(path);
+    }
+    return app_ratings;
+}
+
+// Weight of an image for weighted picks
+static double get_image_weight(const char *image_path, gpointer userdata) {
+    (void)userdata;
+    return ratings_get_weight(get_ratings(), image_path, g_get_real_time() / G_USEC_PER_SEC);
+}
+
+// Count the first count images as shown
+static void note_images_shown(GPtrArray *images, guint count) {
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    for (guint i = 0; i < count && i < images->len; i++) {
+        const char *image = g_ptr_array_index(images, i);
+        ratings_record_show(get_ratings(), image, now);
+        if (app_selector) {
+            selector_update_weight(app_selector, image);
+        }
+    }
+    schedule_ratings_save();
+}
+
+// Asking for another random wallpaper right after one appeared counts against it
+static void note_skip(void) {
+    if (!current_image || current_image_skipped ||
+        g_get_monotonic_time() - current_image_time > (gint64)SKIP_WINDOW_SECONDS * G_USEC_PER_SEC) {
+        return;
+    }
+
+    ratings_record_skip(get_ratings(), current_image, g_get_real_time() / G_USEC_PER_SEC);
+    if (app_selector) {
+        selector_update_weight(app_selector, current_image);
+    }
+    current_image_skipped = TRUE;
+    schedule_ratings_save();
+}
+
+static void schedule_ratings_save(void) {
+    if (ratings_save_id != 0) {
+        g_source_remove(ratings_save_id);
+    }
+    ratings_save_id = g_timeout_add_seconds(2, save_ratings_timeout, NULL);
+}
+
+static gboolean save_ratings_timeout(gpointer data) {
+    (void)data;
+    ratings_save_id = 0;
+    if (app_ratings) {
+        ratings_save(app_ratings);
+    }
+    return FALSE;
+}
+
+// Queue an apply on the worker; a newer apply replaces one still waiting
+static void submit_apply(const char *image_path, int desktop_index) {
+    ApplyRequest *request = g_new0(ApplyRequest, 1);
+    request->images = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(request->images, g_strdup(image_path));
+    request->desktop_index = desktop_index;
+
+    worker_submit(WORKER_LANE_APPLY, apply_request_run, apply_request_done, request, apply_request_free);
+}
+
+// Queue a per-desktop apply (takes ownership of images)
+static void submit_apply_each_desktop(GPtrArray *images) {
+    ApplyRequest *request = g_new0(ApplyRequest, 1);
+    request->images = images;
+    request->desktop_index = -1;
+    request->each_desktop = TRUE;
+
+    worker_submit(WORKER_LANE_APPLY, apply_request_run, apply_request_done, request, apply_request_free);
+}
+
+// Runs on the apply worker
+static void apply_request_run(gpointer data, GCancellable *cancellable) {
+    ApplyRequest *request = data;
+
+    // Learn the screen layout once so later picks can fit it. Cached, and
+    // after a failure only re-queried once monitors change or plasmashell
+    // answers again.
+    GArray *screens = plasma_get_screens(NULL);
+    if (screens) {
+        g_array_free(screens, TRUE);
+    }
+
+    // A newer apply may have superseded this one while the screens were
+    // queried; past this point the apply happens and is reported as done
+    if (g_cancellable_is_cancelled(cancellable)) return;
+
+    if (!request->each_desktop) {
+        request->applied = set_kde_wallpaper_desktop(g_ptr_array_index(request->images, 0),
+                                                     request->desktop_index) == 0;
+        return;
+    }
+
+    // Desktop count is cached after the first query, so this is usually free
+    int desktop_count = plasma_get_desktop_count(NULL);
+    if (desktop_count <= 0) {
+        request->applied = set_kde_wallpaper(g_ptr_array_index(request->images, 0)) == 0;
+        return;
+    }
+
+    // Distinct images while the pool is large enough, then wrap around
+    PlasmaAssignment *assignments = g_new(PlasmaAssignment, desktop_count);
+    for (int i = 0; i < desktop_count; i++) {
+        assignments[i].desktop_index = i;
+        assignments[i].image_path = g_ptr_array_index(request->images, i % request->images->len);
+    }
+    request->applied = set_kde_wallpaper_batch(assignments, desktop_count) == 0;
+    g_free(assignments);
+}
+
+// Back on the main loop: prepare variants so the next apply of these images
+// is cheap. A job cancelled after it reached Plasma still changed the
+// wallpaper, so history follows what was applied, not the cancel flag.
+static void apply_request_done(gpointer data, gboolean cancelled) {
+    (void)cancelled;
+    ApplyRequest *request = data;
+    if (!request->applied) return;
+
+    // History for weighted picks; a pool for Randomize Each Desktop may
+    // hold more images than there are desktops
+    guint shown = 1;
+    if (request->each_desktop) {
+        int desktop_count = plasma_peek_desktop_count();
+        shown = desktop_count > 0 ? MIN(request->images->len, (guint)desktop_count) : 1;
+    }
+    note_images_shown(request->images, shown);
+    if (request->desktop_index <= 0) {
+        g_free(current_image);
+        current_image = g_strdup(g_ptr_array_index(request->images, 0));
+        current_image_time = g_get_monotonic_time();
+        current_image_skipped = FALSE;
+    }
+
+    GPtrArray *images = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < request->images->len; i++) {
+        g_ptr_array_add(images, g_strdup(g_ptr_array_index(request->images, i)));
+    }
+    submit_scale(images);
+}
+
+static void apply_request_free(gpointer data) {
+    ApplyRequest *request = data;
+    g_ptr_array_free(request->images, TRUE);
+    g_free(request);
+}
+
+// Queue variant generation on the I/O worker (takes ownership of images)
+static void submit_scale(GPtrArray *images) {
+    if (images->len == 0) {
+        g_ptr_array_free(images, TRUE);
+        return;
+    }
+
+    ScaleRequest *request = g_new0(ScaleRequest, 1);
+    request->images = images;
+    worker_submit(WORKER_LANE_IO, scale_request_run, NULL, request, scale_request_free);
+}
+
+// Runs on the I/O worker
+static void scale_request_run(gpointer data, GCancellable *cancellable) {
+    ScaleRequest *request = data;
+
+    for (guint i = 0; i < request->images->len; i++) {
+        if (g_cancellable_is_cancelled(cancellable)) break;
+
+        GError *error = NULL;
+        char *variant = scalecache_prepare(g_ptr_array_index(request->images, i), &error);
+        if (error) {
+            log_warning("Failed to prepare scaled wallpaper for %s: %s",
+                        (char *)g_ptr_array_index(request->images, i), error->message);
+            g_error_free(error);
         }
-        free(log_path);
+        g_free(variant);
+    }
+    scalecache_save();
+}
+
+static void scale_request_free(gpointer data) {
+    ScaleRequest *request = data;
+    g_ptr_array_free(request->images, TRUE);
+    g_free(request);
+}
 
-        return result == 0 ? 0 : -1;
+// Size variants for the largest monitor, in device pixels
+static void update_scale_target(void) {
+    GdkDisplay *display = gdk_display_get_default();
+    if (!display) return;
+
+    int width = 0, height = 0;
+    int old_width, old_height;
+    scalecache_get_target(&old_width, &old_height);
+    for (int i = 0; i < gdk_display_get_n_monitors(display); i++) {
+        GdkMonitor *monitor = gdk_display_get_monitor(display, i);
+        GdkRectangle geometry;
+        gdk_monitor_get_geometry(monitor, &geometry);
+        int scale = gdk_monitor_get_scale_factor(monitor);
+        width = MAX(width, geometry.width * scale);
+        height = MAX(height, geometry.height * scale);
+    }
+
+    scalecache_set_target(width, height);
+
+    // Variants for the old size are dead weight now; the first call at
+    // startup prunes whatever built up last time
+    if (width != old_width || height != old_height) {
+        worker_submit(WORKER_LANE_IO, scale_prune_run, NULL, NULL, NULL);
+    }
+}
+
+// Runs on the I/O worker
+static void scale_prune_run(gpointer data, GCancellable *cancellable) {
+    (void)data;
+    (void)cancellable;
+    guint removed = scalecache_prune();
+    if (removed > 0) {
+        log_info("Removed %u scaled wallpapers from the cache", removed);
     }
 }
 
+static void on_monitors_changed(GdkDisplay *display, GdkMonitor *monitor, gpointer userdata) {
+    (void)display;
+    (void)monitor;
+    (void)userdata;
+    update_scale_target();
+
+    // Plasma's screen geometry is re-read at the next apply
+    plasma_forget_screens();
+}
+
+static int set_kde_wallpaper(const char *image_path) {
+    return set_kde_wallpaper_desktop(image_path, -1); // -1 means all desktops
+}
+
+static int set_kde_wallpaper_desktop(const char *image_path, int desktop_index) {
+    gint64 apply_start = g_get_monotonic_time();
+    log_info("Setting wallpaper: %s (desktop: %d)", image_path, desktop_index);
+
+    // Hand plasmashell the pre-scaled variant when there is one
+    char *variant = scalecache_lookup(image_path);
+    if (variant) {
+        log_debug("Using scaled variant: %s", variant);
+        image_path = variant;
+    }
+
+    // Ask plasmashell directly over our D-Bus connection
+    GError *error = NULL;
+    gint64 start_time = g_get_monotonic_time();
+    gboolean success = plasma_set_wallpaper(image_path, desktop_index, &error);
+
+    log_write(success ? LOG_LEVEL_INFO : LOG_LEVEL_WARNING, "D-Bus evaluateScript: %s (%.1f ms)",
+              success ? "ok" : error->message,
+              (g_get_monotonic_time() - start_time) / 1000.0);
+
+    // If D-Bus fails, try fallback to the all-desktops tool
+    if (!success) {
+        g_clear_error(&error);
+        log_info("D-Bus failed, trying fallback to all-desktops");
+
+        start_time = g_get_monotonic_time();
+        success = plasma_apply_wallpaper_tool(image_path, &error);
+
+        log_write(success ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR, "Fallback result: %s (%.1f ms)",
+                  success ? "ok" : error->message,
+                  (g_get_monotonic_time() - start_time) / 1000.0);
+        g_clear_error(&error);
+    }
+
+    g_free(variant);
+    record_apply(apply_start, desktop_index < 0 ? (guint)MAX(plasma_peek_desktop_count(), 1) : 1, success);
+
+    return success ? 0 : -1;
+}
+
+// Time an apply; items count the desktops it covered
+static void record_apply(gint64 start_time, guint desktops, gboolean success) {
+    metrics_record_since(METRIC_APPLY, start_time);
+    metrics_add_items(METRIC_APPLY, desktops);
+    if (!success) {
+        metrics_add_error(METRIC_APPLY);
+    }
+}
+
+// Apply several desktops at once in a single Plasma round trip
+static int set_kde_wallpaper_batch(const PlasmaAssignment *assignments, guint count) {
+    gint64 apply_start = g_get_monotonic_time();
+    log_info("Setting wallpapers for %u desktops", count);
+    for (guint i = 0; i < count; i++) {
+        log_info("  desktop %d: %s", assignments[i].desktop_index, assignments[i].image_path);
+    }
+
+    // Swap in pre-scaled variants where they exist
+    PlasmaAssignment *scaled = g_new(PlasmaAssignment, count);
+    GPtrArray *variants = g_ptr_array_new_with_free_func(g_free);
+    for (guint i = 0; i < count; i++) {
+        char *variant = scalecache_lookup(assignments[i].image_path);
+        scaled[i] = assignments[i];
+        if (variant) {
+            scaled[i].image_path = variant;
+            g_ptr_array_add(variants, variant);
+        }
+    }
+
+    GError *error = NULL;
+    gint64 start_time = g_get_monotonic_time();
+    gboolean success = plasma_apply_batch(scaled, count, &error);
+    g_free(scaled);
+    g_ptr_array_free(variants, TRUE);
+
+    log_write(success ? LOG_LEVEL_INFO : LOG_LEVEL_WARNING, "D-Bus evaluateScript: %s (%.1f ms)",
+              success ? "ok" : error->message,
+              (g_get_monotonic_time() - start_time) / 1000.0);
+    g_clear_error(&error);
+    record_apply(apply_start, count, success);
+
+    // Fall back to a single image everywhere if the batch couldn't be applied
+    if (!success && count > 0) {
+        return set_kde_wallpaper(assignments[0].image_path);
+    }
+
+    return success ? 0 : -1;
+}
+
 // Update installed photos from directory scan
 static void update_installed_photos_from_directory(void) {
     if (!app_config) return;
 
+    // The watcher keeps the photo list in sync while it is running
+    if (app_watcher && g_strcmp0(watcher_get_directory(app_watcher), app_config->wallpaper_directory) == 0) {
+        return;
+    }
+
+    // Fill from the catalog; if it's stale, a background rescan refills it
+    fill_installed_photos_from_catalog(get_wallpaper_catalog(app_config->wallpaper_directory));
+    request_hash_sync();
+
+    // Follow further changes incrementally
+    watcher_free(app_watcher);
+    app_watcher = watcher_new(app_config->wallpaper_directory, on_library_changed, NULL);
+}
+
+static void fill_installed_photos_from_catalog(Catalog *catalog) {
     // Clear existing photos
-    g_ptr_array_set_size(app_config->installed_photos, 0);
+    config_clear_photos(app_config);
+
+    for (guint i = 0; i < catalog_get_count(catalog); i++) {
+        config_add_photo(app_config, catalog_get_name(catalog, i));
+    }
+}
 
-    // Scan directory for images
-    DIR *dir = opendir(app_config->wallpaper_directory);
-    if (!dir) return;
+// Apply a single change in the wallpaper directory to the photo list and catalog
+static void on_library_changed(WatcherEventType type, const char *name, const char *new_name, gpointer userdata) {
+    (void)userdata;
+    if (!app_config) return;
+
+    Catalog *catalog = NULL;
+    if (app_catalog && g_strcmp0(catalog_get_directory(app_catalog), app_config->wallpaper_directory) == 0) {
+        catalog = app_catalog;
+    }
+
+    gboolean changed = FALSE;
+    guint visible_before = catalog ? catalog_get_visible_count(catalog) : 0;
+    switch (type) {
+        case WATCHER_EVENT_ADDED:
+            config_add_photo(app_config, name);
+            changed = catalog ? catalog_add(catalog, name) : FALSE;
+            if (changed) update_selector(catalog, name, TRUE, visible_before);
+            break;
+        case WATCHER_EVENT_REMOVED:
+            config_remove_photo(app_config, name);
+            changed = catalog ? catalog_remove(catalog, name) : FALSE;
+            if (changed) update_selector(catalog, name, FALSE, visible_before);
+            break;
+        case WATCHER_EVENT_RENAMED:
+            config_remove_photo(app_config, name);
+            config_add_photo(app_config, new_name);
+            changed = catalog ? catalog_rename(catalog, name, new_name) : FALSE;
+            if (changed) rename_in_selector(catalog, name, new_name);
+            rename_rating(name, new_name);
+            break;
+    }
 
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-        if (is_image_file(ent->d_name)) {
-            config_add_photo(app_config, ent->d_name);
+    // Bursts of changes (e.g. an import) are written out once they settle
+    if (changed) {
+        if (catalog_save_id != 0) {
+            g_source_remove(catalog_save_id);
         }
+        catalog_save_id = g_timeout_add_seconds(2, save_catalog_timeout, NULL);
     }
-    closedir(dir);
 }
 
-// Copy default wallpapers from data/wallpaper to user directory
-static void install_default_wallpapers(void) {
-    if (!app_config->use_default_wallpapers) return;
+// A renamed image keeps its stars and history
+static void rename_rating(const char *name, const char *new_name) {
+    char *old_path = g_build_filename(app_config->wallpaper_directory, name, NULL);
+    char *new_path = g_build_filename(app_config->wallpaper_directory, new_name, NULL);
+    ratings_rename(get_ratings(), old_path, new_path);
+    schedule_ratings_save();
+    g_free(new_path);
+    g_free(old_path);
+}
 
-    const char *default_wallpaper_dir = "/opt/dp/dp/data/wallpaper";
-    const char *user_wallpaper_dir = app_config->wallpaper_directory;
+// Apply one library change to the selector without a resync. An unchanged
+// visible count means the name shadowed, or uncovered, a bundled image.
+static void update_selector(Catalog *catalog, const char *name, gboolean added, guint visible_before) {
+    if (!app_selector || selector_stale) return;
+
+    // Files whose header can't be read are never picked
+    int width = 0, height = 0;
+    char *path = g_build_filename(catalog_get_directory(catalog), name, NULL);
+    if (added) {
+        if (catalog_lookup_dimensions(catalog, path, &width, &height)) {
+            selector_add(app_selector, path);
+        }
+    } else {
+        selector_remove(app_selector, path);
+    }
+    g_free(path);
+
+    const Catalog *lower = catalog_get_lower(catalog);
+    if (lower && catalog_get_visible_count(catalog) == visible_before) {
+        char *lower_path = g_build_filename(catalog_get_directory(lower), name, NULL);
+        if (added) {
+            selector_remove(app_selector, lower_path);
+        } else if (catalog_lookup_dimensions(catalog, lower_path, &width, &height)) {
+            selector_add(app_selector, lower_path);
+        }
+        g_free(lower_path);
+    }
+}
 
-    // Check if default wallpapers exist
-    if (!g_file_test(default_wallpaper_dir, G_FILE_TEST_IS_DIR)) {
-        return;
+// Apply a rename to the selector without a resync. The image keeps its
+// slot, so whether it was shown this cycle survives the rename.
+static void rename_in_selector(Catalog *catalog, const char *name, const char *new_name) {
+    if (!app_selector || selector_stale) return;
+
+    int width = 0, height = 0;
+    char *old_path = g_build_filename(catalog_get_directory(catalog), name, NULL);
+    char *new_path = g_build_filename(catalog_get_directory(catalog), new_name, NULL);
+    if (!catalog_lookup_dimensions(catalog, new_path, &width, &height)) {
+        selector_remove(app_selector, old_path);
+    } else if (!selector_rename(app_selector, old_path, new_path)) {
+        selector_add(app_selector, new_path);
+    }
+    g_free(new_path);
+    g_free(old_path);
+
+    // The old name no longer shadows a bundled image; the new one may
+    const Catalog *lower = catalog_get_lower(catalog);
+    if (lower) {
+        char *lower_path = g_build_filename(catalog_get_directory(lower), name, NULL);
+        if (catalog_lookup_dimensions(catalog, lower_path, &width, &height)) {
+            selector_add(app_selector, lower_path);
+        }
+        g_free(lower_path);
+        lower_path = g_build_filename(catalog_get_directory(lower), new_name, NULL);
+        selector_remove(app_selector, lower_path);
+        g_free(lower_path);
     }
+}
 
-    // Create user directory if needed
-    if (g_mkdir_with_parents(user_wallpaper_dir, 0755) != 0) {
-        return;
+static gboolean save_catalog_timeout(gpointer data) {
+    (void)data;
+    catalog_save_id = 0;
+    if (app_catalog) {
+        catalog_save(app_catalog);
+        request_hash_sync();
     }
+    return FALSE;
+}
 
-    // Copy all wallpaper files
-    DIR *dir = opendir(default_wallpaper_dir);
-    if (!dir) return;
+// Layer the bundled wallpapers under the library if enabled, and rescan
+// them in the background if their directory changed
+static void load_default_wallpapers(void) {
+    if (app_catalog) {
+        attach_system_layer(app_catalog);
+    }
+    if (!app_config->use_default_wallpapers || system_scan_pending) return;
 
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-        if (is_image_file(ent->d_name)) {
-            char src_path[PATH_MAX];
-            char dst_path[PATH_MAX];
-            snprintf(src_path, sizeof(src_path), "%s/%s", default_wallpaper_dir, ent->d_name);
-            snprintf(dst_path, sizeof(dst_path), "%s/%s", user_wallpaper_dir, ent->d_name);
+    if (!catalog_is_current(get_system_catalog())) {
+        system_scan_pending = TRUE;
+        ScanRequest *request = g_new0(ScanRequest, 1);
+        request->directory = g_strdup(SYSTEM_WALLPAPER_DIR);
+        worker_submit(WORKER_LANE_IO, system_scan_request_run, system_scan_request_done, request, scan_request_free);
+    }
+}
 
-            // Only copy if destination doesn't exist
-            if (!g_file_test(dst_path, G_FILE_TEST_EXISTS)) {
-                g_file_copy(g_file_new_for_path(src_path),
-                           g_file_new_for_path(dst_path),
-                           G_FILE_COPY_NONE, NULL, NULL, NULL, NULL);
-            }
-        }
+// Catalog of the bundled wallpapers, cached per user like the library's
+static Catalog* get_system_catalog(void) {
+    if (!system_catalog) {
+        char *cache_path = get_system_catalog_path();
+        system_catalog = catalog_open(SYSTEM_WALLPAPER_DIR, cache_path);
+        g_free(cache_path);
+    }
+    return system_catalog;
+}
+
+static char* get_system_catalog_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "cache", "system-catalog.bin", NULL);
+}
+
+// Show or hide the bundled wallpapers in a library catalog
+static void attach_system_layer(Catalog *catalog) {
+    if (app_config && app_config->use_default_wallpapers) {
+        catalog_set_lower(catalog, get_system_catalog());
+    } else {
+        catalog_set_lower(catalog, NULL);
+    }
+    selector_stale = TRUE;
+}
+
+// Runs on the I/O worker
+static void system_scan_request_run(gpointer data, GCancellable *cancellable) {
+    (void)cancellable;
+    ScanRequest *request = data;
+    char *cache_path = get_system_catalog_path();
+    request->catalog = catalog_open(request->directory, cache_path);
+    catalog_refresh(request->catalog);
+    g_free(cache_path);
+}
+
+// Back on the main loop: swap in the new system layer
+static void system_scan_request_done(gpointer data, gboolean cancelled) {
+    ScanRequest *request = data;
+    system_scan_pending = FALSE;
+    if (cancelled || !request->catalog) return;
+
+    // The library catalog points into the old one
+    if (app_catalog) {
+        catalog_set_lower(app_catalog, NULL);
+    }
+    catalog_free(system_catalog);
+    system_catalog = request->catalog;
+    request->catalog = NULL;
+    if (app_catalog) {
+        attach_system_layer(app_catalog);
     }
-    closedir(dir);
+    run_pending_pick();
 }
 
 // Toggle default wallpapers callback
@@ -982,16 +2629,45 @@ static void toggle_default_wallpapers_callback(GtkMenuItem *menuitem, gpointer u
     if (!app_config) return;
     app_config->use_default_wallpapers = gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(menuitem));
 
-    // If enabled, install wallpapers now
-    if (app_config->use_default_wallpapers) {
-        install_default_wallpapers();
-        update_installed_photos_from_directory();
-    }
+    // Show or hide them in picks right away
+    load_default_wallpapers();
+    cancel_prefetch();
 
     // Save config
-    char *config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
+}
+
+// Rotation policy radio items; the next pick uses the new policy
+static void rotation_policy_callback(GtkCheckMenuItem *menuitem, gpointer userdata) {
+    if (!app_config || !gtk_check_menu_item_get_active(menuitem)) return;
+    app_config->rotation_policy = (SelectorMode)GPOINTER_TO_INT(userdata);
+
+    // The prefetched image was chosen under the old policy
+    cancel_prefetch();
+
+    // Save config
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
+}
+
+// Rating submenu items carry their star count
+static void rate_current_callback(GtkMenuItem *menuitem, gpointer userdata) {
+    (void)menuitem;
+    int stars = GPOINTER_TO_INT(userdata);
+    GError *error = NULL;
+    char *image = service_rate("", stars, &error);
+    if (!image) {
+        show_task_result(error->message);
+        g_error_free(error);
+        return;
+    }
+
+    char *name = g_path_get_basename(image);
+    char *message = stars > 0 ? g_strdup_printf("Rated %s %d/%d", name, stars, RATINGS_MAX_STARS)
+                              : g_strdup_printf("Cleared the rating of %s", name);
+    show_task_result(message);
+    g_free(message);
+    g_free(name);
+    g_free(image);
 }
 
 // Toggle boot screen callback
@@ -1000,9 +2676,7 @@ static void toggle_boot_screen_callback(GtkMenuItem *menuitem, gpointer userdata
     app_config->boot_screen_enabled = gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(menuitem));
 
     // Save config
-    char *config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 }
 
 // Set boot screen to random callback
@@ -1014,9 +2688,7 @@ static void set_boot_screen_random_callback(GtkMenuItem *menuitem, gpointer user
     app_config->boot_screen_image = NULL;
 
     // Save config
-    char *config_path = config_get_config_path();
-    config_save(app_config, config_path);
-    g_free(config_path);
+    config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 
     // Show confirmation
     GtkWidget *dialog = gtk_message_dialog_new(NULL,
@@ -1069,9 +2741,7 @@ static void set_boot_screen_selected_callback(GtkMenuItem *menuitem, gpointer us
             app_config->boot_screen_image = g_strdup(filename);
 
             // Save config
-            char *config_path = config_get_config_path();
-            config_save(app_config, config_path);
-            g_free(config_path);
+            config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 
             // Show confirmation
             GtkWidget *msg_dialog = gtk_message_dialog_new(NULL,
@@ -1167,11 +2837,12 @@ static void show_configuration_dialog(void) {
         }
 
         app_config->auto_rotate_interval = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(interval_spin));
+        if (auto_rotate_running()) {
+            governor_set_interval(app_governor, (guint)app_config->auto_rotate_interval);
+        }
 
         // Save configuration
-        char *config_path = config_get_config_path();
-        config_save(app_config, config_path);
-        g_free(config_path);
+        config_mark_dirty(app_config, CONFIG_DIRTY_SETTINGS);
 
         // Update installed photos
         update_installed_photos_from_directory();
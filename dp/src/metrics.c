@@ -0,0 +1,202 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+// Values below METRICS_SUB_BUCKETS microseconds get a bucket each; above
+// that, every power of two is split into METRICS_SUB_BUCKETS / 2 buckets.
+#define METRICS_SUB_BITS 5
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_BITS 36             // ~19 hours; longer values are clamped
+#define METRICS_BUCKETS (METRICS_SUB_BUCKETS + (METRICS_MAX_BITS - METRICS_SUB_BITS) * (METRICS_SUB_BUCKETS / 2))
+
+// The call count is the sum of the buckets
+typedef struct {
+    gint errors;
+    gint items;
+    gsize sum;                          // Microseconds
+    gint max;                           // Microseconds, clamped to G_MAXINT
+    gint buckets[METRICS_BUCKETS];
+} Metric;
+
+static Metric metrics[METRIC_COUNT];
+static gint64 metrics_start_time = 0;
+
+static const char *metric_names[METRIC_COUNT] = {
+    "apply", "pick", "scan", "import", "config_load", "config_save", "startup"
+};
+
+// Percentiles reported, in tenths of a percent
+static const struct {
+    const char *key;
+    int permille;
+} percentiles[] = {
+    { "p50_us", 500 }, { "p90_us", 900 }, { "p99_us", 990 }, { "p999_us", 999 }
+};
+
+void metrics_init(void) {
+    metrics_start_time = g_get_monotonic_time();
+}
+
+const char* metrics_get_name(MetricId id) {
+    return metric_names[id];
+}
+
+static guint metrics_bucket_index(guint64 value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return (guint)value;
+    }
+    if (value >= (G_GUINT64_CONSTANT(1) << METRICS_MAX_BITS)) {
+        return METRICS_BUCKETS - 1;
+    }
+
+    // The top METRICS_SUB_BITS bits select the bucket within this power of two
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (METRICS_SUB_BITS - 1);
+    guint mantissa = (guint)(value >> shift) - METRICS_SUB_BUCKETS / 2;
+    return METRICS_SUB_BUCKETS + (shift - 1) * (METRICS_SUB_BUCKETS / 2) + mantissa;
+}
+
+// Highest value that lands in a bucket
+static guint64 metrics_bucket_limit(guint index) {
+    if (index < METRICS_SUB_BUCKETS) {
+        return index;
+    }
+
+    guint offset = index - METRICS_SUB_BUCKETS;
+    int shift = (int)(offset / (METRICS_SUB_BUCKETS / 2)) + 1;
+    guint64 mantissa = offset % (METRICS_SUB_BUCKETS / 2) + METRICS_SUB_BUCKETS / 2;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void metrics_record(MetricId id, gint64 usec) {
+    Metric *metric = &metrics[id];
+    guint64 value = usec > 0 ? (guint64)usec : 0;
+
+    g_atomic_int_inc(&metric->buckets[metrics_bucket_index(value)]);
+    g_atomic_pointer_add(&metric->sum, (gssize)value);
+
+    gint clamped = (gint)MIN(value, (guint64)G_MAXINT);
+    gint max = g_atomic_int_get(&metric->max);
+    while (clamped > max && !g_atomic_int_compare_and_exchange(&metric->max, max, clamped)) {
+        max = g_atomic_int_get(&metric->max);
+    }
+}
+
+void metrics_record_since(MetricId id, gint64 start_time) {
+    metrics_record(id, g_get_monotonic_time() - start_time);
+}
+
+void metrics_add_items(MetricId id, guint items) {
+    g_atomic_int_add(&metrics[id].items, (gint)items);
+}
+
+void metrics_add_error(MetricId id) {
+    g_atomic_int_inc(&metrics[id].errors);
+}
+
+// Value at or below which permille/1000 of the samples fall. Reported as
+// the bucket's upper limit, but never above the largest value seen.
+static guint64 metrics_percentile(const gint *buckets, guint64 total, guint64 max, int permille) {
+    if (total == 0) {
+        return 0;
+    }
+
+    guint64 rank = (total * (guint64)permille + 999) / 1000;
+    guint64 seen = 0;
+    guint i = 0;
+    for (; i < METRICS_BUCKETS - 1; i++) {
+        seen += (guint)buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return MIN(metrics_bucket_limit(i), max);
+}
+
+GVariant* metrics_snapshot(void) {
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sa{st}}"));
+
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        Metric *metric = &metrics[id];
+
+        // Copy the buckets first so the percentiles match the count
+        gint buckets[METRICS_BUCKETS];
+        guint64 total = 0;
+        for (guint i = 0; i < METRICS_BUCKETS; i++) {
+            buckets[i] = g_atomic_int_get(&metric->buckets[i]);
+            total += (guint)buckets[i];
+        }
+
+        guint64 max = (guint64)g_atomic_int_get(&metric->max);
+
+        GVariantBuilder values;
+        g_variant_builder_init(&values, G_VARIANT_TYPE("a{st}"));
+        g_variant_builder_add(&values, "{st}", "count", total);
+        g_variant_builder_add(&values, "{st}", "errors", (guint64)(guint)g_atomic_int_get(&metric->errors));
+        g_variant_builder_add(&values, "{st}", "items", (guint64)(guint)g_atomic_int_get(&metric->items));
+        g_variant_builder_add(&values, "{st}", "sum_us", (guint64)(gsize)g_atomic_pointer_get(&metric->sum));
+        g_variant_builder_add(&values, "{st}", "max_us", max);
+        for (guint p = 0; p < G_N_ELEMENTS(percentiles); p++) {
+            g_variant_builder_add(&values, "{st}", percentiles[p].key,
+                                  metrics_percentile(buckets, total, max, percentiles[p].permille));
+        }
+        g_variant_builder_add(&builder, "{sa{st}}", metric_names[id], &values);
+    }
+
+    // Lets readers turn counts into rates
+    guint64 uptime = metrics_start_time ? (guint64)(g_get_monotonic_time() - metrics_start_time) : 0;
+    GVariantBuilder process;
+    g_variant_builder_init(&process, G_VARIANT_TYPE("a{st}"));
+    g_variant_builder_add(&process, "{st}", "uptime_us", uptime);
+    g_variant_builder_add(&builder, "{sa{st}}", "process", &process);
+
+    return g_variant_builder_end(&builder);
+}
+
+static guint64 metrics_lookup(GVariant *values, const char *key) {
+    guint64 value = 0;
+    g_variant_lookup(values, key, "t", &value);
+    return value;
+}
+
+// Duration with a unit that keeps it short
+static void metrics_append_duration(GString *out, guint64 usec) {
+    if (usec < 1000) {
+        g_string_append_printf(out, " %8" G_GUINT64_FORMAT "us", usec);
+    } else if (usec < 1000000) {
+        g_string_append_printf(out, " %8.1fms", usec / 1000.0);
+    } else {
+        g_string_append_printf(out, " %8.2fs ", usec / 1000000.0);
+    }
+}
+
+char* metrics_format(GVariant *snapshot) {
+    GString *out = g_string_new(NULL);
+    g_string_append_printf(out, "%-12s %8s %6s %8s %10s %10s %10s %10s %10s\n",
+                           "metric", "count", "errors", "items", "p50", "p90", "p99", "p99.9", "max");
+
+    GVariantIter iter;
+    const char *name;
+    GVariant *values;
+    g_variant_iter_init(&iter, snapshot);
+    while (g_variant_iter_next(&iter, "{&s@a{st}}", &name, &values)) {
+        if (strcmp(name, "process") == 0) {
+            g_string_append_printf(out, "uptime %.0f s\n", metrics_lookup(values, "uptime_us") / 1000000.0);
+        } else {
+            g_string_append_printf(out, "%-12s %8" G_GUINT64_FORMAT " %6" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT,
+                                   name, metrics_lookup(values, "count"),
+                                   metrics_lookup(values, "errors"), metrics_lookup(values, "items"));
+            metrics_append_duration(out, metrics_lookup(values, "p50_us"));
+            metrics_append_duration(out, metrics_lookup(values, "p90_us"));
+            metrics_append_duration(out, metrics_lookup(values, "p99_us"));
+            metrics_append_duration(out, metrics_lookup(values, "p999_us"));
+            metrics_append_duration(out, metrics_lookup(values, "max_us"));
+            g_string_append_c(out, '\n');
+        }
+        g_variant_unref(values);
+    }
+
+    return g_string_free(out, FALSE);
+}
@@ -0,0 +1,351 @@
+#include "plasma.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gio/gio.h>
+
+#define PLASMA_BUS_NAME       "org.kde.plasmashell"
+#define PLASMA_OBJECT_PATH    "/PlasmaShell"
+#define PLASMA_INTERFACE      "org.kde.PlasmaShell"
+#define PLASMA_CALL_TIMEOUT_MS 10000
+
+static GDBusConnection *plasma_connection = NULL;
+static GMutex plasma_lock;
+static int plasma_desktop_count = 0;
+static GArray *plasma_screens = NULL;    // PlasmaScreen per desktop, once queried
+static gboolean plasma_screens_failed = FALSE;  // Last query failed; don't ask again yet
+static PlasmaScriptHandler script_handler = NULL;
+static gpointer script_handler_data = NULL;
+
+// Get the shared session bus connection, reconnecting if it was closed
+static GDBusConnection* plasma_get_connection(GError **error) {
+    g_mutex_lock(&plasma_lock);
+
+    if (plasma_connection && g_dbus_connection_is_closed(plasma_connection)) {
+        g_object_unref(plasma_connection);
+        plasma_connection = NULL;
+    }
+    if (!plasma_connection) {
+        plasma_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, error);
+    }
+
+    GDBusConnection *connection = plasma_connection ? g_object_ref(plasma_connection) : NULL;
+    g_mutex_unlock(&plasma_lock);
+    return connection;
+}
+
+// Route scripts to handler instead of plasmashell (NULL restores D-Bus)
+void plasma_set_script_handler(PlasmaScriptHandler handler, gpointer user_data) {
+    g_mutex_lock(&plasma_lock);
+    script_handler = handler;
+    script_handler_data = user_data;
+    g_mutex_unlock(&plasma_lock);
+}
+
+// Run a script in plasmashell. Output (from print()) is returned if requested.
+gboolean plasma_evaluate_script(const char *script, char **output, GError **error) {
+    g_mutex_lock(&plasma_lock);
+    PlasmaScriptHandler handler = script_handler;
+    gpointer handler_data = script_handler_data;
+    g_mutex_unlock(&plasma_lock);
+    if (handler) {
+        return handler(script, output, error, handler_data);
+    }
+
+    GDBusConnection *connection = plasma_get_connection(error);
+    if (!connection) {
+        return FALSE;
+    }
+
+    GVariant *reply = g_dbus_connection_call_sync(connection,
+                                                  PLASMA_BUS_NAME,
+                                                  PLASMA_OBJECT_PATH,
+                                                  PLASMA_INTERFACE,
+                                                  "evaluateScript",
+                                                  g_variant_new("(s)", script),
+                                                  NULL,
+                                                  G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                                  PLASMA_CALL_TIMEOUT_MS,
+                                                  NULL,
+                                                  error);
+    g_object_unref(connection);
+
+    if (!reply) {
+        return FALSE;
+    }
+
+    // plasmashell answers again, so a failed screen query is worth retrying
+    g_mutex_lock(&plasma_lock);
+    plasma_screens_failed = FALSE;
+    g_mutex_unlock(&plasma_lock);
+
+    if (output) {
+        const char *text = "";
+        if (g_variant_is_of_type(reply, G_VARIANT_TYPE("(s)"))) {
+            g_variant_get(reply, "(&s)", &text);
+        }
+        *output = g_strdup(text);
+    }
+
+    g_variant_unref(reply);
+    return TRUE;
+}
+
+// Append a double-quoted JavaScript string literal
+static void append_js_string(GString *script, const char *value) {
+    g_string_append_c(script, '"');
+    for (const char *p = value; *p; p++) {
+        switch (*p) {
+            case '"':  g_string_append(script, "\\\""); break;
+            case '\\': g_string_append(script, "\\\\"); break;
+            case '\n': g_string_append(script, "\\n"); break;
+            case '\r': g_string_append(script, "\\r"); break;
+            default:   g_string_append_c(script, *p); break;
+        }
+    }
+    g_string_append_c(script, '"');
+}
+
+// Build the script that points one desktop (or all of them) at an image
+char* plasma_build_wallpaper_script(const char *image_path, int desktop_index) {
+    char *uri = g_filename_to_uri(image_path, NULL, NULL);
+    if (!uri) {
+        return NULL;
+    }
+
+    GString *script = g_string_new("var image = ");
+    append_js_string(script, uri);
+    g_string_append(script, ";\nvar allDesktops = desktops();\n");
+
+    if (desktop_index < 0) {
+        g_string_append(script, "for (var i = 0; i < allDesktops.length; i++) {\n"
+                                "  var desktop = allDesktops[i];\n");
+    } else {
+        g_string_append_printf(script, "if (%d < allDesktops.length) {\n"
+                                       "  var desktop = allDesktops[%d];\n",
+                               desktop_index, desktop_index);
+    }
+    g_string_append(script, "  desktop.wallpaperPlugin = \"org.kde.image\";\n"
+                            "  desktop.currentConfigGroup = [\"Wallpaper\", \"org.kde.image\", \"General\"];\n"
+                            "  desktop.writeConfig(\"Image\", image);\n"
+                            "}\n");
+
+    g_free(uri);
+    return g_string_free(script, FALSE);
+}
+
+gboolean plasma_set_wallpaper(const char *image_path, int desktop_index, GError **error) {
+    char *script = plasma_build_wallpaper_script(image_path, desktop_index);
+    if (!script) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid image path: %s", image_path);
+        return FALSE;
+    }
+
+    gboolean success = plasma_evaluate_script(script, NULL, error);
+    g_free(script);
+    return success;
+}
+
+// Build one script that assigns every (desktop, image) pair and reports
+// the desktop count, so the cached count stays current for free
+char* plasma_build_batch_script(const PlasmaAssignment *assignments, guint count) {
+    GString *script = g_string_new("var assignments = [\n");
+
+    for (guint i = 0; i < count; i++) {
+        char *uri = g_filename_to_uri(assignments[i].image_path, NULL, NULL);
+        if (!uri) {
+            g_string_free(script, TRUE);
+            return NULL;
+        }
+        g_string_append_printf(script, "  [%d, ", assignments[i].desktop_index);
+        append_js_string(script, uri);
+        g_string_append(script, "],\n");
+        g_free(uri);
+    }
+
+    g_string_append(script, "];\n"
+                            "var allDesktops = desktops();\n"
+                            "for (var i = 0; i < assignments.length; i++) {\n"
+                            "  if (assignments[i][0] >= allDesktops.length) continue;\n"
+                            "  var desktop = allDesktops[assignments[i][0]];\n"
+                            "  desktop.wallpaperPlugin = \"org.kde.image\";\n"
+                            "  desktop.currentConfigGroup = [\"Wallpaper\", \"org.kde.image\", \"General\"];\n"
+                            "  desktop.writeConfig(\"Image\", assignments[i][1]);\n"
+                            "}\n"
+                            "print(allDesktops.length);\n");
+
+    return g_string_free(script, FALSE);
+}
+
+static void plasma_update_desktop_count(const char *output) {
+    int count = output ? atoi(output) : 0;
+    if (count > 0) {
+        g_mutex_lock(&plasma_lock);
+        plasma_desktop_count = count;
+        g_mutex_unlock(&plasma_lock);
+    }
+}
+
+// Apply several desktops in a single evaluateScript round trip
+gboolean plasma_apply_batch(const PlasmaAssignment *assignments, guint count, GError **error) {
+    char *script = plasma_build_batch_script(assignments, count);
+    if (!script) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid image path in batch");
+        return FALSE;
+    }
+
+    char *output = NULL;
+    gboolean success = plasma_evaluate_script(script, &output, error);
+    if (success) {
+        plasma_update_desktop_count(output);
+    }
+
+    g_free(output);
+    g_free(script);
+    return success;
+}
+
+// Number of Plasma desktops. Queried once, then kept current by batch applies.
+int plasma_get_desktop_count(GError **error) {
+    int count = plasma_peek_desktop_count();
+    if (count > 0) {
+        return count;
+    }
+
+    char *output = NULL;
+    if (!plasma_evaluate_script("print(desktops().length);", &output, error)) {
+        return -1;
+    }
+    plasma_update_desktop_count(output);
+    g_free(output);
+
+    count = plasma_peek_desktop_count();
+    return count > 0 ? count : -1;
+}
+
+// Cached desktop count without querying plasmashell (0 if not known yet)
+int plasma_peek_desktop_count(void) {
+    g_mutex_lock(&plasma_lock);
+    int count = plasma_desktop_count;
+    g_mutex_unlock(&plasma_lock);
+    return count;
+}
+
+// Every desktop with its screen's geometry, one "desktop screen width
+// height;" record each
+static const char *screens_script =
+    "var allDesktops = desktops();\n"
+    "for (var i = 0; i < allDesktops.length; i++) {\n"
+    "  var screen = allDesktops[i].screen;\n"
+    "  var rect = screen >= 0 ? screenGeometry(screen) : null;\n"
+    "  print(i + \" \" + screen + \" \" + (rect ? rect.width : 0) + \" \" + (rect ? rect.height : 0) + \";\");\n"
+    "}\n";
+
+GArray* plasma_parse_screens(const char *output) {
+    GArray *screens = g_array_new(FALSE, FALSE, sizeof(PlasmaScreen));
+    char **records = g_strsplit(output ? output : "", ";", -1);
+    for (char **record = records; *record; record++) {
+        PlasmaScreen screen;
+        if (sscanf(*record, "%d %d %d %d", &screen.desktop_index, &screen.screen,
+                   &screen.width, &screen.height) == 4 && screen.desktop_index >= 0) {
+            g_array_append_val(screens, screen);
+        }
+    }
+    g_strfreev(records);
+    return screens;
+}
+
+static GArray* copy_screens(const GArray *screens) {
+    GArray *copy = g_array_sized_new(FALSE, FALSE, sizeof(PlasmaScreen), screens->len);
+    g_array_append_vals(copy, screens->data, screens->len);
+    return copy;
+}
+
+// Each desktop's screen size. Queried once, then cached until
+// plasma_forget_screens(). A failed query isn't repeated until then either,
+// or until plasmashell answers another script, so callers on every apply
+// don't wait out the call timeout each time. Caller frees; NULL on failure.
+GArray* plasma_get_screens(GError **error) {
+    GArray *screens = plasma_peek_screens();
+    if (screens) {
+        return screens;
+    }
+
+    g_mutex_lock(&plasma_lock);
+    gboolean failed = plasma_screens_failed;
+    g_mutex_unlock(&plasma_lock);
+    if (failed) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Screens unknown; the last query failed");
+        return NULL;
+    }
+
+    char *output = NULL;
+    if (!plasma_evaluate_script(screens_script, &output, error)) {
+        g_mutex_lock(&plasma_lock);
+        plasma_screens_failed = TRUE;
+        g_mutex_unlock(&plasma_lock);
+        return NULL;
+    }
+    screens = plasma_parse_screens(output);
+    g_free(output);
+
+    g_mutex_lock(&plasma_lock);
+    if (plasma_screens) {
+        g_array_free(plasma_screens, TRUE);
+    }
+    plasma_screens = copy_screens(screens);
+    if (screens->len > 0) {
+        plasma_desktop_count = (int)screens->len;
+    }
+    g_mutex_unlock(&plasma_lock);
+    return screens;
+}
+
+// Cached screens without querying plasmashell (NULL if not known yet)
+GArray* plasma_peek_screens(void) {
+    g_mutex_lock(&plasma_lock);
+    GArray *screens = plasma_screens ? copy_screens(plasma_screens) : NULL;
+    g_mutex_unlock(&plasma_lock);
+    return screens;
+}
+
+// Drop the cached screens, e.g. after monitors were added or removed
+void plasma_forget_screens(void) {
+    g_mutex_lock(&plasma_lock);
+    plasma_screens_failed = FALSE;
+    if (plasma_screens) {
+        g_array_free(plasma_screens, TRUE);
+        plasma_screens = NULL;
+    }
+    g_mutex_unlock(&plasma_lock);
+}
+
+// Fallback for when plasmashell isn't reachable over D-Bus. The path is
+// passed as an argument vector, so no shell quoting is involved.
+gboolean plasma_apply_wallpaper_tool(const char *image_path, GError **error) {
+    char *argv[] = { "plasma-apply-wallpaperimage", (char *)image_path, NULL };
+    int wait_status = 0;
+
+    if (!g_spawn_sync(NULL, argv, NULL,
+                      G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, NULL, NULL, &wait_status, error)) {
+        return FALSE;
+    }
+
+    return g_spawn_check_wait_status(wait_status, error);
+}
+
+void plasma_shutdown(void) {
+    g_mutex_lock(&plasma_lock);
+    if (plasma_connection) {
+        g_object_unref(plasma_connection);
+        plasma_connection = NULL;
+    }
+    plasma_desktop_count = 0;
+    plasma_screens_failed = FALSE;
+    if (plasma_screens) {
+        g_array_free(plasma_screens, TRUE);
+        plasma_screens = NULL;
+    }
+    g_mutex_unlock(&plasma_lock);
+}
@@ -0,0 +1,218 @@
+#include "ratings.h"
+#include "binfile.h"
+#include "log.h"
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define RATINGS_MAGIC   0x54525044u  // "DPRT"
+#define RATINGS_VERSION 1
+
+// History below this no longer affects the weight and isn't saved
+#define RATINGS_HISTORY_EPSILON 0.01
+
+// A skip counts for this many shows
+#define RATINGS_SKIP_PENALTY 2.0
+
+// On-disk records; paths live in the binfile pool
+typedef struct {
+    double shows;
+    double skips;
+    gint64 shows_time;
+    gint64 skips_time;
+    guint32 stars;
+    guint32 path_offset;
+    guint32 path_length;
+    guint32 reserved;
+} RatingsRecord;
+
+static const BinfileFormat ratings_format = {
+    RATINGS_MAGIC, RATINGS_VERSION, 0, sizeof(RatingsRecord)
+};
+
+typedef struct {
+    char *path;
+    int stars;
+    double shows;           // Decayed count as of shows_time
+    double skips;
+    gint64 shows_time;
+    gint64 skips_time;
+} RatingsEntry;
+
+struct _Ratings {
+    char *path;
+    GHashTable *entries;    // Image path -> RatingsEntry
+    gboolean dirty;
+};
+
+static void entry_free(gpointer data) {
+    RatingsEntry *entry = data;
+    g_free(entry->path);
+    g_free(entry);
+}
+
+// Counter value at time now
+static double decayed(double value, gint64 since, gint64 now, double half_life) {
+    if (value <= 0 || now <= since) {
+        return value;
+    }
+    return value * exp2(-(double)(now - since) / half_life);
+}
+
+static RatingsEntry* ratings_lookup(Ratings *ratings, const char *image_path, gboolean create) {
+    RatingsEntry *entry = g_hash_table_lookup(ratings->entries, image_path);
+    if (!entry && create) {
+        entry = g_new0(RatingsEntry, 1);
+        entry->path = g_strdup(image_path);
+        g_hash_table_insert(ratings->entries, entry->path, entry);
+    }
+    return entry;
+}
+
+static gboolean ratings_load(Ratings *ratings) {
+    BinfileView view;
+    char *data = binfile_load(&ratings_format, ratings->path, &view);
+    if (!data) {
+        return FALSE;
+    }
+
+    const RatingsRecord *records = view.records;
+    for (guint32 i = 0; i < view.count; i++) {
+        const char *path = binfile_string(&view, records[i].path_offset, records[i].path_length);
+        if (!path) {
+            break;
+        }
+
+        RatingsEntry *entry = ratings_lookup(ratings, path, TRUE);
+        entry->stars = (int)MIN(records[i].stars, RATINGS_MAX_STARS);
+        entry->shows = records[i].shows;
+        entry->skips = records[i].skips;
+        entry->shows_time = records[i].shows_time;
+        entry->skips_time = records[i].skips_time;
+    }
+
+    g_free(data);
+    return TRUE;
+}
+
+Ratings* ratings_open(const char *path) {
+    Ratings *ratings = g_new0(Ratings, 1);
+    ratings->path = g_strdup(path);
+    ratings->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, entry_free);
+
+    ratings_load(ratings);
+    return ratings;
+}
+
+void ratings_free(Ratings *ratings) {
+    if (!ratings) return;
+
+    g_hash_table_destroy(ratings->entries);
+    g_free(ratings->path);
+    g_free(ratings);
+}
+
+// Write the ratings if anything changed. Unrated images whose history has
+// worn off are left out.
+gboolean ratings_save(Ratings *ratings) {
+    if (!ratings->dirty) {
+        return TRUE;
+    }
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    GArray *records = g_array_sized_new(FALSE, TRUE, sizeof(RatingsRecord), g_hash_table_size(ratings->entries));
+    GString *paths = g_string_sized_new(4096);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, ratings->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        RatingsEntry *entry = value;
+        double shows = decayed(entry->shows, entry->shows_time, now, RATINGS_SHOW_HALF_LIFE);
+        double skips = decayed(entry->skips, entry->skips_time, now, RATINGS_SKIP_HALF_LIFE);
+        if (entry->stars == 0 && shows < RATINGS_HISTORY_EPSILON && skips < RATINGS_HISTORY_EPSILON) {
+            continue;
+        }
+
+        RatingsRecord record = {0};
+        record.shows = entry->shows;
+        record.skips = entry->skips;
+        record.shows_time = entry->shows_time;
+        record.skips_time = entry->skips_time;
+        record.stars = (guint32)entry->stars;
+        record.path_offset = binfile_pool_append(paths, entry->path, &record.path_length);
+        g_array_append_val(records, record);
+    }
+
+    GError *error = NULL;
+    gboolean success = binfile_save(&ratings_format, ratings->path, NULL, records->data, records->len,
+                                    paths->str, paths->len, &error);
+    if (success) {
+        ratings->dirty = FALSE;
+    } else {
+        log_warning("Failed to save ratings %s: %s", ratings->path, error->message);
+        g_error_free(error);
+    }
+
+    g_array_free(records, TRUE);
+    g_string_free(paths, TRUE);
+    return success;
+}
+
+void ratings_set_stars(Ratings *ratings, const char *image_path, int stars) {
+    stars = CLAMP(stars, 0, RATINGS_MAX_STARS);
+    RatingsEntry *entry = ratings_lookup(ratings, image_path, stars != 0);
+    if (!entry || entry->stars == stars) return;
+
+    entry->stars = stars;
+    ratings->dirty = TRUE;
+}
+
+int ratings_get_stars(const Ratings *ratings, const char *image_path) {
+    const RatingsEntry *entry = g_hash_table_lookup(ratings->entries, image_path);
+    return entry ? entry->stars : 0;
+}
+
+void ratings_record_show(Ratings *ratings, const char *image_path, gint64 now) {
+    RatingsEntry *entry = ratings_lookup(ratings, image_path, TRUE);
+    entry->shows = decayed(entry->shows, entry->shows_time, now, RATINGS_SHOW_HALF_LIFE) + 1;
+    entry->shows_time = now;
+    ratings->dirty = TRUE;
+}
+
+void ratings_record_skip(Ratings *ratings, const char *image_path, gint64 now) {
+    RatingsEntry *entry = ratings_lookup(ratings, image_path, TRUE);
+    entry->skips = decayed(entry->skips, entry->skips_time, now, RATINGS_SKIP_HALF_LIFE) + 1;
+    entry->skips_time = now;
+    ratings->dirty = TRUE;
+}
+
+void ratings_rename(Ratings *ratings, const char *old_path, const char *new_path) {
+    RatingsEntry *entry = g_hash_table_lookup(ratings->entries, old_path);
+    if (!entry) return;
+
+    g_hash_table_steal(ratings->entries, old_path);
+    g_hash_table_remove(ratings->entries, new_path);
+    g_free(entry->path);
+    entry->path = g_strdup(new_path);
+    g_hash_table_insert(ratings->entries, entry->path, entry);
+    ratings->dirty = TRUE;
+}
+
+// Stars scale by powers of two around 3; recent shows and skips divide
+double ratings_get_weight(const Ratings *ratings, const char *image_path, gint64 now) {
+    const RatingsEntry *entry = g_hash_table_lookup(ratings->entries, image_path);
+    if (!entry) {
+        return 1.0;
+    }
+
+    double weight = entry->stars > 0 ? exp2(entry->stars - 3) : 1.0;
+    double shows = decayed(entry->shows, entry->shows_time, now, RATINGS_SHOW_HALF_LIFE);
+    double skips = decayed(entry->skips, entry->skips_time, now, RATINGS_SKIP_HALF_LIFE);
+    return weight / (1.0 + shows + RATINGS_SKIP_PENALTY * skips);
+}
+
+char* ratings_get_default_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "ratings.bin", NULL);
+}
@@ -0,0 +1,461 @@
+#include "scalecache.h"
+#include "binfile.h"
+#include "hash.h"
+#include "imagemeta.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#define SCALECACHE_JPEG_QUALITY "90"
+#define SCALECACHE_SOURCES_MAGIC   0x53535044u  // "DPSS"
+#define SCALECACHE_SOURCES_VERSION 1
+#define SCALECACHE_TEMP_AGE (60 * 60)   // Seconds before a leftover .tmp file is removed
+
+// Content hash of a source file, valid while its size, mtime and inode are
+// unchanged
+typedef struct {
+    gint64 size;
+    gint64 mtime;
+    guint64 inode;
+    guint64 hash;
+} ScalecacheHash;
+
+// On-disk record of the hash memo; source paths live in the binfile pool
+typedef struct {
+    guint64 hash;
+    gint64 size;
+    gint64 mtime;
+    guint64 inode;
+    guint32 path_offset;
+    guint32 path_length;
+} ScalecacheSourcesRecord;
+
+static const BinfileFormat scalecache_sources_format = {
+    SCALECACHE_SOURCES_MAGIC, SCALECACHE_SOURCES_VERSION, 0, sizeof(ScalecacheSourcesRecord)
+};
+
+// A variant on disk, for pruning; its mtime is the last time it was used
+typedef struct {
+    char *path;
+    gint64 size;
+    gint64 used;
+} ScalecacheVariant;
+
+static GMutex scalecache_lock;
+static int target_width = 0;
+static int target_height = 0;
+static GHashTable *hash_memo = NULL;   // Source path -> ScalecacheHash
+static gboolean hash_memo_dirty = FALSE;
+
+void scalecache_set_target(int width, int height) {
+    g_mutex_lock(&scalecache_lock);
+    target_width = width;
+    target_height = height;
+    g_mutex_unlock(&scalecache_lock);
+}
+
+gboolean scalecache_get_target(int *width, int *height) {
+    g_mutex_lock(&scalecache_lock);
+    *width = target_width;
+    *height = target_height;
+    g_mutex_unlock(&scalecache_lock);
+    return *width > 0 && *height > 0;
+}
+
+char* scalecache_get_default_directory(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "cache", "scaled", NULL);
+}
+
+static char* scalecache_get_sources_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "cache", "scaled-sources.bin", NULL);
+}
+
+// Load the memo saved by the last run. Lock held.
+static void scalecache_load_locked(void) {
+    if (hash_memo) return;
+    hash_memo = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    char *path = scalecache_get_sources_path();
+    BinfileView view;
+    char *data = binfile_load(&scalecache_sources_format, path, &view);
+    g_free(path);
+    if (!data) return;
+
+    const ScalecacheSourcesRecord *records = view.records;
+    for (guint32 i = 0; i < view.count; i++) {
+        const char *source = binfile_string(&view, records[i].path_offset, records[i].path_length);
+        if (!source) {
+            break;
+        }
+        ScalecacheHash *entry = g_new(ScalecacheHash, 1);
+        entry->size = records[i].size;
+        entry->mtime = records[i].mtime;
+        entry->inode = records[i].inode;
+        entry->hash = records[i].hash;
+        g_hash_table_replace(hash_memo, g_strdup(source), entry);
+    }
+    g_free(data);
+}
+
+// Write the memo if it changed since it was loaded or last saved
+gboolean scalecache_save(void) {
+    g_mutex_lock(&scalecache_lock);
+    if (!hash_memo || !hash_memo_dirty) {
+        g_mutex_unlock(&scalecache_lock);
+        return TRUE;
+    }
+
+    guint count = g_hash_table_size(hash_memo);
+    GArray *records = g_array_sized_new(FALSE, FALSE, sizeof(ScalecacheSourcesRecord), count);
+    GString *paths = g_string_sized_new(4096);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, hash_memo);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const ScalecacheHash *entry = value;
+        ScalecacheSourcesRecord record = {0};
+        record.hash = entry->hash;
+        record.size = entry->size;
+        record.mtime = entry->mtime;
+        record.inode = entry->inode;
+        record.path_offset = binfile_pool_append(paths, key, &record.path_length);
+        g_array_append_val(records, record);
+    }
+    hash_memo_dirty = FALSE;
+    g_mutex_unlock(&scalecache_lock);
+
+    char *path = scalecache_get_sources_path();
+    GError *error = NULL;
+    gboolean success = binfile_save(&scalecache_sources_format, path, NULL, records->data, records->len,
+                                    paths->str, paths->len, &error);
+    if (!success) {
+        log_warning("Failed to save %s: %s", path, error->message);
+        g_error_free(error);
+
+        g_mutex_lock(&scalecache_lock);
+        hash_memo_dirty = TRUE;
+        g_mutex_unlock(&scalecache_lock);
+    }
+
+    g_free(path);
+    g_array_free(records, TRUE);
+    g_string_free(paths, TRUE);
+    return success;
+}
+
+// Content hash of a source, from the memo while the file is unchanged.
+// Otherwise the file is read and hashed only if compute is set.
+static char* scalecache_hash_file(const char *image_path, gboolean compute) {
+    struct stat st;
+    if (g_stat(image_path, &st) != 0) {
+        return NULL;
+    }
+
+    g_mutex_lock(&scalecache_lock);
+    scalecache_load_locked();
+    ScalecacheHash *entry = g_hash_table_lookup(hash_memo, image_path);
+    char *hash = NULL;
+    if (entry && entry->size == (gint64)st.st_size && entry->mtime == (gint64)st.st_mtime &&
+        entry->inode == (guint64)st.st_ino) {
+        hash = hash_to_string(entry->hash);
+    }
+    g_mutex_unlock(&scalecache_lock);
+
+    guint64 value;
+    if (hash || !compute || !hash_file(image_path, &value, NULL, NULL)) {
+        return hash;
+    }
+
+    entry = g_new(ScalecacheHash, 1);
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->inode = st.st_ino;
+    entry->hash = value;
+
+    g_mutex_lock(&scalecache_lock);
+    g_hash_table_replace(hash_memo, g_strdup(image_path), entry);
+    hash_memo_dirty = TRUE;
+    g_mutex_unlock(&scalecache_lock);
+
+    return hash_to_string(value);
+}
+
+// Whether applying a variant would save plasmashell any work. Only reads
+// the image header.
+gboolean scalecache_wants_variant(const char *image_path) {
+    int width, height;
+    if (!scalecache_get_target(&width, &height)) {
+        return FALSE;
+    }
+
+    ImageMeta meta;
+    if (!imagemeta_read(image_path, &meta, NULL)) {
+        return FALSE;
+    }
+
+    // Uncompressed formats are worth re-encoding even at screen size
+    return meta.format == IMAGE_FORMAT_BMP || meta.width > width || meta.height > height;
+}
+
+// Cache path for a variant; the extension depends on whether it kept an alpha channel
+static char* scalecache_variant_path(const char *hash, int width, int height, const char *extension) {
+    char *directory = scalecache_get_default_directory();
+    char *filename = g_strdup_printf("%s-%dx%d.%s", hash, width, height, extension);
+    char *path = g_build_filename(directory, filename, NULL);
+    g_free(filename);
+    g_free(directory);
+    return path;
+}
+
+// Existing variant for the current target, or NULL to apply the original.
+// Costs a header read and a few stats; an image whose hash isn't known yet
+// is applied as-is rather than hashed here.
+char* scalecache_lookup(const char *image_path) {
+    if (!scalecache_wants_variant(image_path)) {
+        return NULL;
+    }
+
+    int width, height;
+    scalecache_get_target(&width, &height);
+
+    char *hash = scalecache_hash_file(image_path, FALSE);
+    if (!hash) {
+        return NULL;
+    }
+
+    // Touch the variant so pruning sees when it was last used
+    static const char *extensions[] = { "jpg", "png" };
+    char *path = NULL;
+    for (guint i = 0; i < G_N_ELEMENTS(extensions) && !path; i++) {
+        path = scalecache_variant_path(hash, width, height, extensions[i]);
+        if (g_utime(path, NULL) != 0) {
+            g_free(path);
+            path = NULL;
+        }
+    }
+    g_free(hash);
+
+    return path;
+}
+
+// Make sure a variant exists for the current target. Returns its path, or
+// NULL if the original should be applied as-is (or on error).
+char* scalecache_prepare(const char *image_path, GError **error) {
+    char *path = scalecache_lookup(image_path);
+    if (path || !scalecache_wants_variant(image_path)) {
+        return path;
+    }
+
+    int width, height;
+    scalecache_get_target(&width, &height);
+
+    char *hash = scalecache_hash_file(image_path, TRUE);
+    if (!hash) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed to read %s", image_path);
+        return NULL;
+    }
+
+    // Scale to cover the screen, like Plasma's default "Scaled and Cropped"
+    ImageMeta meta;
+    if (!imagemeta_read(image_path, &meta, error)) {
+        g_free(hash);
+        return NULL;
+    }
+    double scale = MAX((double)width / meta.width, (double)height / meta.height);
+    if (scale > 1.0) {
+        scale = 1.0;
+    }
+    int scaled_width = MAX(1, (int)(meta.width * scale + 0.5));
+    int scaled_height = MAX(1, (int)(meta.height * scale + 0.5));
+
+    // Decoders such as libjpeg scale while decoding at this size. They see
+    // the image as stored, so a quarter-turned one is asked for on its side
+    // and rotated afterwards; the variant carries no EXIF of its own.
+    gboolean sideways = meta.orientation >= 5;
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale(image_path,
+                                                          sideways ? scaled_height : scaled_width,
+                                                          sideways ? scaled_width : scaled_height,
+                                                          TRUE, error);
+    if (!pixbuf) {
+        g_free(hash);
+        return NULL;
+    }
+    if (meta.orientation != 1) {
+        GdkPixbuf *oriented = gdk_pixbuf_apply_embedded_orientation(pixbuf);
+        g_object_unref(pixbuf);
+        pixbuf = oriented;
+    }
+
+    gboolean has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+    path = scalecache_variant_path(hash, width, height, has_alpha ? "png" : "jpg");
+    g_free(hash);
+
+    char *directory = g_path_get_dirname(path);
+    g_mkdir_with_parents(directory, 0755);
+    g_free(directory);
+
+    // Write under a temporary name so a half-written variant is never applied
+    char *temp_path = g_strdup_printf("%s.%d.tmp", path, (int)getpid());
+    gboolean saved = has_alpha
+        ? gdk_pixbuf_save(pixbuf, temp_path, "png", error, NULL)
+        : gdk_pixbuf_save(pixbuf, temp_path, "jpeg", error, "quality", SCALECACHE_JPEG_QUALITY, NULL);
+    g_object_unref(pixbuf);
+
+    if (!saved || g_rename(temp_path, path) != 0) {
+        if (saved) {
+            g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_IO, "Failed to store %s", path);
+        }
+        g_unlink(temp_path);
+        g_free(temp_path);
+        g_free(path);
+        return NULL;
+    }
+
+    g_free(temp_path);
+    return path;
+}
+
+static gint compare_variant_use(gconstpointer a, gconstpointer b) {
+    const ScalecacheVariant *x = a, *y = b;
+    return x->used < y->used ? -1 : x->used > y->used;
+}
+
+// Forget sources that are gone or changed and return the hashes of the rest
+static GHashTable* scalecache_live_hashes(void) {
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GArray *entries = g_array_new(FALSE, FALSE, sizeof(ScalecacheHash));
+    g_mutex_lock(&scalecache_lock);
+    scalecache_load_locked();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, hash_memo);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_ptr_array_add(paths, g_strdup(key));
+        g_array_append_val(entries, *(ScalecacheHash *)value);
+    }
+    g_mutex_unlock(&scalecache_lock);
+
+    // Stat without the lock; applies look hashes up meanwhile
+    GHashTable *live = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    GPtrArray *gone = g_ptr_array_new();
+    for (guint i = 0; i < paths->len; i++) {
+        const ScalecacheHash *entry = &g_array_index(entries, ScalecacheHash, i);
+        struct stat st;
+        if (g_stat(g_ptr_array_index(paths, i), &st) == 0 && entry->size == (gint64)st.st_size &&
+            entry->mtime == (gint64)st.st_mtime && entry->inode == (guint64)st.st_ino) {
+            g_hash_table_add(live, hash_to_string(entry->hash));
+        } else {
+            g_ptr_array_add(gone, g_ptr_array_index(paths, i));
+        }
+    }
+
+    if (gone->len > 0) {
+        g_mutex_lock(&scalecache_lock);
+        for (guint i = 0; i < gone->len; i++) {
+            g_hash_table_remove(hash_memo, g_ptr_array_index(gone, i));
+        }
+        hash_memo_dirty = TRUE;
+        g_mutex_unlock(&scalecache_lock);
+    }
+
+    g_ptr_array_free(gone, TRUE);
+    g_array_free(entries, TRUE);
+    g_ptr_array_free(paths, TRUE);
+    return live;
+}
+
+// Remove variants whose source is gone or changed, variants for another
+// target size, variants unused for SCALECACHE_MAX_AGE_DAYS and then the
+// least recently used ones until the cache fits in SCALECACHE_MAX_BYTES.
+// Returns the number of files removed. Reads the directory and stats
+// every source; run it on a worker.
+guint scalecache_prune(void) {
+    char *directory = scalecache_get_default_directory();
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (!dir) {
+        g_free(directory);
+        return 0;
+    }
+
+    GHashTable *live = scalecache_live_hashes();
+    int width, height;
+    gboolean targeted = scalecache_get_target(&width, &height);
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    gint64 max_age = (gint64)SCALECACHE_MAX_AGE_DAYS * 24 * 60 * 60;
+
+    GArray *kept = g_array_new(FALSE, FALSE, sizeof(ScalecacheVariant));
+    guint64 total = 0;
+    guint removed = 0;
+    const char *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        char *path = g_build_filename(directory, name, NULL);
+        struct stat st;
+        if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            g_free(path);
+            continue;
+        }
+
+        char hash[17];
+        int variant_width, variant_height;
+        char extension[5];
+        gboolean stale;
+        if (g_str_has_suffix(name, ".tmp")) {
+            // Left behind by a crash mid-write
+            stale = now - (gint64)st.st_mtime > SCALECACHE_TEMP_AGE;
+        } else if (sscanf(name, "%16[0-9a-f]-%dx%d.%4s", hash, &variant_width, &variant_height, extension) == 4) {
+            stale = !g_hash_table_contains(live, hash) ||
+                    (targeted && (variant_width != width || variant_height != height)) ||
+                    now - (gint64)st.st_mtime > max_age;
+        } else {
+            // Not ours
+            g_free(path);
+            continue;
+        }
+
+        if (stale) {
+            if (g_unlink(path) == 0) {
+                removed++;
+            }
+            g_free(path);
+            continue;
+        }
+
+        ScalecacheVariant variant = { path, st.st_size, st.st_mtime };
+        g_array_append_val(kept, variant);
+        total += (guint64)st.st_size;
+    }
+    g_dir_close(dir);
+
+    // Least recently used first
+    g_array_sort(kept, compare_variant_use);
+    for (guint i = 0; i < kept->len; i++) {
+        ScalecacheVariant *variant = &g_array_index(kept, ScalecacheVariant, i);
+        if (total > SCALECACHE_MAX_BYTES && g_unlink(variant->path) == 0) {
+            total -= (guint64)variant->size;
+            removed++;
+        }
+        g_free(variant->path);
+    }
+
+    g_array_free(kept, TRUE);
+    g_hash_table_destroy(live);
+    g_free(directory);
+    scalecache_save();
+    return removed;
+}
+
+void scalecache_shutdown(void) {
+    scalecache_save();
+
+    g_mutex_lock(&scalecache_lock);
+    if (hash_memo) {
+        g_hash_table_destroy(hash_memo);
+        hash_memo = NULL;
+    }
+    g_mutex_unlock(&scalecache_lock);
+}
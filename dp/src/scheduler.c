@@ -0,0 +1,445 @@
+#include "scheduler.h"
+#include "catalog.h"
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+
+#define SCHEDULER_LOCATION_GROUP "location"
+
+// Longest sleep between checks; g_timeout sources run on the monotonic
+// clock, so this bounds how late a wall-clock jump nobody reported is noticed
+#define SCHEDULER_MAX_SLEEP (60 * 60)
+
+// Sunrise and sunset are when the sun's center is this far from the zenith
+// (refraction and the solar radius included)
+#define SCHEDULER_SUN_ZENITH 90.833
+
+typedef struct {
+    gint64 time;            // Unix seconds
+    guint slot;
+} SchedulerBoundary;
+
+struct _Scheduler {
+    GPtrArray *slots;       // TimeSlot*, in file order
+    gboolean has_location;
+    double latitude;
+    double longitude;
+    SchedulerCallback callback;
+    gpointer user_data;
+    guint timer_id;
+    gint64 active_since;    // Boundary of the slot last reported, 0 for none
+};
+
+static void slot_free(gpointer data) {
+    TimeSlot *slot = data;
+    g_free(slot->name);
+    g_strfreev(slot->images);
+    g_free(slot->playlist);
+    g_free(slot);
+}
+
+// H:MM or HH:MM
+static gboolean parse_clock(const char *text, int *minutes) {
+    int hours = 0;
+    int digits = 0;
+    for (; g_ascii_isdigit(*text) && digits < 2; text++, digits++) {
+        hours = hours * 10 + (*text - '0');
+    }
+    if (digits == 0 || hours > 23 || text[0] != ':' ||
+        !g_ascii_isdigit(text[1]) || !g_ascii_isdigit(text[2]) || text[3] != '\0') {
+        return FALSE;
+    }
+
+    int mins = (text[1] - '0') * 10 + (text[2] - '0');
+    if (mins > 59) return FALSE;
+    *minutes = hours * 60 + mins;
+    return TRUE;
+}
+
+// HH:MM, sunrise, sunset, sunrise+HH:MM, sunset-HH:MM, ...
+static gboolean parse_start(const char *text, SchedulerAnchor *anchor, int *offset) {
+    *offset = 0;
+    if (g_str_has_prefix(text, "sunrise")) {
+        *anchor = SCHEDULER_ANCHOR_SUNRISE;
+        text += strlen("sunrise");
+    } else if (g_str_has_prefix(text, "sunset")) {
+        *anchor = SCHEDULER_ANCHOR_SUNSET;
+        text += strlen("sunset");
+    } else {
+        *anchor = SCHEDULER_ANCHOR_CLOCK;
+        return parse_clock(text, offset);
+    }
+
+    if (*text == '\0') return TRUE;
+    if (*text != '+' && *text != '-') return FALSE;
+    int sign = *text == '-' ? -1 : 1;
+    if (!parse_clock(text + 1, offset)) return FALSE;
+    *offset *= sign;
+    return TRUE;
+}
+
+static char* resolve_path(const char *base_dir, const char *text) {
+    if (g_str_has_prefix(text, "~/")) {
+        return g_build_filename(g_get_home_dir(), text + 2, NULL);
+    }
+    if (g_path_is_absolute(text)) {
+        return g_strdup(text);
+    }
+    return g_build_filename(base_dir, text, NULL);
+}
+
+static gboolean load_location(Scheduler *scheduler, GKeyFile *file, GError **error) {
+    GError *local_error = NULL;
+    scheduler->latitude = g_key_file_get_double(file, SCHEDULER_LOCATION_GROUP, "latitude", &local_error);
+    if (!local_error) {
+        scheduler->longitude = g_key_file_get_double(file, SCHEDULER_LOCATION_GROUP, "longitude", &local_error);
+    }
+    if (local_error) {
+        g_propagate_error(error, local_error);
+        return FALSE;
+    }
+
+    if (fabs(scheduler->latitude) > 90 || fabs(scheduler->longitude) > 180) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Location %g, %g is out of range", scheduler->latitude, scheduler->longitude);
+        return FALSE;
+    }
+
+    // The equations divide by cos(latitude)
+    scheduler->latitude = CLAMP(scheduler->latitude, -89.99, 89.99);
+    scheduler->has_location = TRUE;
+    return TRUE;
+}
+
+static TimeSlot* load_slot(GKeyFile *file, const char *group, const char *base_dir, GError **error) {
+    char *start = g_key_file_get_string(file, group, "start", error);
+    if (!start) return NULL;
+
+    TimeSlot *slot = g_new0(TimeSlot, 1);
+    slot->name = g_strdup(group);
+    gboolean valid = parse_start(start, &slot->anchor, &slot->offset);
+    if (!valid) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "Slot [%s] has an unknown start \"%s\"", group, start);
+    }
+    g_free(start);
+    if (!valid) {
+        slot_free(slot);
+        return NULL;
+    }
+
+    gsize count = 0;
+    char **images = g_key_file_get_string_list(file, group, "image", &count, NULL);
+    if (images && count > 0) {
+        slot->images = g_new0(char*, count + 1);
+        for (gsize i = 0; i < count; i++) {
+            slot->images[i] = resolve_path(base_dir, images[i]);
+        }
+    }
+    g_strfreev(images);
+
+    char *playlist = g_key_file_get_string(file, group, "playlist", NULL);
+    if (playlist && *playlist) {
+        slot->playlist = resolve_path(base_dir, playlist);
+    }
+    g_free(playlist);
+
+    if (!slot->images && !slot->playlist) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                    "Slot [%s] has neither an image nor a playlist", group);
+        slot_free(slot);
+        return NULL;
+    }
+    return slot;
+}
+
+Scheduler* scheduler_load(const char *path, GError **error) {
+    GKeyFile *file = g_key_file_new();
+    if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, error)) {
+        g_key_file_free(file);
+        return NULL;
+    }
+
+    Scheduler *scheduler = g_new0(Scheduler, 1);
+    scheduler->slots = g_ptr_array_new_with_free_func(slot_free);
+
+    char *base_dir = g_path_get_dirname(path);
+    char **groups = g_key_file_get_groups(file, NULL);
+    gboolean success = TRUE;
+    gboolean needs_location = FALSE;
+    for (char **group = groups; success && *group; group++) {
+        if (strcmp(*group, SCHEDULER_LOCATION_GROUP) == 0) {
+            success = load_location(scheduler, file, error);
+            continue;
+        }
+
+        TimeSlot *slot = load_slot(file, *group, base_dir, error);
+        if (!slot) {
+            success = FALSE;
+            break;
+        }
+        needs_location |= slot->anchor != SCHEDULER_ANCHOR_CLOCK;
+        g_ptr_array_add(scheduler->slots, slot);
+    }
+    g_strfreev(groups);
+    g_free(base_dir);
+    g_key_file_free(file);
+
+    if (success && scheduler->slots->len == 0) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND, "No time slots in %s", path);
+        success = FALSE;
+    } else if (success && needs_location && !scheduler->has_location) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                    "Sunrise and sunset slots need a [" SCHEDULER_LOCATION_GROUP "] group");
+        success = FALSE;
+    }
+
+    if (!success) {
+        scheduler_free(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+void scheduler_free(Scheduler *scheduler) {
+    if (!scheduler) return;
+
+    scheduler_stop(scheduler);
+    g_ptr_array_free(scheduler->slots, TRUE);
+    g_free(scheduler);
+}
+
+// NOAA general solar position equations. Minutes after UTC midnight on
+// the given day of the year; FALSE when the sun stays up or down all day.
+static gboolean sun_events(double latitude, double longitude, int day_of_year, double *sunrise, double *sunset) {
+    double gamma = 2 * G_PI / 365 * (day_of_year - 1);
+    double eqtime = 229.18 * (0.000075 + 0.001868 * cos(gamma) - 0.032077 * sin(gamma)
+                              - 0.014615 * cos(2 * gamma) - 0.040849 * sin(2 * gamma));
+    double decl = 0.006918 - 0.399912 * cos(gamma) + 0.070257 * sin(gamma)
+                  - 0.006758 * cos(2 * gamma) + 0.000907 * sin(2 * gamma)
+                  - 0.002697 * cos(3 * gamma) + 0.00148 * sin(3 * gamma);
+
+    double lat = latitude * G_PI / 180;
+    double cos_hour_angle = cos(SCHEDULER_SUN_ZENITH * G_PI / 180) / (cos(lat) * cos(decl)) - tan(lat) * tan(decl);
+    if (cos_hour_angle < -1 || cos_hour_angle > 1) {
+        return FALSE;
+    }
+
+    double hour_angle = acos(cos_hour_angle) * 180 / G_PI;
+    *sunrise = 720 - 4 * (longitude + hour_angle) - eqtime;
+    *sunset = 720 - 4 * (longitude - hour_angle) - eqtime;
+    return TRUE;
+}
+
+// Slot starts on the local day days after now
+static void add_day_boundaries(const Scheduler *scheduler, GDateTime *now, int days, GArray *boundaries) {
+    GDateTime *day = g_date_time_add_days(now, days);
+    int year, month, mday;
+    g_date_time_get_ymd(day, &year, &month, &mday);
+
+    double sunrise = 0, sunset = 0;
+    gboolean has_sun = scheduler->has_location &&
+                       sun_events(scheduler->latitude, scheduler->longitude,
+                                  g_date_time_get_day_of_year(day), &sunrise, &sunset);
+    g_date_time_unref(day);
+
+    gint64 utc_midnight = 0;
+    if (has_sun) {
+        GDateTime *midnight = g_date_time_new_utc(year, month, mday, 0, 0, 0);
+        utc_midnight = g_date_time_to_unix(midnight);
+        g_date_time_unref(midnight);
+    }
+
+    for (guint i = 0; i < scheduler->slots->len; i++) {
+        const TimeSlot *slot = g_ptr_array_index(scheduler->slots, i);
+        SchedulerBoundary boundary = { 0, i };
+        if (slot->anchor == SCHEDULER_ANCHOR_CLOCK) {
+            // Built from the wall-clock time so it holds across DST changes
+            GDateTime *start = g_date_time_new_local(year, month, mday, slot->offset / 60, slot->offset % 60, 0);
+            if (!start) continue;
+            boundary.time = g_date_time_to_unix(start);
+            g_date_time_unref(start);
+        } else if (has_sun) {
+            double minutes = slot->anchor == SCHEDULER_ANCHOR_SUNRISE ? sunrise : sunset;
+            boundary.time = utc_midnight + (gint64)llround((minutes + slot->offset) * 60);
+        } else {
+            continue;
+        }
+        g_array_append_val(boundaries, boundary);
+    }
+}
+
+static gint compare_boundaries(gconstpointer a, gconstpointer b) {
+    const SchedulerBoundary *first = a;
+    const SchedulerBoundary *second = b;
+    if (first->time != second->time) {
+        return first->time < second->time ? -1 : 1;
+    }
+    return first->slot < second->slot ? -1 : first->slot > second->slot;
+}
+
+// The boundary in effect at now and the one after it, either NULL. Looks
+// from yesterday to tomorrow, enough for any slot that wraps midnight.
+static GArray* find_boundaries(const Scheduler *scheduler, GDateTime *now,
+                               const SchedulerBoundary **active, const SchedulerBoundary **next) {
+    GArray *boundaries = g_array_sized_new(FALSE, FALSE, sizeof(SchedulerBoundary), scheduler->slots->len * 3);
+    for (int days = -1; days <= 1; days++) {
+        add_day_boundaries(scheduler, now, days, boundaries);
+    }
+    g_array_sort(boundaries, compare_boundaries);
+
+    gint64 now_time = g_date_time_to_unix(now);
+    *active = NULL;
+    *next = NULL;
+    for (guint i = 0; i < boundaries->len; i++) {
+        const SchedulerBoundary *boundary = &g_array_index(boundaries, SchedulerBoundary, i);
+        if (boundary->time > now_time) {
+            *next = boundary;
+            break;
+        }
+        *active = boundary;
+    }
+    return boundaries;
+}
+
+static gboolean scheduler_timeout(gpointer data);
+
+// Report the active slot if it began since the last report, then sleep
+// until the next boundary
+static void scheduler_check(Scheduler *scheduler) {
+    if (scheduler->timer_id != 0) {
+        g_source_remove(scheduler->timer_id);
+        scheduler->timer_id = 0;
+    }
+
+    GDateTime *now = g_date_time_new_now_local();
+    const SchedulerBoundary *active, *next;
+    GArray *boundaries = find_boundaries(scheduler, now, &active, &next);
+
+    gint64 delay = next ? next->time - g_date_time_to_unix(now) : SCHEDULER_MAX_SLEEP;
+    delay = CLAMP(delay, 1, SCHEDULER_MAX_SLEEP);
+    scheduler->timer_id = g_timeout_add_seconds((guint)delay, scheduler_timeout, scheduler);
+
+    TimeSlot *began = NULL;
+    if (active && active->time != scheduler->active_since) {
+        scheduler->active_since = active->time;
+        began = g_ptr_array_index(scheduler->slots, active->slot);
+    }
+    g_array_free(boundaries, TRUE);
+    g_date_time_unref(now);
+
+    // Last, so the callback may stop or restart the scheduler
+    if (began && scheduler->callback) {
+        scheduler->callback(began, scheduler->user_data);
+    }
+}
+
+static gboolean scheduler_timeout(gpointer data) {
+    Scheduler *scheduler = data;
+    scheduler->timer_id = 0;
+    scheduler_check(scheduler);
+    return G_SOURCE_REMOVE;
+}
+
+void scheduler_start(Scheduler *scheduler, SchedulerCallback callback, gpointer user_data) {
+    scheduler->callback = callback;
+    scheduler->user_data = user_data;
+    scheduler->active_since = 0;
+    scheduler_check(scheduler);
+}
+
+void scheduler_stop(Scheduler *scheduler) {
+    if (scheduler->timer_id != 0) {
+        g_source_remove(scheduler->timer_id);
+        scheduler->timer_id = 0;
+    }
+    scheduler->callback = NULL;
+}
+
+void scheduler_reschedule(Scheduler *scheduler) {
+    if (scheduler->callback) {
+        scheduler_check(scheduler);
+    }
+}
+
+TimeSlot* scheduler_get_active_slot(const Scheduler *scheduler, GDateTime *now) {
+    GDateTime *local = now ? g_date_time_ref(now) : g_date_time_new_now_local();
+    const SchedulerBoundary *active, *next;
+    GArray *boundaries = find_boundaries(scheduler, local, &active, &next);
+    TimeSlot *slot = active ? g_ptr_array_index(scheduler->slots, active->slot) : NULL;
+    g_array_free(boundaries, TRUE);
+    g_date_time_unref(local);
+    return slot;
+}
+
+GDateTime* scheduler_get_next_boundary(const Scheduler *scheduler, GDateTime *now) {
+    GDateTime *local = now ? g_date_time_ref(now) : g_date_time_new_now_local();
+    const SchedulerBoundary *active, *next;
+    GArray *boundaries = find_boundaries(scheduler, local, &active, &next);
+    GDateTime *boundary = next ? g_date_time_new_from_unix_local(next->time) : NULL;
+    g_array_free(boundaries, TRUE);
+    g_date_time_unref(local);
+    return boundary;
+}
+
+guint scheduler_get_slot_count(const Scheduler *scheduler) {
+    return scheduler->slots->len;
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Images directly inside the playlist directory, sorted
+static GPtrArray* list_playlist(const char *directory) {
+    GPtrArray *images = g_ptr_array_new_with_free_func(g_free);
+    GDir *dir = g_dir_open(directory, 0, NULL);
+    if (!dir) return images;
+
+    const char *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (catalog_is_image_file(name)) {
+            g_ptr_array_add(images, g_build_filename(directory, name, NULL));
+        }
+    }
+    g_dir_close(dir);
+    g_ptr_array_sort(images, compare_names);
+    return images;
+}
+
+// The first existing image from position on; position ends up after it
+static char* scheduler_find_image(const TimeSlot *slot, guint *position) {
+    GPtrArray *images = NULL;
+    if (slot->images) {
+        images = g_ptr_array_new();
+        for (char **image = slot->images; *image; image++) {
+            g_ptr_array_add(images, *image);
+        }
+    } else {
+        images = list_playlist(slot->playlist);
+    }
+
+    char *result = NULL;
+    for (guint tries = 0; tries < images->len && !result; tries++) {
+        const char *image = g_ptr_array_index(images, *position % images->len);
+        *position = (*position + 1) % images->len;
+        if (g_file_test(image, G_FILE_TEST_IS_REGULAR)) {
+            result = g_strdup(image);
+        }
+    }
+    g_ptr_array_free(images, TRUE);
+    return result;
+}
+
+char* scheduler_next_image(TimeSlot *slot) {
+    return scheduler_find_image(slot, &slot->position);
+}
+
+char* scheduler_peek_image(const TimeSlot *slot) {
+    guint position = slot->position;
+    return scheduler_find_image(slot, &position);
+}
+
+char* scheduler_get_default_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "schedule.ini", NULL);
+}
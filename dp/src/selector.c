@@ -0,0 +1,702 @@
+#include "selector.h"
+#include "binfile.h"
+#include "hash.h"
+#include "log.h"
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define SELECTOR_MAGIC   0x4c535044u  // "DPSL"
+#define SELECTOR_VERSION 1
+
+// Redraws before a weighted pick may repeat the previous image
+#define SELECTOR_REPEAT_TRIES 8
+
+// On-disk layout: this after the binfile header, then the hashes of the
+// images already shown in the current cycle and an empty pool. Paths are
+// stored as hashes to keep the file small.
+typedef struct {
+    guint64 state[4];       // Generator state
+    guint64 last;           // Hash of the last pick
+} SelectorSaved;
+
+static const BinfileFormat selector_format = {
+    SELECTOR_MAGIC, SELECTOR_VERSION, sizeof(SelectorSaved), sizeof(guint64)
+};
+
+// One column of an alias table; alias is relative to the table
+typedef struct {
+    double probability;
+    guint alias;
+} SelectorAlias;
+
+typedef struct {
+    double total;
+    gboolean dirty;
+} SelectorBlock;
+
+struct _Selector {
+    char *cache_path;
+    SelectorMode mode;
+    guint64 state[4];
+    GPtrArray *items;       // Owned paths; [0, remaining) not shown yet this cycle
+    guint remaining;
+    GHashTable *positions;  // Path (borrowed from items) -> index + 1
+    GHashTable *restored;   // Hashes shown before the last save, until their paths are added
+    guint64 last;
+    gboolean dirty;
+
+    // Weighted picks. Weights move with their items; the tables are only
+    // brought up to date when a weighted pick needs them.
+    SelectorWeightFunc weight_func;
+    gpointer weight_data;
+    GArray *weights;        // double per item
+    GArray *alias;          // SelectorAlias per item, one table per block
+    GArray *blocks;         // SelectorBlock per SELECTOR_BLOCK items
+    GArray *top;            // SelectorAlias per block, over the block totals
+    gboolean top_dirty;
+};
+
+static const char *mode_names[] = { "random", "shuffle", "weighted" };
+
+static inline guint64 rotl(guint64 value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+// xoshiro256** (Blackman and Vigna)
+static guint64 selector_random(Selector *selector) {
+    guint64 *s = selector->state;
+    guint64 result = rotl(s[1] * 5, 7) * 9;
+    guint64 t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+// Uniform in [0, bound) without modulo bias (Lemire's multiply-shift)
+static guint selector_range(Selector *selector, guint bound) {
+    guint64 product = (selector_random(selector) >> 32) * (guint64)bound;
+    guint32 low = (guint32)product;
+    if (low < bound) {
+        guint32 threshold = (guint32)(0u - bound) % bound;
+        while (low < threshold) {
+            product = (selector_random(selector) >> 32) * (guint64)bound;
+            low = (guint32)product;
+        }
+    }
+    return (guint)(product >> 32);
+}
+
+// Fresh generator state from the system entropy source
+static void selector_seed(Selector *selector) {
+    GRand *rand = g_rand_new();
+    do {
+        for (int i = 0; i < 4; i++) {
+            selector->state[i] = ((guint64)g_rand_int(rand) << 32) | g_rand_int(rand);
+        }
+    } while ((selector->state[0] | selector->state[1] | selector->state[2] | selector->state[3]) == 0);
+    g_rand_free(rand);
+}
+
+// Uniform in [0, 1)
+static double selector_uniform(Selector *selector) {
+    return (selector_random(selector) >> 11) * 0x1.0p-53;
+}
+
+static guint64 selector_hash_path(const char *path) {
+    return hash_bytes(path, strlen(path), 0);
+}
+
+static double selector_query_weight(Selector *selector, const char *path) {
+    if (!selector->weight_func) {
+        return 1.0;
+    }
+    double weight = selector->weight_func(path, selector->weight_data);
+    return weight > 0 ? weight : 0;    // Also catches NaN
+}
+
+// The block holding index needs a new alias table
+static void selector_mark_block(Selector *selector, guint index) {
+    guint block = index / SELECTOR_BLOCK;
+    if (block >= selector->blocks->len) {
+        g_array_set_size(selector->blocks, block + 1);
+    }
+    g_array_index(selector->blocks, SelectorBlock, block).dirty = TRUE;
+    selector->top_dirty = TRUE;
+}
+
+static void selector_swap(Selector *selector, guint a, guint b) {
+    if (a == b) return;
+
+    gpointer *items = selector->items->pdata;
+    gpointer item = items[a];
+    items[a] = items[b];
+    items[b] = item;
+    g_hash_table_insert(selector->positions, items[a], GUINT_TO_POINTER(a + 1));
+    g_hash_table_insert(selector->positions, items[b], GUINT_TO_POINTER(b + 1));
+
+    double *weights = (double *)selector->weights->data;
+    if (weights[a] != weights[b]) {
+        double weight = weights[a];
+        weights[a] = weights[b];
+        weights[b] = weight;
+        selector_mark_block(selector, a);
+        selector_mark_block(selector, b);
+    }
+}
+
+// Vose's alias method over count weights; returns their sum. The scratch
+// arrays hold count entries each.
+static double selector_build_alias(const double *weights, guint count, SelectorAlias *table,
+                                   double *scaled, guint *small, guint *large) {
+    double total = 0;
+    for (guint i = 0; i < count; i++) {
+        total += weights[i];
+    }
+
+    // Nothing to weigh: fall back to uniform
+    if (total <= 0) {
+        for (guint i = 0; i < count; i++) {
+            table[i].probability = 1.0;
+            table[i].alias = i;
+        }
+        return 0;
+    }
+
+    guint small_count = 0, large_count = 0;
+    for (guint i = 0; i < count; i++) {
+        scaled[i] = weights[i] * count / total;
+        if (scaled[i] < 1.0) {
+            small[small_count++] = i;
+        } else {
+            large[large_count++] = i;
+        }
+    }
+
+    // Each short column is topped up from a tall one
+    while (small_count > 0 && large_count > 0) {
+        guint less = small[--small_count];
+        guint more = large[--large_count];
+        table[less].probability = scaled[less];
+        table[less].alias = more;
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+        if (scaled[more] < 1.0) {
+            small[small_count++] = more;
+        } else {
+            large[large_count++] = more;
+        }
+    }
+
+    // Whatever is left is full, up to rounding
+    while (large_count > 0) {
+        guint i = large[--large_count];
+        table[i].probability = 1.0;
+        table[i].alias = i;
+    }
+    while (small_count > 0) {
+        guint i = small[--small_count];
+        table[i].probability = 1.0;
+        table[i].alias = i;
+    }
+
+    return total;
+}
+
+// Rebuild the alias tables of changed blocks, then the top table
+static void selector_prepare_weighted(Selector *selector) {
+    guint count = selector->items->len;
+    guint block_count = (count + SELECTOR_BLOCK - 1) / SELECTOR_BLOCK;
+    if (selector->blocks->len != block_count) {
+        guint old_count = selector->blocks->len;
+        g_array_set_size(selector->blocks, block_count);
+        for (guint b = old_count; b < block_count; b++) {
+            g_array_index(selector->blocks, SelectorBlock, b).dirty = TRUE;
+        }
+        selector->top_dirty = TRUE;
+    }
+    if (!selector->top_dirty) {
+        return;
+    }
+    g_array_set_size(selector->alias, count);
+
+    double scaled[SELECTOR_BLOCK];
+    guint small[SELECTOR_BLOCK], large[SELECTOR_BLOCK];
+    const double *weights = (const double *)selector->weights->data;
+    for (guint b = 0; b < block_count; b++) {
+        SelectorBlock *block = &g_array_index(selector->blocks, SelectorBlock, b);
+        if (!block->dirty) continue;
+
+        guint start = b * SELECTOR_BLOCK;
+        guint size = MIN(SELECTOR_BLOCK, count - start);
+        block->total = selector_build_alias(weights + start, size,
+                                            &g_array_index(selector->alias, SelectorAlias, start),
+                                            scaled, small, large);
+        block->dirty = FALSE;
+    }
+
+    double *totals = g_new(double, block_count);
+    double *top_scaled = g_new(double, block_count);
+    guint *top_small = g_new(guint, block_count);
+    guint *top_large = g_new(guint, block_count);
+    for (guint b = 0; b < block_count; b++) {
+        totals[b] = g_array_index(selector->blocks, SelectorBlock, b).total;
+    }
+    g_array_set_size(selector->top, block_count);
+    selector_build_alias(totals, block_count, (SelectorAlias *)selector->top->data,
+                         top_scaled, top_small, top_large);
+    g_free(totals);
+    g_free(top_scaled);
+    g_free(top_small);
+    g_free(top_large);
+    selector->top_dirty = FALSE;
+}
+
+static guint selector_sample_alias(Selector *selector, const SelectorAlias *table, guint count) {
+    guint column = selector_range(selector, count);
+    return selector_uniform(selector) < table[column].probability ? column : table[column].alias;
+}
+
+// Block by its total, then an item within it: two O(1) alias draws
+static guint selector_draw_weighted(Selector *selector) {
+    selector_prepare_weighted(selector);
+
+    guint count = selector->items->len;
+    guint block = selector_sample_alias(selector, (const SelectorAlias *)selector->top->data,
+                                        selector->blocks->len);
+    guint start = block * SELECTOR_BLOCK;
+    return start + selector_sample_alias(selector, &g_array_index(selector->alias, SelectorAlias, start),
+                                         MIN(SELECTOR_BLOCK, count - start));
+}
+
+static gboolean selector_load(Selector *selector) {
+    BinfileView view;
+    char *data = binfile_load(&selector_format, selector->cache_path, &view);
+    if (!data) {
+        return FALSE;
+    }
+
+    const SelectorSaved *saved = view.extra;
+    if ((saved->state[0] | saved->state[1] | saved->state[2] | saved->state[3]) == 0) {
+        g_free(data);
+        return FALSE;
+    }
+
+    memcpy(selector->state, saved->state, sizeof(selector->state));
+    selector->last = saved->last;
+
+    const guint64 *shown = view.records;
+    if (view.count > 0) {
+        selector->restored = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+        for (guint32 i = 0; i < view.count; i++) {
+            guint64 *hash = g_new(guint64, 1);
+            *hash = shown[i];
+            g_hash_table_add(selector->restored, hash);
+        }
+    }
+
+    g_free(data);
+    return TRUE;
+}
+
+Selector* selector_open(const char *cache_path) {
+    Selector *selector = g_new0(Selector, 1);
+    selector->cache_path = g_strdup(cache_path);
+    selector->mode = SELECTOR_MODE_SHUFFLE;
+    selector->items = g_ptr_array_new_with_free_func(g_free);
+    selector->positions = g_hash_table_new(g_str_hash, g_str_equal);
+    selector->weights = g_array_new(FALSE, FALSE, sizeof(double));
+    selector->alias = g_array_new(FALSE, FALSE, sizeof(SelectorAlias));
+    selector->blocks = g_array_new(FALSE, TRUE, sizeof(SelectorBlock));
+    selector->top = g_array_new(FALSE, FALSE, sizeof(SelectorAlias));
+
+    if (!selector_load(selector)) {
+        selector_seed(selector);
+        selector->dirty = TRUE;
+    }
+    return selector;
+}
+
+void selector_free(Selector *selector) {
+    if (!selector) return;
+
+    if (selector->restored) {
+        g_hash_table_destroy(selector->restored);
+    }
+    g_array_free(selector->top, TRUE);
+    g_array_free(selector->blocks, TRUE);
+    g_array_free(selector->alias, TRUE);
+    g_array_free(selector->weights, TRUE);
+    g_hash_table_destroy(selector->positions);
+    g_ptr_array_free(selector->items, TRUE);
+    g_free(selector->cache_path);
+    g_free(selector);
+}
+
+// Write the generator state and cycle progress if they changed
+gboolean selector_save(Selector *selector) {
+    if (!selector->dirty) {
+        return TRUE;
+    }
+
+    guint shown = selector->items->len - selector->remaining;
+    guint pending = selector->restored ? g_hash_table_size(selector->restored) : 0;
+    GArray *hashes = g_array_sized_new(FALSE, FALSE, sizeof(guint64), shown + pending);
+    for (guint i = selector->remaining; i < selector->items->len; i++) {
+        guint64 hash = selector_hash_path(g_ptr_array_index(selector->items, i));
+        g_array_append_val(hashes, hash);
+    }
+    if (selector->restored) {
+        GHashTableIter iter;
+        gpointer key;
+        g_hash_table_iter_init(&iter, selector->restored);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            g_array_append_val(hashes, *(guint64 *)key);
+        }
+    }
+
+    SelectorSaved saved;
+    memcpy(saved.state, selector->state, sizeof(saved.state));
+    saved.last = selector->last;
+
+    GError *error = NULL;
+    gboolean success = binfile_save(&selector_format, selector->cache_path, &saved, hashes->data, hashes->len,
+                                    NULL, 0, &error);
+    if (success) {
+        selector->dirty = FALSE;
+    } else {
+        log_warning("Failed to save selector state %s: %s", selector->cache_path, error->message);
+        g_error_free(error);
+    }
+
+    g_array_free(hashes, TRUE);
+    return success;
+}
+
+gboolean selector_is_dirty(const Selector *selector) {
+    return selector->dirty;
+}
+
+void selector_set_mode(Selector *selector, SelectorMode mode) {
+    selector->mode = mode;
+}
+
+SelectorMode selector_get_mode(const Selector *selector) {
+    return selector->mode;
+}
+
+void selector_set_weight_func(Selector *selector, SelectorWeightFunc func, gpointer user_data) {
+    selector->weight_func = func;
+    selector->weight_data = user_data;
+    selector_refresh_weights(selector);
+}
+
+void selector_update_weight(Selector *selector, const char *path) {
+    gpointer value = g_hash_table_lookup(selector->positions, path);
+    if (!value) return;
+
+    guint position = GPOINTER_TO_UINT(value) - 1;
+    double weight = selector_query_weight(selector, path);
+    double *current = &g_array_index(selector->weights, double, position);
+    if (*current != weight) {
+        *current = weight;
+        selector_mark_block(selector, position);
+    }
+}
+
+void selector_refresh_weights(Selector *selector) {
+    for (guint i = 0; i < selector->items->len; i++) {
+        selector_update_weight(selector, g_ptr_array_index(selector->items, i));
+    }
+}
+
+gboolean selector_add(Selector *selector, const char *path) {
+    if (g_hash_table_contains(selector->positions, path)) {
+        return FALSE;
+    }
+
+    char *item = g_strdup(path);
+    double weight = selector_query_weight(selector, path);
+    g_ptr_array_add(selector->items, item);
+    g_array_append_val(selector->weights, weight);
+    g_hash_table_insert(selector->positions, item, GUINT_TO_POINTER(selector->items->len));
+    selector_mark_block(selector, selector->items->len - 1);
+
+    // Shown before a restart: stays in the shown part
+    if (selector->restored) {
+        guint64 hash = selector_hash_path(path);
+        if (g_hash_table_remove(selector->restored, &hash)) {
+            return TRUE;
+        }
+    }
+
+    selector_swap(selector, selector->items->len - 1, selector->remaining);
+    selector->remaining++;
+    return TRUE;
+}
+
+gboolean selector_remove(Selector *selector, const char *path) {
+    gpointer value = g_hash_table_lookup(selector->positions, path);
+    if (!value) {
+        return FALSE;
+    }
+
+    // Keep the not-shown part contiguous, then drop the item from the end
+    guint position = GPOINTER_TO_UINT(value) - 1;
+    if (position < selector->remaining) {
+        selector->remaining--;
+        selector_swap(selector, position, selector->remaining);
+        position = selector->remaining;
+    }
+
+    guint last = selector->items->len - 1;
+    selector_swap(selector, position, last);
+    g_hash_table_remove(selector->positions, g_ptr_array_index(selector->items, last));
+    g_ptr_array_remove_index(selector->items, last);
+    g_array_set_size(selector->weights, last);
+    if (last > 0) {
+        selector_mark_block(selector, last - 1);
+    }
+    selector->top_dirty = TRUE;
+    return TRUE;
+}
+
+gboolean selector_rename(Selector *selector, const char *old_path, const char *new_path) {
+    gpointer value = g_hash_table_lookup(selector->positions, old_path);
+    if (!value) {
+        return FALSE;
+    }
+    if (g_hash_table_contains(selector->positions, new_path)) {
+        // Renamed over another image: only one of them is left
+        return selector_remove(selector, old_path);
+    }
+
+    // Same slot, so the item stays on its side of the cycle
+    guint position = GPOINTER_TO_UINT(value) - 1;
+    char *item = g_ptr_array_index(selector->items, position);
+    g_hash_table_remove(selector->positions, item);
+    if (selector_hash_path(item) == selector->last) {
+        selector->last = selector_hash_path(new_path);
+    }
+    g_free(item);
+
+    item = g_strdup(new_path);
+    selector->items->pdata[position] = item;
+    g_hash_table_insert(selector->positions, item, GUINT_TO_POINTER(position + 1));
+    selector_update_weight(selector, item);
+
+    // Shown items are saved by path hash
+    if (position >= selector->remaining) {
+        selector->dirty = TRUE;
+    }
+    return TRUE;
+}
+
+void selector_sync(Selector *selector, GPtrArray *paths) {
+    GHashTable *wanted = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < paths->len; i++) {
+        g_hash_table_add(wanted, g_ptr_array_index(paths, i));
+    }
+
+    // Removal only moves items from later positions, which were already checked
+    for (guint i = selector->items->len; i > 0; i--) {
+        const char *item = g_ptr_array_index(selector->items, i - 1);
+        if (!g_hash_table_contains(wanted, item)) {
+            selector_remove(selector, item);
+        }
+    }
+    g_hash_table_destroy(wanted);
+
+    for (guint i = 0; i < paths->len; i++) {
+        selector_add(selector, g_ptr_array_index(paths, i));
+    }
+
+    // Anything not matched by now is gone from the library
+    if (selector->restored) {
+        if (g_hash_table_size(selector->restored) > 0) {
+            selector->dirty = TRUE;
+        }
+        g_hash_table_destroy(selector->restored);
+        selector->restored = NULL;
+    }
+}
+
+// Move an unshown item into the shown part and return its position,
+// starting a new cycle when everything has been shown
+static guint selector_draw(Selector *selector) {
+    guint count = selector->items->len;
+    if (selector->remaining == 0) {
+        selector->remaining = count;
+    }
+
+    guint index = selector_range(selector, selector->remaining);
+
+    // Don't open a cycle with the image that closed the previous one
+    if (selector->remaining == count && count > 1 &&
+        selector_hash_path(g_ptr_array_index(selector->items, index)) == selector->last) {
+        index = (index + 1 + selector_range(selector, count - 1)) % count;
+    }
+
+    selector->remaining--;
+    selector_swap(selector, index, selector->remaining);
+    return selector->remaining;
+}
+
+static char* selector_take(Selector *selector, guint index) {
+    const char *path = g_ptr_array_index(selector->items, index);
+    selector->last = selector_hash_path(path);
+    selector->dirty = TRUE;
+    return g_strdup(path);
+}
+
+char* selector_next(Selector *selector) {
+    guint count = selector->items->len;
+    if (count == 0) {
+        return NULL;
+    }
+
+    if (selector->mode == SELECTOR_MODE_SHUFFLE) {
+        return selector_take(selector, selector_draw(selector));
+    }
+
+    if (selector->mode == SELECTOR_MODE_WEIGHTED) {
+        guint index = selector_draw_weighted(selector);
+        for (int tries = 1; tries < SELECTOR_REPEAT_TRIES && count > 1 &&
+             selector_hash_path(g_ptr_array_index(selector->items, index)) == selector->last; tries++) {
+            index = selector_draw_weighted(selector);
+        }
+        return selector_take(selector, index);
+    }
+
+    return selector_take(selector, selector_range(selector, count));
+}
+
+// Like selector_next(), restricted to the images match accepts. Only the
+// accepted image counts as shown, so a shuffle cycle keeps the rejected
+// ones for later. Gives up after tries rejected draws.
+char* selector_next_matching(Selector *selector, SelectorMatchFunc match, gpointer user_data, guint tries) {
+    guint count = selector->items->len;
+
+    for (guint attempt = 0; count > 0 && attempt < tries; attempt++) {
+        guint index;
+        if (selector->mode == SELECTOR_MODE_SHUFFLE) {
+            if (selector->remaining == 0) {
+                selector->remaining = count;
+            }
+            index = selector_range(selector, selector->remaining);
+        } else if (selector->mode == SELECTOR_MODE_WEIGHTED) {
+            index = selector_draw_weighted(selector);
+        } else {
+            index = selector_range(selector, count);
+        }
+
+        const char *path = g_ptr_array_index(selector->items, index);
+        if (selector->mode != SELECTOR_MODE_RANDOM && count > 1 &&
+            (selector->mode == SELECTOR_MODE_WEIGHTED || selector->remaining == count) &&
+            selector_hash_path(path) == selector->last) {
+            continue;
+        }
+        if (!match(path, user_data)) {
+            continue;
+        }
+
+        if (selector->mode == SELECTOR_MODE_SHUFFLE) {
+            selector->remaining--;
+            selector_swap(selector, index, selector->remaining);
+            index = selector->remaining;
+        }
+        return selector_take(selector, index);
+    }
+    return NULL;
+}
+
+// Up to count distinct images
+GPtrArray* selector_next_many(Selector *selector, guint count) {
+    GPtrArray *images = g_ptr_array_new_with_free_func(g_free);
+    guint item_count = selector->items->len;
+    if (count > item_count) {
+        count = item_count;
+    }
+
+    if (selector->mode == SELECTOR_MODE_SHUFFLE) {
+        // A repeat is only possible once the batch runs into a new cycle;
+        // the new cycle still holds enough images that weren't picked
+        GHashTable *picked = g_hash_table_new(g_direct_hash, g_direct_equal);
+        while (images->len < count) {
+            guint index = selector_draw(selector);
+            gpointer item = g_ptr_array_index(selector->items, index);
+            if (g_hash_table_add(picked, item)) {
+                g_ptr_array_add(images, selector_take(selector, index));
+            }
+        }
+        g_hash_table_destroy(picked);
+        return images;
+    }
+
+    if (selector->mode == SELECTOR_MODE_WEIGHTED) {
+        // Redraw repeats; if the weight sits on too few images, take the
+        // rest in order from a random start
+        GHashTable *picked = g_hash_table_new(g_direct_hash, g_direct_equal);
+        for (guint tries = 0; images->len < count && tries < count * SELECTOR_REPEAT_TRIES; tries++) {
+            guint index = selector_draw_weighted(selector);
+            if (g_hash_table_add(picked, GUINT_TO_POINTER(index + 1))) {
+                g_ptr_array_add(images, selector_take(selector, index));
+            }
+        }
+        guint start = selector_range(selector, item_count);
+        for (guint i = 0; images->len < count; i++) {
+            guint index = (start + i) % item_count;
+            if (g_hash_table_add(picked, GUINT_TO_POINTER(index + 1))) {
+                g_ptr_array_add(images, selector_take(selector, index));
+            }
+        }
+        g_hash_table_destroy(picked);
+        return images;
+    }
+
+    // Sparse Fisher-Yates over the indices: only swapped positions are stored
+    GHashTable *swapped = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (guint i = 0; i < count; i++) {
+        guint j = i + selector_range(selector, item_count - i);
+        gpointer at_i, at_j;
+        guint value_j = g_hash_table_lookup_extended(swapped, GUINT_TO_POINTER(j), NULL, &at_j)
+                        ? GPOINTER_TO_UINT(at_j) : j;
+        guint value_i = g_hash_table_lookup_extended(swapped, GUINT_TO_POINTER(i), NULL, &at_i)
+                        ? GPOINTER_TO_UINT(at_i) : i;
+        g_hash_table_insert(swapped, GUINT_TO_POINTER(j), GUINT_TO_POINTER(value_i));
+        g_ptr_array_add(images, selector_take(selector, value_j));
+    }
+    g_hash_table_destroy(swapped);
+    return images;
+}
+
+guint selector_get_count(const Selector *selector) {
+    return selector->items->len;
+}
+
+guint selector_get_remaining(const Selector *selector) {
+    return selector->remaining;
+}
+
+char* selector_get_default_path(void) {
+    return g_build_filename(g_get_home_dir(), ".dp", "cache", "selector.bin", NULL);
+}
+
+const char* selector_mode_get_name(SelectorMode mode) {
+    return mode_names[mode];
+}
+
+gboolean selector_mode_from_name(const char *name, SelectorMode *mode) {
+    for (guint i = 0; i < G_N_ELEMENTS(mode_names); i++) {
+        if (g_strcmp0(name, mode_names[i]) == 0) {
+            *mode = (SelectorMode)i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
@@ -0,0 +1,205 @@
+#include "service.h"
+#include "metrics.h"
+#include "log.h"
+#include <gio/gio.h>
+
+// How long a client waits for the running instance
+#define SERVICE_CALL_TIMEOUT_MS 2000
+
+static const char service_introspection_xml[] =
+    "<node>"
+    "  <interface name='" SERVICE_INTERFACE "'>"
+    "    <method name='Next'>"
+    "      <arg name='image' type='s' direction='out'/>"
+    "    </method>"
+    "    <method name='Set'>"
+    "      <arg name='image' type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='SetDesktop'>"
+    "      <arg name='desktop' type='i' direction='in'/>"
+    "      <arg name='image' type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='Import'>"
+    "      <arg name='path' type='s' direction='in'/>"
+    "      <arg name='queued' type='u' direction='out'/>"
+    "    </method>"
+    "    <method name='Rate'>"
+    "      <arg name='image' type='s' direction='in'/>"
+    "      <arg name='stars' type='u' direction='in'/>"
+    "      <arg name='rated' type='s' direction='out'/>"
+    "    </method>"
+    "    <method name='Stats'>"
+    "      <arg name='stats' type='a{sa{st}}' direction='out'/>"
+    "    </method>"
+    "    <property name='Stats' type='a{sa{st}}' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+static GDBusNodeInfo *service_info = NULL;
+static GDBusConnection *service_connection = NULL;
+static guint service_registration_id = 0;
+static ServiceHandlers service_handlers;
+
+// Runs on the main loop, like the tray menu callbacks
+static void service_method_call(GDBusConnection *connection, const gchar *sender,
+                                const gchar *object_path, const gchar *interface_name,
+                                const gchar *method_name, GVariant *parameters,
+                                GDBusMethodInvocation *invocation, gpointer user_data) {
+    (void)connection;
+    (void)sender;
+    (void)object_path;
+    (void)interface_name;
+    (void)user_data;
+
+    GError *error = NULL;
+    GVariant *reply = NULL;
+
+    if (g_strcmp0(method_name, "Stats") == 0) {
+        reply = g_variant_new("(@a{sa{st}})", metrics_snapshot());
+    } else if (g_strcmp0(method_name, "Next") == 0 && service_handlers.next) {
+        char *image = service_handlers.next(&error);
+        if (image) {
+            reply = g_variant_new("(s)", image);
+            g_free(image);
+        }
+    } else if (g_strcmp0(method_name, "Set") == 0 && service_handlers.set) {
+        const char *image;
+        g_variant_get(parameters, "(&s)", &image);
+        if (service_handlers.set(image, -1, &error)) {
+            reply = g_variant_new("()");
+        }
+    } else if (g_strcmp0(method_name, "SetDesktop") == 0 && service_handlers.set) {
+        gint32 desktop;
+        const char *image;
+        g_variant_get(parameters, "(i&s)", &desktop, &image);
+        if (desktop < 0) {
+            g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid desktop index %d", desktop);
+        } else if (service_handlers.set(image, desktop, &error)) {
+            reply = g_variant_new("()");
+        }
+    } else if (g_strcmp0(method_name, "Import") == 0 && service_handlers.import) {
+        const char *path;
+        g_variant_get(parameters, "(&s)", &path);
+        guint queued = service_handlers.import(path, &error);
+        if (queued > 0) {
+            reply = g_variant_new("(u)", queued);
+        }
+    } else if (g_strcmp0(method_name, "Rate") == 0 && service_handlers.rate) {
+        const char *image;
+        guint32 stars;
+        g_variant_get(parameters, "(&su)", &image, &stars);
+        char *rated = stars <= G_MAXINT ? service_handlers.rate(image, (int)stars, &error) : NULL;
+        if (rated) {
+            reply = g_variant_new("(s)", rated);
+            g_free(rated);
+        } else if (!error) {
+            g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid rating %u", stars);
+        }
+    } else {
+        g_set_error(&error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD, "No such method: %s", method_name);
+    }
+
+    if (reply) {
+        g_dbus_method_invocation_return_value(invocation, reply);
+    } else {
+        log_info("D-Bus %s rejected: %s", method_name, error ? error->message : "unknown error");
+        if (error) {
+            g_dbus_method_invocation_take_error(invocation, error);
+        } else {
+            g_dbus_method_invocation_return_error(invocation, G_IO_ERROR, G_IO_ERROR_FAILED, "%s failed", method_name);
+        }
+    }
+}
+
+static GVariant* service_get_property(GDBusConnection *connection, const gchar *sender,
+                                      const gchar *object_path, const gchar *interface_name,
+                                      const gchar *property_name, GError **error, gpointer user_data) {
+    (void)connection;
+    (void)sender;
+    (void)object_path;
+    (void)interface_name;
+    (void)user_data;
+
+    if (g_strcmp0(property_name, "Stats") == 0) {
+        return metrics_snapshot();
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No such property: %s", property_name);
+    return NULL;
+}
+
+static const GDBusInterfaceVTable service_vtable = {
+    service_method_call,
+    service_get_property,
+    NULL,
+    { NULL }
+};
+
+void service_start(GDBusConnection *connection, const ServiceHandlers *handlers) {
+    if (service_registration_id != 0 || !connection) return;
+
+    if (handlers) {
+        service_handlers = *handlers;
+    }
+
+    if (!service_info) {
+        service_info = g_dbus_node_info_new_for_xml(service_introspection_xml, NULL);
+    }
+
+    // Shares the object path with the application's own interfaces
+    GError *error = NULL;
+    service_registration_id = g_dbus_connection_register_object(connection, SERVICE_OBJECT_PATH,
+                                                                service_info->interfaces[0],
+                                                                &service_vtable, NULL, NULL, &error);
+    if (service_registration_id == 0) {
+        log_warning("Failed to export %s: %s", SERVICE_OBJECT_PATH, error->message);
+        g_error_free(error);
+        return;
+    }
+    service_connection = g_object_ref(connection);
+}
+
+void service_stop(void) {
+    if (service_registration_id != 0) {
+        g_dbus_connection_unregister_object(service_connection, service_registration_id);
+        service_registration_id = 0;
+    }
+    g_clear_object(&service_connection);
+    if (service_info) {
+        g_dbus_node_info_unref(service_info);
+        service_info = NULL;
+    }
+}
+
+GVariant* service_call(const char *method, GVariant *parameters, const GVariantType *reply_type, GError **error) {
+    GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, error);
+    if (!connection) {
+        if (parameters) {
+            g_variant_unref(g_variant_ref_sink(parameters));
+        }
+        return NULL;
+    }
+
+    GVariant *reply = g_dbus_connection_call_sync(connection, SERVICE_BUS_NAME, SERVICE_OBJECT_PATH,
+                                                  SERVICE_INTERFACE, method, parameters, reply_type,
+                                                  G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                                  SERVICE_CALL_TIMEOUT_MS, NULL, error);
+    g_object_unref(connection);
+
+    // Report the daemon's message rather than the D-Bus error name
+    if (!reply && error && *error) {
+        g_dbus_error_strip_remote_error(*error);
+    }
+    return reply;
+}
+
+GVariant* service_get_stats(GError **error) {
+    GVariant *reply = service_call("Stats", NULL, G_VARIANT_TYPE("(a{sa{st}})"), error);
+    if (!reply) {
+        return NULL;
+    }
+
+    GVariant *stats = g_variant_get_child_value(reply, 0);
+    g_variant_unref(reply);
+    return stats;
+}
@@ -0,0 +1,314 @@
+#include "similar.h"
+#include "log.h"
+#include <string.h>
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#define DHASH_COLS 9
+#define DHASH_ROWS 8
+
+// Thumbnail size to decode at; JPEG decoders scale by up to 1/8 for free
+#define SIMILAR_SAMPLE_WIDTH  (DHASH_COLS * 8)
+#define SIMILAR_SAMPLE_HEIGHT (DHASH_ROWS * 8)
+
+// One hashing batch, shared by the pool threads
+typedef struct {
+    GPtrArray *paths;
+    SimilarInfo *infos;
+    gint done;
+    SimilarProgressFunc progress;
+    gpointer user_data;
+    GCancellable *cancellable;
+} SimilarBatch;
+
+guint similar_distance(guint64 a, guint64 b) {
+    return (guint)__builtin_popcountll(a ^ b);
+}
+
+// Box-average the image down to 9x8 luma and compare horizontal neighbours.
+// The inner loops run over plain arrays so the compiler can vectorize them.
+guint64 similar_dhash_rgb(const guint8 *pixels, int width, int height, int rowstride, int channels) {
+    guint32 sums[DHASH_ROWS][DHASH_COLS] = {{0}};
+    guint32 counts[DHASH_ROWS][DHASH_COLS] = {{0}};
+
+    guint16 *luma = g_new(guint16, width);
+    guint8 *column_bin = g_new(guint8, width);
+    for (int x = 0; x < width; x++) {
+        column_bin[x] = (guint8)((gint64)x * DHASH_COLS / width);
+    }
+
+    for (int y = 0; y < height; y++) {
+        const guint8 *row = pixels + (gsize)y * rowstride;
+        int row_bin = (int)((gint64)y * DHASH_ROWS / height);
+
+        // BT.601 luma in 8.8 fixed point
+        if (channels == 4) {
+            for (int x = 0; x < width; x++) {
+                luma[x] = (guint16)((77 * row[x * 4] + 150 * row[x * 4 + 1] + 29 * row[x * 4 + 2]) >> 8);
+            }
+        } else {
+            for (int x = 0; x < width; x++) {
+                luma[x] = (guint16)((77 * row[x * channels] + 150 * row[x * channels + 1] + 29 * row[x * channels + 2]) >> 8);
+            }
+        }
+
+        guint32 *row_sums = sums[row_bin];
+        guint32 *row_counts = counts[row_bin];
+        for (int x = 0; x < width; x++) {
+            row_sums[column_bin[x]] += luma[x];
+            row_counts[column_bin[x]]++;
+        }
+    }
+
+    g_free(column_bin);
+    g_free(luma);
+
+    // Bit set where a cell is darker than its right neighbour (compared as
+    // averages without dividing)
+    guint64 hash = 0;
+    for (int r = 0; r < DHASH_ROWS; r++) {
+        for (int c = 0; c < DHASH_COLS - 1; c++) {
+            guint64 left = (guint64)sums[r][c] * MAX(counts[r][c + 1], 1u);
+            guint64 right = (guint64)sums[r][c + 1] * MAX(counts[r][c], 1u);
+            hash = (hash << 1) | (left < right ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+gboolean similar_dhash_file(const char *path, SimilarInfo *info, GError **error) {
+    memset(info, 0, sizeof(*info));
+
+    if (!gdk_pixbuf_get_file_info(path, &info->width, &info->height)) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Not a readable image: %s", path);
+        return FALSE;
+    }
+
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale(path, SIMILAR_SAMPLE_WIDTH, SIMILAR_SAMPLE_HEIGHT,
+                                                          FALSE, error);
+    if (!pixbuf) {
+        return FALSE;
+    }
+
+    info->dhash = similar_dhash_rgb(gdk_pixbuf_read_pixels(pixbuf),
+                                    gdk_pixbuf_get_width(pixbuf),
+                                    gdk_pixbuf_get_height(pixbuf),
+                                    gdk_pixbuf_get_rowstride(pixbuf),
+                                    gdk_pixbuf_get_n_channels(pixbuf));
+    info->valid = TRUE;
+    g_object_unref(pixbuf);
+    return TRUE;
+}
+
+// Pool thread: hash one image
+static void similar_task_run(gpointer data, gpointer user_data) {
+    guint i = GPOINTER_TO_UINT(data) - 1;
+    SimilarBatch *batch = user_data;
+
+    if (!g_cancellable_is_cancelled(batch->cancellable)) {
+        GError *error = NULL;
+        if (!similar_dhash_file(g_ptr_array_index(batch->paths, i), &batch->infos[i], &error)) {
+            log_warning("Skipping %s: %s", (char *)g_ptr_array_index(batch->paths, i), error->message);
+            g_error_free(error);
+        }
+    }
+
+    guint done = g_atomic_int_add(&batch->done, 1) + 1;
+    if (batch->progress) {
+        batch->progress(done, batch->paths->len, batch->user_data);
+    }
+}
+
+SimilarInfo* similar_hash_files(GPtrArray *paths, guint max_workers,
+                                SimilarProgressFunc progress, gpointer user_data,
+                                GCancellable *cancellable) {
+    SimilarBatch batch = {
+        .paths = paths,
+        .infos = g_new0(SimilarInfo, MAX(paths->len, 1)),
+        .done = 0,
+        .progress = progress,
+        .user_data = user_data,
+        .cancellable = cancellable,
+    };
+
+    GThreadPool *pool = g_thread_pool_new(similar_task_run, &batch, MAX(1, max_workers), FALSE, NULL);
+    for (guint i = 0; i < paths->len; i++) {
+        g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+    }
+
+    // Wait for every queued image
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    return batch.infos;
+}
+
+// Multi-index hashing: the hash splits into SIMILAR_CHUNKS chunks of
+// SIMILAR_CHUNK_BITS. Two hashes within threshold bits of each other have a
+// chunk within threshold / SIMILAR_CHUNKS bits, so a query only looks in
+// the buckets of its chunks' near variants.
+#define SIMILAR_CHUNKS     4
+#define SIMILAR_CHUNK_BITS 16
+#define SIMILAR_BUCKETS    (1u << SIMILAR_CHUNK_BITS)
+
+typedef struct {
+    guint *offsets[SIMILAR_CHUNKS];     // Bucket start in members, SIMILAR_BUCKETS + 1 each
+    guint *members[SIMILAR_CHUNKS];     // Image indices sorted by chunk value
+} SimilarIndex;
+
+// A query's state while enumerating chunk variants
+typedef struct {
+    const SimilarIndex *index;
+    const SimilarInfo *infos;
+    const gboolean *assigned;
+    guint *seen;            // Query stamp per image, so candidates are checked once
+    guint stamp;
+    guint64 hash;
+    guint threshold;
+    GArray *matches;
+} SimilarQuery;
+
+static guint chunk_of(guint64 hash, guint chunk) {
+    return (guint)(hash >> (chunk * SIMILAR_CHUNK_BITS)) & (SIMILAR_BUCKETS - 1);
+}
+
+// Counting sort of the valid images by each chunk
+static void similar_index_init(SimilarIndex *index, const SimilarInfo *infos, guint count) {
+    for (guint c = 0; c < SIMILAR_CHUNKS; c++) {
+        guint *offsets = g_new0(guint, SIMILAR_BUCKETS + 1);
+        for (guint i = 0; i < count; i++) {
+            if (infos[i].valid) {
+                offsets[chunk_of(infos[i].dhash, c) + 1]++;
+            }
+        }
+        for (guint b = 0; b < SIMILAR_BUCKETS; b++) {
+            offsets[b + 1] += offsets[b];
+        }
+
+        guint *members = g_new(guint, MAX(offsets[SIMILAR_BUCKETS], 1));
+        guint *fill = g_new(guint, SIMILAR_BUCKETS);
+        memcpy(fill, offsets, SIMILAR_BUCKETS * sizeof(guint));
+        for (guint i = 0; i < count; i++) {
+            if (infos[i].valid) {
+                members[fill[chunk_of(infos[i].dhash, c)]++] = i;
+            }
+        }
+        g_free(fill);
+
+        index->offsets[c] = offsets;
+        index->members[c] = members;
+    }
+}
+
+static void similar_index_clear(SimilarIndex *index) {
+    for (guint c = 0; c < SIMILAR_CHUNKS; c++) {
+        g_free(index->offsets[c]);
+        g_free(index->members[c]);
+    }
+}
+
+static void query_bucket(SimilarQuery *query, guint chunk, guint bucket) {
+    const guint *members = query->index->members[chunk];
+    for (guint k = query->index->offsets[chunk][bucket]; k < query->index->offsets[chunk][bucket + 1]; k++) {
+        guint i = members[k];
+        if (query->seen[i] == query->stamp || query->assigned[i]) continue;
+        query->seen[i] = query->stamp;
+        if (similar_distance(query->infos[i].dhash, query->hash) <= query->threshold) {
+            g_array_append_val(query->matches, i);
+        }
+    }
+}
+
+// Visit every chunk value within radius bits of value, flipping bits from
+// first_bit up
+static void query_variants(SimilarQuery *query, guint chunk, guint value, guint first_bit, guint radius) {
+    query_bucket(query, chunk, value);
+    if (radius == 0) return;
+    for (guint bit = first_bit; bit < SIMILAR_CHUNK_BITS; bit++) {
+        query_variants(query, chunk, value ^ (1u << bit), bit + 1, radius - 1);
+    }
+}
+
+// Unassigned images within threshold of hash, in no particular order
+static void similar_index_query(SimilarQuery *query, guint64 hash) {
+    query->hash = hash;
+    query->stamp++;
+    g_array_set_size(query->matches, 0);
+    guint radius = MIN(query->threshold / SIMILAR_CHUNKS, SIMILAR_CHUNK_BITS);
+    for (guint c = 0; c < SIMILAR_CHUNKS; c++) {
+        query_variants(query, c, chunk_of(hash, c), 0, radius);
+    }
+}
+
+static gint compare_indices(gconstpointer a, gconstpointer b) {
+    guint x = *(const guint *)a, y = *(const guint *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Most pixels first, then list order
+static gint compare_keepers(gconstpointer a, gconstpointer b, gpointer data) {
+    const SimilarInfo *infos = data;
+    guint x = *(const guint *)a, y = *(const guint *)b;
+    gint64 area_x = (gint64)infos[x].width * infos[x].height;
+    gint64 area_y = (gint64)infos[y].width * infos[y].height;
+    if (area_x != area_y) {
+        return area_x > area_y ? -1 : 1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+// Each cluster is built around the image it would keep: the largest image
+// not yet in a cluster takes every other unclustered image within
+// threshold of itself. Members are compared with the keeper, never with
+// each other, so a chain of small differences can't pull in a different
+// picture. Candidates come from a multi-index hash instead of comparing
+// all pairs.
+GPtrArray* similar_cluster(const SimilarInfo *infos, guint count, guint threshold) {
+    GArray *order = g_array_new(FALSE, FALSE, sizeof(guint));
+    for (guint i = 0; i < count; i++) {
+        if (infos[i].valid) {
+            g_array_append_val(order, i);
+        }
+    }
+    g_array_sort_with_data(order, compare_keepers, (gpointer)infos);
+
+    SimilarIndex index;
+    similar_index_init(&index, infos, count);
+    gboolean *assigned = g_new0(gboolean, MAX(count, 1));
+    SimilarQuery query = {
+        .index = &index,
+        .infos = infos,
+        .assigned = assigned,
+        .seen = g_new0(guint, MAX(count, 1)),
+        .stamp = 0,
+        .threshold = threshold,
+        .matches = g_array_new(FALSE, FALSE, sizeof(guint)),
+    };
+
+    GPtrArray *clusters = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    for (guint i = 0; i < order->len; i++) {
+        guint keeper = g_array_index(order, guint, i);
+        if (assigned[keeper]) continue;
+        assigned[keeper] = TRUE;
+
+        similar_index_query(&query, infos[keeper].dhash);
+        if (query.matches->len == 0) continue;
+
+        // Singletons aren't duplicates of anything
+        GArray *members = g_array_sized_new(FALSE, FALSE, sizeof(guint), query.matches->len + 1);
+        g_array_append_val(members, keeper);
+        g_array_sort(query.matches, compare_indices);
+        for (guint j = 0; j < query.matches->len; j++) {
+            guint member = g_array_index(query.matches, guint, j);
+            assigned[member] = TRUE;
+            g_array_append_val(members, member);
+        }
+        g_ptr_array_add(clusters, members);
+    }
+
+    g_array_free(query.matches, TRUE);
+    g_free(query.seen);
+    g_free(assigned);
+    similar_index_clear(&index);
+    g_array_free(order, TRUE);
+    return clusters;
+}
@@ -0,0 +1,113 @@
+#include "watcher.h"
+#include "catalog.h"
+#include "log.h"
+#include <string.h>
+#include <gio/gio.h>
+
+struct _Watcher {
+    char *directory;
+    GFile *root;
+    GFileMonitor *monitor;
+    WatcherCallback callback;
+    gpointer user_data;
+};
+
+// Basename of a direct child of the watched directory, or NULL
+static char* watcher_child_name(Watcher *watcher, GFile *file) {
+    if (!file) return NULL;
+
+    GFile *parent = g_file_get_parent(file);
+    gboolean is_child = parent && g_file_equal(parent, watcher->root);
+    if (parent) g_object_unref(parent);
+
+    return is_child ? g_file_get_basename(file) : NULL;
+}
+
+static void watcher_emit(Watcher *watcher, WatcherEventType type, const char *name, const char *new_name) {
+    watcher->callback(type, name, new_name, watcher->user_data);
+}
+
+static void on_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                               GFileMonitorEvent event, gpointer user_data) {
+    (void)monitor;
+    Watcher *watcher = user_data;
+    char *name = watcher_child_name(watcher, file);
+    if (!name) return;
+
+    switch (event) {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+            if (catalog_is_image_file(name)) {
+                watcher_emit(watcher, WATCHER_EVENT_ADDED, name, NULL);
+            }
+            break;
+
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            if (catalog_is_image_file(name)) {
+                watcher_emit(watcher, WATCHER_EVENT_REMOVED, name, NULL);
+            }
+            break;
+
+        case G_FILE_MONITOR_EVENT_RENAMED: {
+            // Renames across the image/non-image boundary become plain adds or removes
+            char *new_name = watcher_child_name(watcher, other_file);
+            gboolean old_is_image = catalog_is_image_file(name);
+            gboolean new_is_image = new_name && catalog_is_image_file(new_name);
+
+            if (old_is_image && new_is_image) {
+                watcher_emit(watcher, WATCHER_EVENT_RENAMED, name, new_name);
+            } else if (old_is_image) {
+                watcher_emit(watcher, WATCHER_EVENT_REMOVED, name, NULL);
+            } else if (new_is_image) {
+                watcher_emit(watcher, WATCHER_EVENT_ADDED, new_name, NULL);
+            }
+            g_free(new_name);
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    g_free(name);
+}
+
+// Start watching a directory. Returns NULL if it can't be monitored.
+Watcher* watcher_new(const char *directory, WatcherCallback callback, gpointer user_data) {
+    GFile *root = g_file_new_for_path(directory);
+    GError *error = NULL;
+    GFileMonitor *monitor = g_file_monitor_directory(root, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+    if (!monitor) {
+        log_warning("Failed to watch %s: %s", directory, error->message);
+        g_error_free(error);
+        g_object_unref(root);
+        return NULL;
+    }
+
+    Watcher *watcher = g_new0(Watcher, 1);
+    watcher->directory = g_strdup(directory);
+    watcher->root = root;
+    watcher->monitor = monitor;
+    watcher->callback = callback;
+    watcher->user_data = user_data;
+
+    g_signal_connect(monitor, "changed", G_CALLBACK(on_monitor_changed), watcher);
+    return watcher;
+}
+
+void watcher_free(Watcher *watcher) {
+    if (!watcher) return;
+
+    g_signal_handlers_disconnect_by_data(watcher->monitor, watcher);
+    g_file_monitor_cancel(watcher->monitor);
+    g_object_unref(watcher->monitor);
+    g_object_unref(watcher->root);
+    g_free(watcher->directory);
+    g_free(watcher);
+}
+
+const char* watcher_get_directory(const Watcher *watcher) {
+    return watcher->directory;
+}
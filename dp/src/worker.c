@@ -0,0 +1,135 @@
+#include "worker.h"
+#include <gio/gio.h>
+
+typedef struct {
+    WorkerLane lane;
+    WorkerFunc func;
+    WorkerDoneFunc done;
+    gpointer data;
+    GDestroyNotify free_data;
+    GCancellable *cancellable;
+} WorkerJob;
+
+typedef struct {
+    GThreadPool *pool;
+    gboolean coalesce;
+    GCancellable *latest;   // Most recent job, main thread only
+    GPtrArray *active;      // Cancellables of queued and running jobs, main thread only
+} WorkerLaneState;
+
+static WorkerLaneState lanes[WORKER_LANE_COUNT];
+static gboolean shutting_down = FALSE;  // Set by worker_shutdown(); later submits are dropped
+
+static void worker_job_free(WorkerJob *job) {
+    if (job->free_data) {
+        job->free_data(job->data);
+    }
+    g_object_unref(job->cancellable);
+    g_free(job);
+}
+
+// Main loop side: report completion and forget the job
+static gboolean worker_job_complete(gpointer user_data) {
+    WorkerJob *job = user_data;
+    WorkerLaneState *lane = &lanes[job->lane];
+
+    if (lane->latest == job->cancellable) {
+        g_clear_object(&lane->latest);
+    }
+    if (lane->active) {
+        g_ptr_array_remove_fast(lane->active, job->cancellable);
+    }
+
+    if (job->done) {
+        job->done(job->data, g_cancellable_is_cancelled(job->cancellable));
+    }
+
+    worker_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+// Worker thread side
+static void worker_job_run(gpointer data, gpointer user_data) {
+    (void)user_data;
+    WorkerJob *job = data;
+
+    if (!g_cancellable_is_cancelled(job->cancellable)) {
+        job->func(job->data, job->cancellable);
+    }
+
+    g_idle_add(worker_job_complete, job);
+}
+
+void worker_init(void) {
+    for (int i = 0; i < WORKER_LANE_COUNT; i++) {
+        if (lanes[i].pool) continue;
+
+        lanes[i].pool = g_thread_pool_new(worker_job_run, NULL, 1, FALSE, NULL);
+        lanes[i].coalesce = (i == WORKER_LANE_APPLY);
+        lanes[i].latest = NULL;
+        lanes[i].active = g_ptr_array_new_with_free_func(g_object_unref);
+    }
+}
+
+// Cancel every queued and running job, wait for the running ones to notice
+// and deliver outstanding completions. Jobs those completions submit are
+// dropped, so nothing runs once this returns.
+void worker_shutdown(void) {
+    shutting_down = TRUE;
+
+    for (int i = 0; i < WORKER_LANE_COUNT; i++) {
+        if (!lanes[i].pool) continue;
+
+        for (guint j = 0; j < lanes[i].active->len; j++) {
+            g_cancellable_cancel(g_ptr_array_index(lanes[i].active, j));
+        }
+        g_thread_pool_free(lanes[i].pool, FALSE, TRUE);
+        lanes[i].pool = NULL;
+    }
+
+    while (g_main_context_iteration(NULL, FALSE));
+
+    for (int i = 0; i < WORKER_LANE_COUNT; i++) {
+        g_clear_object(&lanes[i].latest);
+        if (lanes[i].active) {
+            g_ptr_array_free(lanes[i].active, TRUE);
+            lanes[i].active = NULL;
+        }
+    }
+}
+
+// Queue a job. Must be called from the main thread.
+void worker_submit(WorkerLane lane, WorkerFunc func, WorkerDoneFunc done,
+                   gpointer data, GDestroyNotify free_data) {
+    if (shutting_down) {
+        if (free_data) {
+            free_data(data);
+        }
+        return;
+    }
+
+    WorkerLaneState *state = &lanes[lane];
+    if (!state->pool) {
+        worker_init();
+    }
+
+    WorkerJob *job = g_new0(WorkerJob, 1);
+    job->lane = lane;
+    job->func = func;
+    job->done = done;
+    job->data = data;
+    job->free_data = free_data;
+    job->cancellable = g_cancellable_new();
+
+    // Rapid requests collapse into the newest one
+    if (state->coalesce) {
+        if (state->latest) {
+            g_cancellable_cancel(state->latest);
+            g_object_unref(state->latest);
+        }
+        state->latest = g_object_ref(job->cancellable);
+    }
+    g_ptr_array_add(state->active, g_object_ref(job->cancellable));
+
+    g_thread_pool_push(state->pool, job, NULL);
+}
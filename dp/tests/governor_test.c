@@ -0,0 +1,337 @@
+// Governor against stand-in logind and UPower services on a private bus
+#include "governor.h"
+#include <string.h>
+#include <gio/gio.h>
+
+#define LOGIN1_NAME "org.freedesktop.login1"
+#define LOGIN1_PATH "/org/freedesktop/login1"
+#define SESSION_PATH "/org/freedesktop/login1/session/_31"
+#define UPOWER_NAME "org.freedesktop.UPower"
+#define UPOWER_PATH "/org/freedesktop/UPower"
+#define DISPLAY_PATH "/org/freedesktop/UPower/devices/DisplayDevice"
+#define MOUSE_PATH "/org/freedesktop/UPower/devices/mouse_0"
+
+#define SETTLE_TIMEOUT_MS 2000      // Longest wait for the governor to see a change
+#define INTERVAL 2                  // Seconds between rotations
+
+static const char *services_xml =
+    "<node>"
+    "  <interface name='org.freedesktop.login1.Manager'>"
+    "    <method name='GetSession'><arg type='s' direction='in'/><arg type='o' direction='out'/></method>"
+    "    <method name='GetSessionByPID'><arg type='u' direction='in'/><arg type='o' direction='out'/></method>"
+    "    <signal name='PrepareForSleep'><arg type='b'/></signal>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.login1.Session'>"
+    "    <property name='LockedHint' type='b' access='read'/>"
+    "    <property name='IdleHint' type='b' access='read'/>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.UPower'>"
+    "    <property name='OnBattery' type='b' access='read'/>"
+    "  </interface>"
+    "  <interface name='org.freedesktop.UPower.Device'>"
+    "    <property name='Percentage' type='d' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+// What the stand-in services report
+static struct {
+    gboolean locked;
+    gboolean idle;
+    gboolean on_battery;
+    double percentage;
+} state;
+
+static GTestDBus *bus;
+static GDBusConnection *service;
+
+typedef struct {
+    GDBusConnection *connection;
+    Governor *governor;
+} Fixture;
+
+static Fixture *current;
+static int rotations;
+static int wakes;
+
+static void on_rotate(void) {
+    rotations++;
+}
+
+static void on_woke(void) {
+    wakes++;
+}
+
+static void service_method_call(GDBusConnection *connection, const char *sender, const char *path,
+                                 const char *interface, const char *method, GVariant *parameters,
+                                 GDBusMethodInvocation *invocation, gpointer data) {
+    (void)connection;
+    (void)sender;
+    (void)path;
+    (void)interface;
+    (void)method;
+    (void)parameters;
+    (void)data;
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(o)", SESSION_PATH));
+}
+
+static GVariant* service_get_property(GDBusConnection *connection, const char *sender, const char *path,
+                                      const char *interface, const char *name, GError **error,
+                                      gpointer data) {
+    (void)connection;
+    (void)sender;
+    (void)path;
+    (void)interface;
+    (void)error;
+    (void)data;
+    if (strcmp(name, "LockedHint") == 0) return g_variant_new_boolean(state.locked);
+    if (strcmp(name, "IdleHint") == 0) return g_variant_new_boolean(state.idle);
+    if (strcmp(name, "OnBattery") == 0) return g_variant_new_boolean(state.on_battery);
+    return g_variant_new_double(state.percentage);
+}
+
+static void emit_changed(const char *path, const char *interface, const char *name, GVariant *value) {
+    GVariantBuilder changed;
+    g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(&changed, "{sv}", name, value);
+    g_dbus_connection_emit_signal(service, NULL, path, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+                                  g_variant_new("(sa{sv}as)", interface, &changed, NULL), NULL);
+    g_dbus_connection_flush_sync(service, NULL, NULL);
+}
+
+static void set_locked(gboolean locked) {
+    state.locked = locked;
+    emit_changed(SESSION_PATH, "org.freedesktop.login1.Session", "LockedHint", g_variant_new_boolean(locked));
+}
+
+static void set_battery(gboolean on_battery, double percentage) {
+    state.on_battery = on_battery;
+    state.percentage = percentage;
+    emit_changed(UPOWER_PATH, "org.freedesktop.UPower", "OnBattery", g_variant_new_boolean(on_battery));
+    emit_changed(DISPLAY_PATH, "org.freedesktop.UPower.Device", "Percentage", g_variant_new_double(percentage));
+}
+
+static void emit_sleep(gboolean sleeping) {
+    g_dbus_connection_emit_signal(service, NULL, LOGIN1_PATH, "org.freedesktop.login1.Manager",
+                                  "PrepareForSleep", g_variant_new("(b)", sleeping), NULL);
+    g_dbus_connection_flush_sync(service, NULL, NULL);
+}
+
+static gboolean on_timeout(gpointer data) {
+    *(gboolean*)data = TRUE;
+    return G_SOURCE_REMOVE;
+}
+
+static void run_for(guint milliseconds) {
+    gboolean done = FALSE;
+    g_timeout_add(milliseconds, on_timeout, &done);
+    while (!done) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+}
+
+// Run the loop until the governor reports reasons; signals and property
+// replies arrive asynchronously
+static gboolean wait_for_reasons(guint reasons) {
+    gboolean expired = FALSE;
+    guint timeout = g_timeout_add(SETTLE_TIMEOUT_MS, on_timeout, &expired);
+    while (!expired && governor_get_pause_reasons(current->governor) != reasons) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+    if (!expired) {
+        g_source_remove(timeout);
+    }
+    return governor_get_pause_reasons(current->governor) == reasons;
+}
+
+static void fixture_setup(Fixture *fixture, gconstpointer data) {
+    (void)data;
+    GError *error = NULL;
+    state.locked = FALSE;
+    state.idle = FALSE;
+    state.on_battery = FALSE;
+    state.percentage = 80;
+    rotations = 0;
+    wakes = 0;
+
+    // The governor gets a connection of its own, as it would to the system bus
+    fixture->connection = g_dbus_connection_new_for_address_sync(
+        g_test_dbus_get_bus_address(bus),
+        G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+        NULL, NULL, &error);
+    g_assert_no_error(error);
+
+    static const GovernorHandlers handlers = { on_rotate, on_woke };
+    fixture->governor = governor_new(&handlers);
+    current = fixture;
+    governor_watch(fixture->governor, fixture->connection);
+    governor_start(fixture->governor, INTERVAL);
+
+    // Let the initial property fetches land
+    run_for(200);
+    g_assert_cmpuint(governor_get_pause_reasons(fixture->governor), ==, 0);
+}
+
+static void fixture_teardown(Fixture *fixture, gconstpointer data) {
+    (void)data;
+    governor_free(fixture->governor);
+    g_dbus_connection_close_sync(fixture->connection, NULL, NULL);
+    g_object_unref(fixture->connection);
+    current = NULL;
+}
+
+static void test_lock_pauses(Fixture *fixture, gconstpointer data) {
+    (void)data;
+    set_locked(TRUE);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_LOCKED));
+
+    // No rotations while locked, however long it lasts
+    run_for(INTERVAL * 1000 + 700);
+    g_assert_cmpint(rotations, ==, 0);
+    g_assert_true(governor_is_running(fixture->governor));
+
+    // The rotation that came due happens once on unlock, and the next one
+    // is a full interval later
+    set_locked(FALSE);
+    g_assert_true(wait_for_reasons(0));
+    g_assert_cmpint(rotations, ==, 1);
+    run_for(1000);
+    g_assert_cmpint(rotations, ==, 1);
+}
+
+static void test_short_lock_no_catch_up(Fixture *fixture, gconstpointer data) {
+    (void)fixture;
+    (void)data;
+    set_locked(TRUE);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_LOCKED));
+    set_locked(FALSE);
+    g_assert_true(wait_for_reasons(0));
+    g_assert_cmpint(rotations, ==, 0);
+}
+
+static void test_low_battery_pauses(Fixture *fixture, gconstpointer data) {
+    (void)fixture;
+    (void)data;
+    set_battery(TRUE, 50);
+    run_for(200);
+    g_assert_cmpuint(governor_get_pause_reasons(fixture->governor), ==, 0);
+
+    set_battery(TRUE, 10);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_BATTERY));
+
+    // Back on the charger
+    set_battery(FALSE, 10);
+    g_assert_true(wait_for_reasons(0));
+}
+
+static void test_other_devices_ignored(Fixture *fixture, gconstpointer data) {
+    (void)data;
+    set_battery(TRUE, 50);
+    run_for(200);
+
+    // A nearly flat mouse is not the laptop battery
+    emit_changed(MOUSE_PATH, "org.freedesktop.UPower.Device", "Percentage", g_variant_new_double(5));
+    run_for(300);
+    g_assert_cmpuint(governor_get_pause_reasons(fixture->governor), ==, 0);
+
+    set_battery(TRUE, 10);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_BATTERY));
+    emit_changed(MOUSE_PATH, "org.freedesktop.UPower.Device", "Percentage", g_variant_new_double(90));
+    run_for(300);
+    g_assert_cmpuint(governor_get_pause_reasons(fixture->governor), ==, GOVERNOR_PAUSE_BATTERY);
+}
+
+static void test_sleep_pauses(Fixture *fixture, gconstpointer data) {
+    (void)fixture;
+    (void)data;
+    emit_sleep(TRUE);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_SLEEP));
+    run_for(INTERVAL * 1000 + 700);
+    g_assert_cmpint(rotations, ==, 0);
+
+    emit_sleep(FALSE);
+    g_assert_true(wait_for_reasons(0));
+    g_assert_cmpint(wakes, ==, 1);
+    g_assert_cmpint(rotations, ==, 1);
+}
+
+static void test_pauses_combine(Fixture *fixture, gconstpointer data) {
+    (void)fixture;
+    (void)data;
+    set_locked(TRUE);
+    set_battery(TRUE, 10);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_LOCKED | GOVERNOR_PAUSE_BATTERY));
+    run_for(INTERVAL * 1000 + 700);
+
+    // Still paused until every reason clears, then one catch-up
+    set_locked(FALSE);
+    g_assert_true(wait_for_reasons(GOVERNOR_PAUSE_BATTERY));
+    g_assert_cmpint(rotations, ==, 0);
+    set_battery(FALSE, 10);
+    g_assert_true(wait_for_reasons(0));
+    g_assert_cmpint(rotations, ==, 1);
+}
+
+static void export_services(void) {
+    GError *error = NULL;
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(services_xml, &error);
+    g_assert_no_error(error);
+
+    static const GDBusInterfaceVTable vtable = { service_method_call, service_get_property, NULL, { 0 } };
+    static const struct {
+        const char *path;
+        guint interface;
+    } objects[] = {
+        { LOGIN1_PATH, 0 },
+        { SESSION_PATH, 1 },
+        { UPOWER_PATH, 2 },
+        { DISPLAY_PATH, 3 },
+        { MOUSE_PATH, 3 }
+    };
+    for (guint i = 0; i < G_N_ELEMENTS(objects); i++) {
+        g_dbus_connection_register_object(service, objects[i].path, info->interfaces[objects[i].interface],
+                                          &vtable, NULL, NULL, &error);
+        g_assert_no_error(error);
+    }
+    g_dbus_node_info_unref(info);
+
+    GVariant *reply;
+    const char *names[] = { LOGIN1_NAME, UPOWER_NAME };
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++) {
+        reply = g_dbus_connection_call_sync(service, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                            "org.freedesktop.DBus", "RequestName",
+                                            g_variant_new("(su)", names[i], 0), G_VARIANT_TYPE("(u)"),
+                                            G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+        g_assert_no_error(error);
+        g_variant_unref(reply);
+    }
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+
+    // The session lookup goes by PID on the stand-in
+    g_unsetenv("XDG_SESSION_ID");
+
+    bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(bus);
+    GError *error = NULL;
+    service = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    g_assert_no_error(error);
+    export_services();
+
+    g_test_add("/governor/lock-pauses", Fixture, NULL, fixture_setup, test_lock_pauses, fixture_teardown);
+    g_test_add("/governor/short-lock-no-catch-up", Fixture, NULL, fixture_setup, test_short_lock_no_catch_up,
+               fixture_teardown);
+    g_test_add("/governor/low-battery-pauses", Fixture, NULL, fixture_setup, test_low_battery_pauses,
+               fixture_teardown);
+    g_test_add("/governor/other-devices-ignored", Fixture, NULL, fixture_setup, test_other_devices_ignored,
+               fixture_teardown);
+    g_test_add("/governor/sleep-pauses", Fixture, NULL, fixture_setup, test_sleep_pauses, fixture_teardown);
+    g_test_add("/governor/pauses-combine", Fixture, NULL, fixture_setup, test_pauses_combine, fixture_teardown);
+    int result = g_test_run();
+
+    g_object_unref(service);
+    g_test_dbus_down(bus);
+    g_object_unref(bus);
+    return result;
+}